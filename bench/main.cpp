@@ -0,0 +1,324 @@
+//===- main.cpp - fast-presburger benchmarks ------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Self-timed benchmarks of the main Presburger operations on generated inputs.
+//
+//   fast-presburger-bench [filter]
+//
+// runs every benchmark whose name contains `filter` (all of them by default)
+// and prints, per iteration, the time taken, the number of Simplex pivots and
+// the number of large MPInt results. The last two are only counted when the
+// library is built with FAST_PRESBURGER_ENABLE_STATISTICS.
+//
+// Inputs are drawn from a fixed seed, so runs are comparable across builds.
+//
+//===----------------------------------------------------------------------===//
+
+#include "IntegerRelation.h"
+#include "Parallel.h"
+#include "PresburgerRelation.h"
+#include "Simplex.h"
+#include "Statistics.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mlir;
+using namespace presburger;
+
+namespace {
+
+/// Deterministic generator for the parameterized input families.
+class InputGenerator {
+public:
+  explicit InputGenerator(uint64_t seed) : rng(seed) {}
+
+  int64_t uniform(int64_t lo, int64_t hi) {
+    return std::uniform_int_distribution<int64_t>(lo, hi)(rng);
+  }
+
+  /// Return a polytope over `numVars` vars in `space`, made of `numIneqs`
+  /// random inequalities intersected with the box [-bound, bound]^numVars.
+  /// Each coefficient is non-zero with probability `density` and has magnitude
+  /// at most `maxCoeff`. The inequalities are shifted so that a random point
+  /// of the box satisfies all of them, so the polytope is never empty.
+  IntegerRelation randomPolytope(const PresburgerSpace &space,
+                                 unsigned numIneqs, double density,
+                                 int64_t maxCoeff, int64_t bound) {
+    unsigned numVars = space.getNumVars();
+    IntegerRelation rel(space);
+    SmallVector<MPInt, 8> center;
+    for (unsigned v = 0; v < numVars; ++v)
+      center.push_back(MPInt(uniform(-bound / 2, bound / 2)));
+
+    SmallVector<MPInt, 8> ineq(numVars + 1);
+    for (unsigned v = 0; v < numVars; ++v) {
+      std::fill(ineq.begin(), ineq.end(), MPInt(0));
+      ineq[v] = 1;
+      ineq.back() = bound;
+      rel.addInequality(ineq);
+      ineq[v] = -1;
+      rel.addInequality(ineq);
+    }
+
+    std::bernoulli_distribution isNonZero(density);
+    for (unsigned r = 0; r < numIneqs; ++r) {
+      MPInt valueAtCenter(0);
+      for (unsigned v = 0; v < numVars; ++v) {
+        ineq[v] = isNonZero(rng) ? MPInt(uniform(-maxCoeff, maxCoeff)) : 0;
+        valueAtCenter += ineq[v] * center[v];
+      }
+      ineq.back() = -valueAtCenter + MPInt(uniform(0, maxCoeff));
+      rel.addInequality(ineq);
+    }
+    return rel;
+  }
+
+  /// Return the dependence system of a perfect loop nest of depth `depth`
+  /// with `n` iterations per loop, where iteration i writes and iteration j
+  /// reads the same element of an array through random affine accesses, and
+  /// i precedes j at loop level `level`. The vars are [i..., j...] in `space`.
+  IntegerRelation dependenceSystem(const PresburgerSpace &space,
+                                   unsigned depth, unsigned level, int64_t n) {
+    unsigned numVars = 2 * depth;
+    assert(space.getNumVars() == numVars && "space must have 2 * depth vars");
+    IntegerRelation rel(space);
+    SmallVector<int64_t, 8> row(numVars + 1);
+
+    // 0 <= i_k, j_k <= n - 1.
+    for (unsigned v = 0; v < numVars; ++v) {
+      std::fill(row.begin(), row.end(), 0);
+      row[v] = 1;
+      rel.addInequality(row);
+      row[v] = -1;
+      row.back() = n - 1;
+      rel.addInequality(row);
+    }
+
+    // A * i + b == A * j + b' for each array dimension.
+    for (unsigned d = 0; d < depth; ++d) {
+      std::fill(row.begin(), row.end(), 0);
+      for (unsigned k = 0; k < depth; ++k) {
+        int64_t coeff = uniform(-2, 2);
+        row[k] = coeff;
+        row[depth + k] = -coeff;
+      }
+      row.back() = uniform(-3, 3);
+      rel.addEquality(row);
+    }
+
+    // i_k == j_k for k < level, and i_level + 1 <= j_level.
+    for (unsigned k = 0; k <= level && k < depth; ++k) {
+      std::fill(row.begin(), row.end(), 0);
+      row[k] = -1;
+      row[depth + k] = 1;
+      if (k < level) {
+        rel.addEquality(row);
+      } else {
+        row.back() = -1;
+        rel.addInequality(row);
+      }
+    }
+    return rel;
+  }
+
+private:
+  std::mt19937_64 rng;
+};
+
+struct Benchmark {
+  std::string name;
+  std::function<void()> run;
+};
+
+/// Keeps the results of the benchmarked calls alive so that they are not
+/// optimized away.
+volatile uint64_t sink;
+
+void consume(bool value) { sink = sink + value; }
+void consume(uint64_t value) { sink = sink + value; }
+
+void runBenchmark(const Benchmark &bench) {
+  using Clock = std::chrono::steady_clock;
+  constexpr double kMinSeconds = 0.2;
+  constexpr unsigned kMinIterations = 3;
+
+  resetStatistics();
+  unsigned iterations = 0;
+  Clock::time_point start = Clock::now();
+  double elapsed = 0;
+  while (iterations < kMinIterations || elapsed < kMinSeconds) {
+    bench.run();
+    ++iterations;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  Statistics stats = getStatistics();
+
+  std::printf("%-44s %8u %14.1f", bench.name.c_str(), iterations,
+              elapsed * 1e6 / iterations);
+  if (areStatisticsEnabled())
+    std::printf(" %12.1f %12.1f\n", double(stats.numPivots) / iterations,
+                double(stats.numMPIntPromotions) / iterations);
+  else
+    std::printf(" %12s %12s\n", "n/a", "n/a");
+}
+
+/// A named input of the families above.
+struct Input {
+  std::string name;
+  IntegerRelation rel;
+};
+
+std::vector<Input> getSetInputs(InputGenerator &gen) {
+  std::vector<Input> inputs;
+  auto setSpace = [](unsigned numDims) {
+    return PresburgerSpace::getSetSpace(numDims);
+  };
+  inputs.push_back({"dense-n6-m12",
+                    gen.randomPolytope(setSpace(6), 12, 1.0, 10, 100)});
+  inputs.push_back({"dense-n10-m20",
+                    gen.randomPolytope(setSpace(10), 20, 1.0, 10, 100)});
+  inputs.push_back({"sparse-n12-m24",
+                    gen.randomPolytope(setSpace(12), 24, 0.25, 10, 100)});
+  inputs.push_back(
+      {"depend-d3", gen.dependenceSystem(setSpace(6), 3, 1, 1000)});
+  inputs.push_back(
+      {"depend-d4", gen.dependenceSystem(setSpace(8), 4, 2, 1000)});
+  inputs.push_back(
+      {"bigcoeff-n6-m12",
+       gen.randomPolytope(setSpace(6), 12, 1.0, int64_t(1) << 40,
+                          int64_t(1) << 40)});
+  return inputs;
+}
+
+/// Return a union of `numDisjuncts` random polytopes in `numDims` dims.
+PresburgerSet randomUnion(InputGenerator &gen, unsigned numDims,
+                          unsigned numDisjuncts, unsigned numIneqs,
+                          int64_t bound) {
+  PresburgerSpace space = PresburgerSpace::getSetSpace(numDims);
+  PresburgerSet result = PresburgerSet::getEmpty(space);
+  for (unsigned i = 0; i < numDisjuncts; ++i)
+    result.unionInPlace(
+        gen.randomPolytope(space, numIneqs, 1.0, 5, bound));
+  return result;
+}
+
+/// Return a union of `numBoxes` random axis-aligned boxes in `numDims` dims,
+/// many of which overlap or contain each other.
+PresburgerSet randomBoxes(InputGenerator &gen, unsigned numDims,
+                          unsigned numBoxes) {
+  PresburgerSpace space = PresburgerSpace::getSetSpace(numDims);
+  PresburgerSet result = PresburgerSet::getEmpty(space);
+  SmallVector<int64_t, 8> row(numDims + 1);
+  for (unsigned b = 0; b < numBoxes; ++b) {
+    IntegerRelation box(space);
+    for (unsigned v = 0; v < numDims; ++v) {
+      int64_t lo = gen.uniform(0, 20);
+      int64_t hi = lo + gen.uniform(0, 10);
+      std::fill(row.begin(), row.end(), 0);
+      row[v] = 1;
+      row.back() = -lo;
+      box.addInequality(row);
+      row[v] = -1;
+      row.back() = hi;
+      box.addInequality(row);
+    }
+    result.unionInPlace(box);
+  }
+  return result;
+}
+
+std::vector<Benchmark> getBenchmarks() {
+  InputGenerator gen(/*seed=*/42);
+  std::vector<Benchmark> benchmarks;
+
+  for (const Input &input : getSetInputs(gen)) {
+    IntegerRelation rel = input.rel;
+    benchmarks.push_back({"isEmpty/" + input.name,
+                          [rel] { consume(rel.isEmpty()); }});
+    benchmarks.push_back(
+        {"findIntegerSample/" + input.name,
+         [rel] { consume(rel.findIntegerSample().has_value()); }});
+    benchmarks.push_back({"computeVolume/" + input.name, [rel] {
+                            consume(rel.computeVolume().has_value());
+                          }});
+    benchmarks.push_back({"projectOut/" + input.name, [rel] {
+                            IntegerRelation copy = rel;
+                            copy.projectOut(0, copy.getNumVars() / 2);
+                            consume(uint64_t(copy.getNumConstraints()));
+                          }});
+  }
+
+  for (unsigned depth : {2u, 3u}) {
+    IntegerRelation rel = gen.dependenceSystem(
+        PresburgerSpace::getRelationSpace(depth, depth), depth, depth - 1,
+        100);
+    benchmarks.push_back(
+        {"findSymbolicIntegerLexMin/depend-d" + std::to_string(depth), [rel] {
+           consume(uint64_t(
+               rel.findSymbolicIntegerLexMin().lexmin.getNumPieces()));
+         }});
+  }
+  IntegerRelation symbolic = gen.randomPolytope(
+      PresburgerSpace::getRelationSpace(2, 3), 8, 1.0, 5, 50);
+  benchmarks.push_back({"findSymbolicIntegerLexMin/dense-d2-r3", [symbolic] {
+                          consume(uint64_t(symbolic.findSymbolicIntegerLexMin()
+                                               .lexmin.getNumPieces()));
+                        }});
+
+  // Enough inequalities for removeRedundantInequalities to screen them in
+  // parallel when more than one thread is allowed.
+  IntegerRelation redundant = gen.randomPolytope(
+      PresburgerSpace::getSetSpace(4), 40, 1.0, 10, 100);
+  for (unsigned numThreads : {1u, 4u}) {
+    benchmarks.push_back(
+        {"removeRedundantInequalities/dense-n4-m40-t" +
+             std::to_string(numThreads),
+         [redundant, numThreads] {
+           setMaxNumThreads(numThreads);
+           IntegerRelation copy = redundant;
+           copy.removeRedundantInequalities();
+           setMaxNumThreads(1);
+           consume(uint64_t(copy.getNumInequalities()));
+         }});
+  }
+
+  for (unsigned numDisjuncts : {2u, 4u}) {
+    PresburgerSet lhs = randomUnion(gen, 3, numDisjuncts, 4, 20);
+    PresburgerSet rhs = randomUnion(gen, 3, numDisjuncts, 4, 20);
+    benchmarks.push_back(
+        {"subtract/union-n3-k" + std::to_string(numDisjuncts), [lhs, rhs] {
+           consume(uint64_t(lhs.subtract(rhs).getNumDisjuncts()));
+         }});
+  }
+
+  for (unsigned numBoxes : {16u, 64u}) {
+    PresburgerSet boxes = randomBoxes(gen, 2, numBoxes);
+    benchmarks.push_back(
+        {"coalesce/boxes-n2-k" + std::to_string(numBoxes), [boxes] {
+           consume(uint64_t(boxes.coalesce().getNumDisjuncts()));
+         }});
+  }
+
+  return benchmarks;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string filter = argc > 1 ? argv[1] : "";
+  std::printf("%-44s %8s %14s %12s %12s\n", "benchmark", "iters", "us/iter",
+              "pivots/iter", "large/iter");
+  for (const Benchmark &bench : getBenchmarks())
+    if (bench.name.find(filter) != std::string::npos)
+      runBenchmark(bench);
+  return 0;
+}
@@ -0,0 +1,150 @@
+//===- IntegerPointEnumerator.h - MLIR IntegerPointEnumerator ---*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Streaming enumeration of the integer points of bounded sets, in
+// lexicographic order.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_INTEGERPOINTENUMERATOR_H
+#define MLIR_ANALYSIS_PRESBURGER_INTEGERPOINTENUMERATOR_H
+
+#include "IntegerRelation.h"
+#include "PresburgerRelation.h"
+#include "Simplex.h"
+#include <optional>
+
+namespace mlir {
+namespace presburger {
+
+/// Enumerates the integer points of the projection of a relation, or of a
+/// union of relations, onto its non-local vars, in lexicographic order. The
+/// points are written as int64 vectors into caller-provided buffers, in
+/// chunks, so that enumerating does not allocate per point.
+///
+/// The vars are fixed one at a time, in order, to each integer value between
+/// their bounds given the values of the previous vars, which are computed with
+/// a Simplex. When the relation has no locals, or only locals that are
+/// determined by the other vars, such as divisions, every value of the last
+/// var between its bounds gives a point, so runs of points along the last var
+/// are written without further Simplex queries. Otherwise, each candidate
+/// point is checked for an integer assignment to the locals.
+///
+/// The relation must have no symbol vars, every non-local var must take
+/// finitely many integer values, and the values must fit in an int64_t.
+class IntegerPointEnumerator {
+public:
+  explicit IntegerPointEnumerator(const IntegerRelation &rel);
+  /// Enumerate the points of a union. Overlapping disjuncts are made disjoint
+  /// first, so every point is produced once; this uses
+  /// computeReprWithOnlyDivLocals() if some local is not a division.
+  explicit IntegerPointEnumerator(const PresburgerRelation &rel);
+
+  /// Only enumerate the points whose first var is in [outerBegin, outerEnd].
+  /// This is used to split the enumeration between threads.
+  IntegerPointEnumerator(const IntegerRelation &rel, int64_t outerBegin,
+                         int64_t outerEnd);
+  IntegerPointEnumerator(const PresburgerRelation &rel, int64_t outerBegin,
+                         int64_t outerEnd);
+
+  /// Return the number of values in each point, i.e., the number of non-local
+  /// vars.
+  unsigned getNumDims() const { return numDims; }
+
+  /// Write the next points, up to `buffer.size() / getNumDims()` of them, to
+  /// `buffer`, one after the other, and return the number of points written.
+  /// If the relation has no non-local vars, its only possible point is empty
+  /// and is returned in the first call with a non-empty buffer. Returns zero
+  /// once all the points have been enumerated.
+  unsigned getNextChunk(MutableArrayRef<int64_t> buffer);
+
+  /// Return the bounds of the first var of `rel`, or std::nullopt if `rel` is
+  /// rationally empty or has no non-local vars. The relation must be bounded.
+  static std::optional<std::pair<int64_t, int64_t>>
+  getOuterBounds(const IntegerRelation &rel);
+  static std::optional<std::pair<int64_t, int64_t>>
+  getOuterBounds(const PresburgerRelation &rel);
+
+private:
+  /// Enumerates the points of one relation.
+  class DisjunctEnumerator {
+  public:
+    DisjunctEnumerator(const IntegerRelation &rel,
+                       std::optional<std::pair<int64_t, int64_t>> outerRange);
+
+    /// Write up to `maxPoints` next points to `out`, and return their number.
+    unsigned getNextChunk(int64_t *out, unsigned maxPoints);
+
+  private:
+    /// Compute the bounds of var `level` given the values of the previous
+    /// ones, which must be fixed in the simplex, into lower[level] and
+    /// upper[level]. Returns false if the var takes no integer value.
+    bool computeBounds(unsigned level);
+
+    /// Leave the innermost active level, and move the previous one to its
+    /// next value.
+    void ascend();
+
+    /// Return whether the values in `values` are a point of the projection.
+    bool isProjectionPoint();
+
+    IntegerRelation rel;
+    Simplex simplex;
+    std::optional<std::pair<int64_t, int64_t>> outerRange;
+    unsigned numDims;
+    /// The number of vars whose values are enumerated.
+    unsigned numEnumerated;
+    /// Whether every value of the last enumerated var between its bounds
+    /// gives a point.
+    bool isLastExact;
+    /// The number of levels whose values are being enumerated. The vars of
+    /// all the active levels but the innermost one are fixed in the simplex.
+    unsigned depth = 0;
+    /// Whether the empty point of a relation without enumerated vars is still
+    /// to be returned.
+    bool hasPendingEmptyPoint = false;
+    /// The current value and the upper bound of each active level.
+    SmallVector<int64_t, 8> values, upper;
+    /// The snapshot taken before fixing the var of each active level.
+    SmallVector<unsigned, 8> snapshots;
+    /// Scratch space for the objective and constraint rows, and for the
+    /// values of the non-local vars when checking the locals.
+    SmallVector<MPInt, 8> row, point;
+  };
+
+  void init(const PresburgerRelation &rel,
+            std::optional<std::pair<int64_t, int64_t>> outerRange);
+
+  /// Fill the lookahead point of `part`, marking it exhausted if there is none.
+  void refill(unsigned part);
+
+  unsigned numDims;
+  SmallVector<DisjunctEnumerator, 1> parts;
+  /// With more than one part, the parts are merged in lexicographic order
+  /// using one point of lookahead per part, stored contiguously.
+  SmallVector<int64_t, 8> lookahead;
+  SmallVector<bool, 4> hasLookahead;
+  bool isLookaheadInitialized = false;
+};
+
+/// Enumerate the integer points of `rel` in parallel with parallelFor. The
+/// values of the first var are split into up to `numParts` contiguous ranges,
+/// and the points of each range are enumerated by a separate
+/// IntegerPointEnumerator. `fn(part, points)` is called with chunks of at most
+/// `chunkSize` points, laid out as by IntegerPointEnumerator::getNextChunk.
+/// Calls for different parts may run concurrently; the chunks of each part are
+/// passed in lexicographic order, and the points of a part precede those of
+/// the next one.
+void parallelForEachIntegerPointChunk(
+    const PresburgerRelation &rel, unsigned numParts, unsigned chunkSize,
+    llvm::function_ref<void(unsigned part, ArrayRef<int64_t> points)> fn);
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_INTEGERPOINTENUMERATOR_H
@@ -20,7 +20,9 @@
 #include "PresburgerSpace.h"
 #include "Utils.h"
 //#include "mlir/Support/LogicalResult.h"
+#include <memory>
 #include <optional>
+#include <unordered_map>
 
 namespace mlir {
 namespace presburger {
@@ -140,7 +142,11 @@ public:
   inline int64_t atEq64(unsigned i, unsigned j) const {
     return int64_t(equalities(i, j));
   }
-  inline MPInt &atEq(unsigned i, unsigned j) { return equalities(i, j); }
+  inline MPInt &atEq(unsigned i, unsigned j) {
+    invalidateLocalReprs();
+    invalidateConstraintIndex();
+    return equalities(i, j);
+  }
 
   /// Returns the value at the specified inequality row and column.
   inline MPInt atIneq(unsigned i, unsigned j) const {
@@ -151,7 +157,11 @@ public:
   inline int64_t atIneq64(unsigned i, unsigned j) const {
     return int64_t(inequalities(i, j));
   }
-  inline MPInt &atIneq(unsigned i, unsigned j) { return inequalities(i, j); }
+  inline MPInt &atIneq(unsigned i, unsigned j) {
+    invalidateLocalReprs();
+    invalidateConstraintIndex();
+    return inequalities(i, j);
+  }
 
   unsigned getNumConstraints() const {
     return getNumInequalities() + getNumEqualities();
@@ -199,6 +209,24 @@ public:
   inline SmallVector<int64_t, 8> getInequality64(unsigned idx) const {
     return getInt64Vec(inequalities.getRow(idx));
   }
+  /// The same, but stores the result in `result`, reusing its storage.
+  inline void getEquality64(unsigned idx,
+                            SmallVectorImpl<int64_t> &result) const {
+    getInt64Vec(equalities.getRow(idx), result);
+  }
+  inline void getInequality64(unsigned idx,
+                              SmallVectorImpl<int64_t> &result) const {
+    getInt64Vec(inequalities.getRow(idx), result);
+  }
+
+  /// Get a view of the coefficients of the pos^th column over all the
+  /// equalities or inequalities, without copying them.
+  inline StridedArrayRef getEqualityColumn(unsigned pos) const {
+    return equalities.getColumn(pos);
+  }
+  inline StridedArrayRef getInequalityColumn(unsigned pos) const {
+    return inequalities.getColumn(pos);
+  }
 
   /// Get the number of vars of the specified kind.
   unsigned getNumVarKind(VarKind kind) const {
@@ -249,6 +277,31 @@ public:
   CountsSnapshot getCounts() const;
   void truncate(const CountsSnapshot &counts);
 
+  /// Start recording edits in an undo log, if not already recording, and
+  /// return a snapshot of the current state. rollback() undoes the edits made
+  /// since the snapshot was taken, in reverse order, restoring the relation.
+  /// This allows speculative edits without copying the relation.
+  ///
+  /// Recording and undoing an edit takes time proportional to the data it
+  /// changes. The recorded edits are: adding, removing or (through constraint
+  /// uniquing) replacing constraints, inserting, removing and swapping vars,
+  /// and setAndEliminate. Operations built from these, like append, truncate,
+  /// convertVarKind, inverse, mergeLocalVars, intersectDomain and
+  /// intersectRange, are recorded too. projectOut, which rewrites most of the
+  /// constraints, and clearAndCopyFrom record a copy of the constraints. Plain
+  /// assignment keeps the undo log of the relation assigned to, but is not
+  /// recorded. Other edits, e.g., simplifications
+  /// and normalizations, are not recorded and must not be made while
+  /// recording.
+  unsigned getSnapshot();
+  void rollback(unsigned snapshot);
+
+  /// Stop recording edits and drop the undo log, invalidating all snapshots.
+  void discardUndoLog();
+
+  /// Return whether edits are being recorded in the undo log.
+  bool isRecordingUndo() const { return undo.isRecording; }
+
   /// Insert `num` variables of the specified kind at position `pos`.
   /// Positions are relative to the kind of variable. The coefficient columns
   /// corresponding to the added variables are initialized to zero. Return the
@@ -271,6 +324,23 @@ public:
   void addEquality(ArrayRef<MPInt> eq);
   void addEquality(ArrayRef<int64_t> eq) { addEquality(getMPIntVec(eq)); }
 
+  /// Enable or disable uniquing of constraints on insertion. While enabled,
+  /// addInequality, addEquality and addBound, and hence append and intersect,
+  /// drop a constraint that is trivially true or that is equivalent, after
+  /// normalization by the GCD of its coefficients, to one already present. Of
+  /// two inequalities that only differ in their constant term after
+  /// normalization, only the tighter one is kept, in the position of the
+  /// existing one. Each insertion takes expected constant time in the number
+  /// of constraints, except after constraints are removed or rewritten, e.g.,
+  /// by projectOut or removeRedundantConstraints, when the index of the
+  /// constraints is first rebuilt. Constraints added by other means are not
+  /// uniqued, though the ones present when uniquing is enabled, or when the
+  /// index is rebuilt, are indexed. Disabled by default.
+  void setConstraintUniquing(bool enable);
+  bool isConstraintUniquingEnabled() const {
+    return constraintIndex.has_value();
+  }
+
   /// Eliminate the `posB^th` local variable, replacing every instance of it
   /// with the `posA^th` local variable. This should be used when the two
   /// local variables are known to always take the same values.
@@ -345,6 +415,50 @@ public:
   /// returns true, no integer solution to the equality constraints can exist.
   bool isEmptyByGCDTest() const;
 
+  /// The stages of runEmptinessPrefilter, in the order in which they run.
+  enum class EmptinessStage {
+    /// No stage could decide whether the relation is integer empty.
+    Undecided,
+    /// The relation is small enough for isIntegerEmptyBySmallSimplex, which
+    /// decided it.
+    SmallSimplex,
+    /// A constraint without variables is violated.
+    InvalidConstraint,
+    /// The GCD test fails for an equality.
+    GCDTest,
+    /// Two inequalities a.x + c1 >= 0 and -a.x + c2 >= 0 with c1 + c2 < 0.
+    OpposingInequalities,
+    /// Propagating constant bounds on the variables yields an empty range or
+    /// shows that a constraint cannot be satisfied.
+    ConstantBounds,
+    /// The constant bounds enclose few enough points to check them all.
+    SmallSystem,
+  };
+
+  struct EmptinessPrefilterResult {
+    /// The stage that decided, or Undecided.
+    EmptinessStage stage = EmptinessStage::Undecided;
+    /// Whether the relation is integer empty, if some stage decided it.
+    std::optional<bool> isEmpty;
+    /// If the relation was found to be non-empty, an integer point in it,
+    /// including the values of local vars.
+    SmallVector<MPInt, 8> sample;
+  };
+
+  /// Try to decide whether the relation is integer empty by a sequence of
+  /// cheap checks. Tiny relations are first decided by
+  /// isIntegerEmptyBySmallSimplex, a fixed-size int64_t Simplex that does not
+  /// allocate. If it gives up, or the relation is larger, the remaining checks
+  /// need no Simplex: checking constraints without variables, the GCD test,
+  /// looking for opposing parallel inequalities, propagating constant bounds
+  /// through the constraints, and, if the bounds enclose at most
+  /// kMaxPrefilterPoints points, testing all of them. Stops at the first stage
+  /// that decides. isEmpty and findIntegerSample run this first.
+  EmptinessPrefilterResult runEmptinessPrefilter() const;
+
+  /// The maximum number of points enumerated by runEmptinessPrefilter.
+  constexpr static unsigned kMaxPrefilterPoints = 64;
+
   /// Returns true if the set of constraints is found to have no solution,
   /// false if a solution exists. Uses the same algorithm as
   /// `findIntegerSample`.
@@ -366,9 +480,21 @@ public:
 
   /// Compute an overapproximation of the number of integer points in the
   /// relation. Symbol vars currently not supported. If the computed
-  /// overapproximation is infinite, an empty optional is returned.
+  /// overapproximation is infinite, an empty optional is returned. See
+  /// countIntegerPoints for the exact number.
   std::optional<MPInt> computeVolume() const;
 
+  /// Compute the number of integer points in the projection of the relation
+  /// onto its non-local vars. Symbol vars currently not supported. If the
+  /// number is infinite, an empty optional is returned.
+  ///
+  /// Hyper-rectangular relations without locals are counted in closed form.
+  /// Otherwise, the points are enumerated one var at a time, and the values of
+  /// the last var are counted in closed form, so the cost grows with the
+  /// number of integer points of the projection onto all vars but the last.
+  /// While the query cache is enabled, the result is cached.
+  std::optional<MPInt> countIntegerPoints() const;
+
   /// Returns true if the given point satisfies the constraints, or false
   /// otherwise. Takes the values of all vars including locals.
   bool containsPoint(ArrayRef<MPInt> point) const;
@@ -393,6 +519,10 @@ public:
   /// in the form of a `MaybeLocalRepr` struct. If no such inequality
   /// pair/equality can be found, the kind attribute in `MaybeLocalRepr` is set
   /// to None.
+  ///
+  /// The representations are computed on first use and cached until the
+  /// constraints or the vars are next modified. Copies of the relation share
+  /// the cache.
   DivisionRepr getLocalReprs(std::vector<MaybeLocalRepr> *repr = nullptr) const;
 
   /// The type of bound: equal, lower bound or upper bound.
@@ -524,7 +654,9 @@ public:
   void removeTrivialRedundancy();
 
   /// A more expensive check than `removeTrivialRedundancy` to detect redundant
-  /// inequalities.
+  /// inequalities. Inequalities implied by a single other one are dropped
+  /// first; the others are checked one at a time, after a parallel screening
+  /// of large systems when several threads are available.
   void removeRedundantInequalities();
 
   /// Removes redundant constraints using Simplex. Although the algorithm can
@@ -665,7 +797,12 @@ public:
   /// For some values of the symbols, the lexmin may be unbounded.
   /// `SymbolicLexMin` stores these parts of the symbolic domain in a separate
   /// `PresburgerSet`, `unboundedDomain`.
-  SymbolicLexMin findSymbolicIntegerLexMin() const;
+  ///
+  /// `parallelSplitDepth` is passed on to
+  /// SymbolicLexSimplex::computeSymbolicIntegerLexMin; if non-zero, parts of
+  /// the symbol domain are explored in parallel.
+  SymbolicLexMin
+  findSymbolicIntegerLexMin(unsigned parallelSplitDepth = 0) const;
 
   /// Return the set difference of this set and the given set, i.e.,
   /// return `this \ set`.
@@ -722,6 +859,40 @@ protected:
   virtual void fourierMotzkinEliminate(unsigned pos, bool darkShadow = false,
                                        bool *isResultIntegerExact = nullptr);
 
+  /// Tracks which of the original inequalities each inequality was combined
+  /// from while several variables are eliminated by Fourier-Motzkin, so that
+  /// combinations known to be redundant can be dropped as they are generated.
+  /// See the implementation for details.
+  struct FMHistory;
+
+  /// Implementation of fourierMotzkinEliminate. If `history` is non-null, it
+  /// is used to prune redundant combined inequalities and is updated to
+  /// describe the inequalities of the result. `darkShadow` must be false in
+  /// that case.
+  void fourierMotzkinEliminateImpl(unsigned pos, bool darkShadow,
+                                   bool *isResultIntegerExact,
+                                   FMHistory *history);
+
+  /// Implementation of removeTrivialRedundancy. If `history` is non-null, it
+  /// is kept in sync with the inequalities that remain.
+  void removeTrivialRedundancy(FMHistory *history);
+
+  /// If constraint uniquing is enabled and `row` is made redundant by a
+  /// constraint already present, or makes an existing inequality redundant,
+  /// update the constraints accordingly and return false. Otherwise, return
+  /// true; the caller must then append `row` as the last equality (isEq=true)
+  /// or inequality (isEq=false), where it has been indexed.
+  bool uniqueConstraint(ArrayRef<MPInt> row, bool isEq);
+
+  /// Rebuild the constraint index from the current constraints.
+  void rebuildConstraintIndex();
+
+  /// Implementation of findIntegerSample, bypassing the query cache.
+  std::optional<SmallVector<MPInt, 8>> computeIntegerSample() const;
+
+  /// Implementation of countIntegerPoints, bypassing the query cache.
+  std::optional<MPInt> computeIntegerPointCount() const;
+
   /// Tightens inequalities given that we are dealing with integer spaces. This
   /// is similar to the GCD test but applied to inequalities. The constant term
   /// can be reduced to the preceding multiple of the GCD of the coefficients,
@@ -784,6 +955,123 @@ protected:
 
   /// Coefficients of affine inequalities (in >= 0 form).
   Matrix inequalities;
+
+  /// Maps the hashes of the normalized constraints to their positions. For
+  /// inequalities, the constant term is not hashed. Edits that move, rewrite or
+  /// remove constraints mark the whole index stale, and it is rebuilt before
+  /// the next constraint is uniqued. Entries are still checked against the
+  /// constraints before being used.
+  struct ConstraintIndex {
+    /// The number of columns when the index was built.
+    unsigned numCols = 0;
+    /// Whether the constraints have changed other than by appending since the
+    /// index was built.
+    bool isStale = false;
+    std::unordered_multimap<size_t, unsigned> equalities;
+    std::unordered_multimap<size_t, unsigned> inequalities;
+  };
+
+  /// The constraint index, present while constraint uniquing is enabled.
+  std::optional<ConstraintIndex> constraintIndex;
+
+  /// The division representations of the locals, and the constraints defining
+  /// them, as returned by getLocalReprs.
+  struct LocalReprs {
+    DivisionRepr divs;
+    std::vector<MaybeLocalRepr> reprs;
+  };
+
+  /// Compute the division representations of the locals from scratch.
+  LocalReprs computeLocalReprs() const;
+
+  /// Drop the cached local representations. This must be called by every
+  /// member function that modifies the constraints or the vars, before
+  /// modifying them.
+  void invalidateLocalReprs() { localReprCache.reset(); }
+
+  /// Mark the constraint index, if any, stale, so that it is rebuilt before it
+  /// is next used.
+  void invalidateConstraintIndex() {
+    if (constraintIndex)
+      constraintIndex->isStale = true;
+  }
+
+  /// The representations returned by getLocalReprs, or null if not computed
+  /// yet. As for the bounding boxes cached by PresburgerRelation, they are
+  /// never modified once computed, so they can be shared between copies, and
+  /// are accessed atomically, including by copies of the relation, to allow
+  /// concurrent queries on the same relation.
+  SharedCache<LocalReprs> localReprCache;
+
+  /// An edit recorded in the undo log, with what is needed to undo it. Removed
+  /// coefficients, spaces and copies of the constraints are kept in the
+  /// corresponding lists of the log, in the order of the entries.
+  struct UndoLogEntry {
+    enum class Kind {
+      AppendEquality,
+      AppendInequality,
+      /// `num` equalities or inequalities were removed at `pos`.
+      RemoveEqualities,
+      RemoveInequalities,
+      /// The inequality at `pos` was replaced.
+      ReplaceInequality,
+      /// `num` vars of kind `varKind` were inserted or removed at `pos`,
+      /// relative to the kind.
+      InsertVars,
+      RemoveVars,
+      /// The vars at the absolute positions `pos` and `otherPos` were swapped.
+      SwapVars,
+      /// The column `pos`, multiplied by `scale`, was added to `otherPos`.
+      AddToColumn,
+      /// The constraints were rewritten.
+      RewriteConstraints,
+    };
+    Kind kind;
+    VarKind varKind = VarKind::Local;
+    unsigned pos = 0, num = 0, otherPos = 0;
+    MPInt scale;
+  };
+
+  /// Record the removal of the rows [start, end) of `isEq ? equalities :
+  /// inequalities` before it happens.
+  void recordRemovedRows(bool isEq, unsigned start, unsigned end);
+
+  /// Record the addition of column `srcPos` multiplied by `scale` to column
+  /// `dstPos`, and perform it.
+  void addToColumn(unsigned srcPos, unsigned dstPos, const MPInt &scale);
+
+  /// Undo the last entry of the undo log.
+  void undoLastEntry();
+
+  /// Record that the space and all the constraints are about to be rewritten,
+  /// by saving a copy of them, if recording.
+  void recordRewriteConstraints();
+
+  /// The undo log. Copies of a relation start without one, so that temporary
+  /// copies made by queries do not record their edits. Assigning to a relation
+  /// keeps its own log, so that edits like projectOut, which assign a new
+  /// relation, can record a copy of the old one and be undone.
+  struct UndoLog {
+    UndoLog() = default;
+    UndoLog(const UndoLog &) {}
+    UndoLog(UndoLog &&) = default;
+    UndoLog &operator=(const UndoLog &) { return *this; }
+    UndoLog &operator=(UndoLog &&) { return *this; }
+
+    void clear() {
+      isRecording = false;
+      entries.clear();
+      coeffs.clear();
+      spaces.clear();
+      constraints.clear();
+    }
+
+    bool isRecording = false;
+    SmallVector<UndoLogEntry, 8> entries;
+    SmallVector<MPInt, 16> coeffs;
+    SmallVector<PresburgerSpace, 2> spaces;
+    SmallVector<std::pair<Matrix, Matrix>, 1> constraints;
+  } undo;
 };
 
 /// An IntegerPolyhedron represents the set of points from a PresburgerSpace
@@ -20,6 +20,7 @@
 #include "Compiler.h"
 #include "SlowMPInt.h"
 #include "Math.h"
+#include "Statistics.h"
 #include "Utils.h"
 #include <cassert>
 #include <limits>
@@ -118,8 +119,32 @@ private:
     holdsLarge = true;
   }
 
+  FP_ATTRIBUTE_ALWAYS_INLINE void initLarge(detail::SlowMPInt &&o) {
+    if (FP_LIKELY(isSmall()))
+      new (&valLarge) detail::SlowMPInt(std::move(o));
+    else
+      valLarge = std::move(o);
+    holdsLarge = true;
+  }
+  /// Switch to the large representation, keeping the value unchanged. This
+  /// allows the slow paths to update the value in place.
+  FP_ATTRIBUTE_ALWAYS_INLINE detail::SlowMPInt &promote() {
+    if (FP_LIKELY(isSmall())) {
+      FP_STAT_INC(NumMPIntPromotions);
+      initLarge(detail::SlowMPInt(getSmall()));
+    }
+    return getLarge();
+  }
+
+  /// These are only used to hold the results of the slow paths.
   FP_ATTRIBUTE_ALWAYS_INLINE explicit MPInt(const detail::SlowMPInt &val)
-      : valLarge(val), holdsLarge(true) {}
+      : valLarge(val), holdsLarge(true) {
+    FP_STAT_INC(NumMPIntPromotions);
+  }
+  FP_ATTRIBUTE_ALWAYS_INLINE explicit MPInt(detail::SlowMPInt &&val)
+      : valLarge(std::move(val)), holdsLarge(true) {
+    FP_STAT_INC(NumMPIntPromotions);
+  }
   FP_ATTRIBUTE_ALWAYS_INLINE bool isSmall() const { return !holdsLarge; }
   FP_ATTRIBUTE_ALWAYS_INLINE bool isLarge() const { return holdsLarge; }
   /// Get the stored value. For getSmall/Large,
@@ -163,6 +188,11 @@ public:
     if (FP_UNLIKELY(o.isLarge()))
       initLarge(o.valLarge);
   }
+  FP_ATTRIBUTE_ALWAYS_INLINE MPInt(MPInt &&o) noexcept
+      : valSmall(o.valSmall), holdsLarge(false) {
+    if (FP_UNLIKELY(o.isLarge()))
+      initLarge(std::move(o.valLarge));
+  }
   FP_ATTRIBUTE_ALWAYS_INLINE MPInt &operator=(const MPInt &o) {
     if (FP_LIKELY(o.isSmall())) {
       initSmall(o.valSmall);
@@ -171,6 +201,15 @@ public:
     initLarge(o.valLarge);
     return *this;
   }
+  /// The moved-from object is left holding an unspecified valid value.
+  FP_ATTRIBUTE_ALWAYS_INLINE MPInt &operator=(MPInt &&o) noexcept {
+    if (FP_LIKELY(o.isSmall())) {
+      initSmall(o.valSmall);
+      return *this;
+    }
+    initLarge(std::move(o.valLarge));
+    return *this;
+  }
   FP_ATTRIBUTE_ALWAYS_INLINE MPInt &operator=(int x) {
     initSmall(x);
     return *this;
@@ -181,6 +220,17 @@ public:
     return static_cast<int64_t>(getLarge());
   }
 
+  /// If the value is held in the small representation, store it in `out` and
+  /// return true. Otherwise, return false and leave `out` unchanged. This
+  /// allows bulk kernels to operate directly on int64_t values and fall back
+  /// to MPInt arithmetic only when some value is large.
+  FP_ATTRIBUTE_ALWAYS_INLINE bool getIfSmall(int64_t &out) const {
+    if (FP_UNLIKELY(isLarge()))
+      return false;
+    out = getSmall();
+    return true;
+  }
+
   bool operator==(const MPInt &o) const;
   bool operator!=(const MPInt &o) const;
   bool operator>(const MPInt &o) const;
@@ -206,6 +256,11 @@ public:
   MPInt divByPositive(const MPInt &o) const;
   MPInt &divByPositiveInPlace(const MPInt &o);
 
+  /// Compute *this += a * b, or *this -= a * b, in place. When the values are
+  /// large, this does not create any temporaries.
+  MPInt &addMul(const MPInt &a, const MPInt &b);
+  MPInt &subMul(const MPInt &a, const MPInt &b);
+
   friend MPInt abs(const MPInt &x);
   friend MPInt gcdRange(ArrayRef<MPInt> range);
   friend MPInt ceilDiv(const MPInt &lhs, const MPInt &rhs);
@@ -218,6 +273,15 @@ public:
   std::ostream &print(std::ostream &os) const;
   void dump() const;
 
+  /// Store the magnitude of the value in `bytes`, least significant byte
+  /// first and without leading zero bytes, and return whether the value is
+  /// negative.
+  bool getMagnitudeBytes(std::vector<uint8_t> &bytes) const;
+  /// Return the value whose magnitude is stored in the `numBytes` bytes at
+  /// `bytes` as by getMagnitudeBytes, negated if `isNegative` is true.
+  static MPInt fromMagnitudeBytes(const uint8_t *bytes, size_t numBytes,
+                                  bool isNegative);
+
   /// ---------------------------------------------------------------------------
   /// Convenience operator overloads for int64_t.
   /// ---------------------------------------------------------------------------
@@ -444,7 +508,15 @@ FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator+=(const MPInt &o) {
     // removing it leads to a performance regression.
     return *this = MPInt(detail::SlowMPInt(*this) + detail::SlowMPInt(o));
   }
-  return *this = MPInt(detail::SlowMPInt(*this) + detail::SlowMPInt(o));
+  // Update the large value in place rather than creating temporaries. Note
+  // that o may alias *this, so a small o is read before promoting.
+  if (o.isLarge()) {
+    promote() += o.getLarge();
+    return *this;
+  }
+  int64_t small = o.getSmall();
+  promote() += small;
+  return *this;
 }
 FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator-=(const MPInt &o) {
   if (FP_LIKELY(isSmall() && o.isSmall())) {
@@ -458,7 +530,15 @@ FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator-=(const MPInt &o) {
     // removing it leads to a performance regression.
     return *this = MPInt(detail::SlowMPInt(*this) - detail::SlowMPInt(o));
   }
-  return *this = MPInt(detail::SlowMPInt(*this) - detail::SlowMPInt(o));
+  // Update the large value in place rather than creating temporaries. Note
+  // that o may alias *this, so a small o is read before promoting.
+  if (o.isLarge()) {
+    promote() -= o.getLarge();
+    return *this;
+  }
+  int64_t small = o.getSmall();
+  promote() -= small;
+  return *this;
 }
 FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator*=(const MPInt &o) {
   if (FP_LIKELY(isSmall() && o.isSmall())) {
@@ -472,7 +552,15 @@ FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator*=(const MPInt &o) {
     // removing it leads to a performance regression.
     return *this = MPInt(detail::SlowMPInt(*this) * detail::SlowMPInt(o));
   }
-  return *this = MPInt(detail::SlowMPInt(*this) * detail::SlowMPInt(o));
+  // Update the large value in place rather than creating temporaries. Note
+  // that o may alias *this, so a small o is read before promoting.
+  if (o.isLarge()) {
+    promote() *= o.getLarge();
+    return *this;
+  }
+  int64_t small = o.getSmall();
+  promote() *= small;
+  return *this;
 }
 FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator/=(const MPInt &o) {
   if (FP_LIKELY(isSmall() && o.isSmall())) {
@@ -493,7 +581,61 @@ MPInt::divByPositiveInPlace(const MPInt &o) {
     getSmall() /= o.getSmall();
     return *this;
   }
-  return *this = MPInt(detail::SlowMPInt(*this) / detail::SlowMPInt(o));
+  if (o.isLarge())
+    promote() /= o.getLarge();
+  else
+    promote() /= detail::SlowMPInt(o.getSmall());
+  return *this;
+}
+
+FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::addMul(const MPInt &a,
+                                                const MPInt &b) {
+  if (FP_LIKELY(isSmall() && a.isSmall() && b.isSmall())) {
+    int64_t product, result;
+    bool overflow = detail::mulOverflow(a.getSmall(), b.getSmall(), product);
+    overflow |= detail::addOverflow(getSmall(), product, result);
+    if (FP_LIKELY(!overflow)) {
+      getSmall() = result;
+      return *this;
+    }
+  }
+  // Note that a or b may alias *this, so their representation must be checked
+  // only after promoting *this.
+  detail::SlowMPInt &res = promote();
+  if (a.isLarge() && b.isLarge())
+    res.addMul(a.getLarge(), b.getLarge());
+  else if (a.isLarge())
+    res.addMul(a.getLarge(), b.getSmall());
+  else if (b.isLarge())
+    res.addMul(b.getLarge(), a.getSmall());
+  else
+    res.addMul(detail::SlowMPInt(a.getSmall()), b.getSmall());
+  return *this;
+}
+
+FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::subMul(const MPInt &a,
+                                                const MPInt &b) {
+  if (FP_LIKELY(isSmall() && a.isSmall() && b.isSmall())) {
+    int64_t product, result;
+    bool overflow = detail::mulOverflow(a.getSmall(), b.getSmall(), product);
+    overflow |= detail::subOverflow(getSmall(), product, result);
+    if (FP_LIKELY(!overflow)) {
+      getSmall() = result;
+      return *this;
+    }
+  }
+  // Note that a or b may alias *this, so their representation must be checked
+  // only after promoting *this.
+  detail::SlowMPInt &res = promote();
+  if (a.isLarge() && b.isLarge())
+    res.subMul(a.getLarge(), b.getLarge());
+  else if (a.isLarge())
+    res.subMul(a.getLarge(), b.getSmall());
+  else if (b.isLarge())
+    res.subMul(b.getLarge(), a.getSmall());
+  else
+    res.subMul(detail::SlowMPInt(a.getSmall()), b.getSmall());
+  return *this;
 }
 
 FP_ATTRIBUTE_ALWAYS_INLINE MPInt &MPInt::operator%=(const MPInt &o) {
@@ -0,0 +1,77 @@
+//===- MPIntArena.h - MLIR MPIntArena Class ---------------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Scoped arena allocation for the limbs of large MPInt values.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FP_MPINTARENA_H
+#define FP_MPINTARENA_H
+
+#include <cstddef>
+
+namespace presburger {
+
+namespace detail {
+class LimbArena;
+} // namespace detail
+
+/// Install GMP memory functions that route all limb allocations through the
+/// MPIntArenaScope active on the calling thread, if any, and through malloc
+/// otherwise.
+///
+/// Since memory allocated by GMP's default allocator cannot be released by the
+/// installed functions, this must be called before GMP allocates anything in
+/// the process, i.e., before any MPInt holds a large value. Calling it more
+/// than once has no further effect.
+void installMPIntArenaAllocator();
+
+/// Return whether installMPIntArenaAllocator has been called.
+bool isMPIntArenaAllocatorInstalled();
+
+/// An RAII object that makes a fresh arena the target of all limb allocations
+/// made by the current thread while the scope is alive. Scopes can be nested;
+/// the innermost one is used. This is intended to wrap a single operation,
+/// e.g., a Simplex query, that may churn through many large temporaries.
+///
+/// Limbs are carved out of large chunks by bumping a pointer, and freed limbs
+/// are recycled through size-segregated free lists, so that large-value
+/// arithmetic inside the scope does not call malloc in the steady state.
+///
+/// Values may safely outlive the scope, and may be freed from any thread: the
+/// arena's chunks are only released once the scope has ended *and* every
+/// block allocated from it has been freed. Blocks freed by a thread other than
+/// the one owning the scope are not recycled.
+///
+/// installMPIntArenaAllocator must have been called for the scope to have any
+/// effect; otherwise GMP keeps using its default allocator.
+class MPIntArenaScope {
+public:
+  explicit MPIntArenaScope(size_t chunkSize = kDefaultChunkSize);
+  ~MPIntArenaScope();
+
+  MPIntArenaScope(const MPIntArenaScope &) = delete;
+  MPIntArenaScope &operator=(const MPIntArenaScope &) = delete;
+
+  /// Return the number of chunks allocated so far by this scope's arena.
+  size_t getNumChunks() const;
+
+  /// Return the number of blocks allocated from this scope's arena that have
+  /// not been freed yet.
+  size_t getNumLiveBlocks() const;
+
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+private:
+  detail::LimbArena *arena;
+  detail::LimbArena *previous;
+};
+
+} // namespace presburger
+
+#endif // FP_MPINTARENA_H
@@ -17,10 +17,117 @@
 #include "MPInt.h"
 
 #include <cassert>
+#include <cstddef>
+#include <iterator>
 
 namespace mlir {
 namespace presburger {
 
+/// A constant reference to a sequence of elements that lie a fixed stride
+/// apart in memory, such as a column of a Matrix. Like ArrayRef, it does not
+/// own the elements and is cheap to copy; it is invalidated by any operation
+/// that reallocates or resizes the underlying storage.
+class StridedArrayRef {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = MPInt;
+    using difference_type = ptrdiff_t;
+    using pointer = const MPInt *;
+    using reference = const MPInt &;
+
+    iterator(const MPInt *data, difference_type index, unsigned stride)
+        : data(data), index(index), stride(stride) {}
+
+    reference operator*() const {
+      return data[index * difference_type(stride)];
+    }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const {
+      return data[(index + n) * difference_type(stride)];
+    }
+    iterator &operator++() {
+      ++index;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator copy = *this;
+      ++index;
+      return copy;
+    }
+    iterator &operator--() {
+      --index;
+      return *this;
+    }
+    iterator operator--(int) {
+      iterator copy = *this;
+      --index;
+      return copy;
+    }
+    iterator &operator+=(difference_type n) {
+      index += n;
+      return *this;
+    }
+    iterator &operator-=(difference_type n) {
+      index -= n;
+      return *this;
+    }
+    iterator operator+(difference_type n) const {
+      return iterator(data, index + n, stride);
+    }
+    friend iterator operator+(difference_type n, const iterator &it) {
+      return it + n;
+    }
+    iterator operator-(difference_type n) const {
+      return iterator(data, index - n, stride);
+    }
+    difference_type operator-(const iterator &other) const {
+      return index - other.index;
+    }
+    bool operator==(const iterator &other) const {
+      return index == other.index;
+    }
+    bool operator!=(const iterator &other) const {
+      return index != other.index;
+    }
+    bool operator<(const iterator &other) const { return index < other.index; }
+    bool operator>(const iterator &other) const { return index > other.index; }
+    bool operator<=(const iterator &other) const {
+      return index <= other.index;
+    }
+    bool operator>=(const iterator &other) const {
+      return index >= other.index;
+    }
+
+  private:
+    /// The element at `index` is data[index * stride]. The position is kept
+    /// as an index, so that the end iterator does not need a pointer past the
+    /// underlying buffer.
+    const MPInt *data;
+    difference_type index;
+    unsigned stride;
+  };
+
+  StridedArrayRef(const MPInt *data, unsigned length, unsigned stride)
+      : data(data), length(length), stride(stride) {}
+
+  unsigned size() const { return length; }
+  bool empty() const { return length == 0; }
+
+  const MPInt &operator[](unsigned i) const {
+    assert(i < length && "Index out of range");
+    return data[i * stride];
+  }
+
+  iterator begin() const { return iterator(data, 0, stride); }
+  iterator end() const { return iterator(data, length, stride); }
+
+private:
+  const MPInt *data;
+  unsigned length, stride;
+};
+
 /// This is a class to represent a resizable matrix.
 ///
 /// More columns and rows can be reserved than are currently used. The data is
@@ -87,6 +194,15 @@ public:
   MutableArrayRef<MPInt> getRow(unsigned row);
   ArrayRef<MPInt> getRow(unsigned row) const;
 
+  /// Get a StridedArrayRef corresponding to the specified column. Unlike
+  /// reading the elements through at(), this does not copy them.
+  StridedArrayRef getColumn(unsigned column) const {
+    assert(column < nColumns && "Column outside of range");
+    if (nRows == 0)
+      return StridedArrayRef(nullptr, 0, nReservedColumns);
+    return StridedArrayRef(data.data() + column, nRows, nReservedColumns);
+  }
+
   /// Set the specified row to `elems`.
   void setRow(unsigned row, ArrayRef<MPInt> elems);
 
@@ -85,6 +85,17 @@ public:
     return valueAt(getMPIntVec(point));
   }
 
+  /// Return the outputs of the function at `numPoints` points at once. The
+  /// points are stored column-major in `points`, i.e., the value of the i^th
+  /// input of the p^th point is `points[i * numPoints + p]`, and the outputs
+  /// are written column-major to `out` in the same way. The divisions are
+  /// computed once per point and the outputs are evaluated in int64, falling
+  /// back to exact arithmetic for the points where this overflows. Returns
+  /// failure if some output does not fit in an int64_t, in which case the
+  /// contents of `out` are unspecified.
+  LogicalResult valueAtBatch(ArrayRef<int64_t> points, unsigned numPoints,
+                             MutableArrayRef<int64_t> out) const;
+
   /// Return whether the `this` and `other` are equal when the domain is
   /// restricted to `domain`. This is the case if they lie in the same space,
   /// and their outputs are equal for every point in `domain`.
@@ -196,6 +207,15 @@ public:
     return valueAt(getMPIntVec(point));
   }
 
+  /// Batch version of valueAt, with points and outputs stored column-major as
+  /// in MultiAffineFunction::valueAtBatch. `defined[p]` is set to whether the
+  /// function is defined at the p^th point; the outputs of points where it is
+  /// not are left unchanged. Returns failure if some output does not fit in an
+  /// int64_t.
+  LogicalResult valueAtBatch(ArrayRef<int64_t> points, unsigned numPoints,
+                             MutableArrayRef<int64_t> out,
+                             MutableArrayRef<bool> defined) const;
+
   /// Return all the pieces of this piece-wise function.
   ArrayRef<Piece> getAllPieces() const { return pieces; }
 
@@ -0,0 +1,48 @@
+//===- Parallel.h - MLIR Presburger Parallelism Utilities -------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Utilities for running independent parts of Presburger algorithms on
+// multiple threads.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_PARALLEL_H
+#define MLIR_ANALYSIS_PRESBURGER_PARALLEL_H
+
+#include "ArrayRef.h"
+
+namespace mlir {
+namespace presburger {
+
+/// Set the maximum number of threads, including the calling thread, that
+/// parallel algorithms may use. The default is 1, i.e., everything runs
+/// serially on the calling thread. `numThreads` must be at least 1.
+///
+/// Parallel algorithms produce the same results regardless of this setting.
+void setMaxNumThreads(unsigned numThreads);
+
+/// Return the value set by setMaxNumThreads, unless the current SolverContext
+/// overrides it.
+unsigned getMaxNumThreads();
+
+/// Call `fn(i)` for every `i` in [begin, end), distributing the calls over up
+/// to getMaxNumThreads() threads. Each thread repeatedly claims the next
+/// unclaimed index, so uneven task sizes balance out. Returns once all calls
+/// have finished. The calls may run in any order, so `fn` must only write to
+/// state owned by its index.
+///
+/// Calls to parallelFor from inside `fn` run serially on the calling thread,
+/// so nested parallel algorithms do not oversubscribe the machine. The calls
+/// to `fn` run in the SolverContext current on the calling thread.
+void parallelFor(unsigned begin, unsigned end,
+                 llvm::function_ref<void(unsigned)> fn);
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_PARALLEL_H
@@ -14,6 +14,7 @@
 #define MLIR_ANALYSIS_PRESBURGER_PRESBURGERRELATION_H
 
 #include "IntegerRelation.h"
+#include <memory>
 #include <optional>
 
 namespace mlir {
@@ -24,6 +25,8 @@ namespace presburger {
 /// function as its main API.
 class SetCoalescer;
 
+class Simplex;
+
 /// A PresburgerRelation represents a union of IntegerRelations that live in
 /// the same PresburgerSpace with support for union, intersection, subtraction,
 /// and complement operations, as well as sampling.
@@ -80,15 +83,26 @@ public:
   /// Return the union of this set and the given set.
   PresburgerRelation unionSet(const PresburgerRelation &set) const;
 
-  /// Return the intersection of this set and the given set.
+  /// Return the intersection of this set and the given set. Pairs of
+  /// disjuncts whose bounding boxes are disjoint are not intersected.
   PresburgerRelation intersect(const PresburgerRelation &set) const;
 
   /// Return true if the set contains the given point, and false otherwise.
+  /// If the bounding boxes of the disjuncts have already been computed,
+  /// disjuncts whose box does not contain the point are skipped.
   bool containsPoint(ArrayRef<MPInt> point) const;
   bool containsPoint(ArrayRef<int64_t> point) const {
     return containsPoint(getMPIntVec(point));
   }
 
+  /// Batch version of containsPoint. The points are stored column-major in
+  /// `points`, i.e., the value of the i^th var of the p^th point is
+  /// `points[i * numPoints + p]`, and `result[p]` is set to whether the set
+  /// contains the p^th point. Constraints of disjuncts without locals are
+  /// evaluated in int64 for all points at once.
+  void containsPointBatch(ArrayRef<int64_t> points, unsigned numPoints,
+                          MutableArrayRef<bool> result) const;
+
   /// Return the complement of this set. All local variables in the set must
   /// correspond to floor divisions.
   PresburgerRelation complement() const;
@@ -97,6 +111,10 @@ public:
   /// return `this \ set`. All local variables in `set` must correspond
   /// to floor divisions, but local variables in `this` need not correspond to
   /// divisions.
+  ///
+  /// The disjuncts of `this` are subtracted from in parallel when
+  /// setMaxNumThreads allows more than one thread; the result is the same
+  /// either way.
   PresburgerRelation subtract(const PresburgerRelation &set) const;
 
   /// Return true if this set is a subset of the given set, and false otherwise.
@@ -123,10 +141,24 @@ public:
   /// case when there is a lot of overlap between disjuncts.
   std::optional<MPInt> computeVolume() const;
 
+  /// Compute the number of integer points in the union. Symbol vars are
+  /// currently not supported. If the number is infinite, an empty optional is
+  /// returned.
+  ///
+  /// Overlapping disjuncts are first made disjoint by subtracting the union of
+  /// the previous disjuncts from each one, and then counted with
+  /// IntegerRelation::countIntegerPoints. If there are several disjuncts and
+  /// some local is not a division, this is done on
+  /// computeReprWithOnlyDivLocals().
+  std::optional<MPInt> countIntegerPoints() const;
+
   /// Simplifies the representation of a PresburgerRelation.
   ///
   /// In particular, removes all disjuncts which are subsets of other
   /// disjuncts in the union.
+  ///
+  /// Pairs of disjuncts are attempted in parallel when setMaxNumThreads allows
+  /// more than one thread; the result is the same either way.
   PresburgerRelation coalesce() const;
 
   /// Check whether all local ids in all disjuncts have a div representation.
@@ -150,11 +182,55 @@ protected:
            "PresburgerRelation cannot have local vars.");
   }
 
+  /// An overapproximation of a disjunct by a box over its first `lb.size()`
+  /// vars. `lb` and `ub` hold the rational minimum and maximum of each var,
+  /// rounded outwards to integers, or std::nullopt if the var is unbounded in
+  /// that direction. If `empty` is set, the disjunct has no rational points and
+  /// the bounds are not meaningful.
+  struct DisjunctBox {
+    bool empty = false;
+    SmallVector<std::optional<MPInt>, 8> lb;
+    SmallVector<std::optional<MPInt>, 8> ub;
+
+    /// Return false if this box and `other` are known to be disjoint, and
+    /// true otherwise. Both boxes must be over the same number of vars.
+    bool mayOverlap(const DisjunctBox &other) const;
+
+    /// Return false if `point`, which has one value per var of the box, lies
+    /// outside the box, and true otherwise.
+    bool mayContain(ArrayRef<MPInt> point) const;
+  };
+
+  /// Compute the box over the first `numVars` vars of the set represented by
+  /// `simp`. `simp` may be pivoted, but its constraints are left unchanged.
+  static DisjunctBox computeDisjunctBox(Simplex &simp, unsigned numVars);
+
+  /// Return the boxes over the non-local vars of all the disjuncts, computing
+  /// them if needed. The returned list stays valid until `disjuncts` is next
+  /// modified.
+  ArrayRef<DisjunctBox> getDisjunctBoxes() const;
+
+  /// Return the cached boxes if they have been computed, and null otherwise.
+  std::shared_ptr<const SmallVector<DisjunctBox, 2>>
+  getCachedDisjunctBoxes() const {
+    return boxCache.load();
+  }
+
+  /// Drop the cached boxes. This must be called whenever `disjuncts` is
+  /// modified.
+  void invalidateDisjunctBoxes() { boxCache.reset(); }
+
   PresburgerSpace space;
 
   /// The list of disjuncts that this set is the union of.
   SmallVector<IntegerRelation, 2> disjuncts;
 
+  /// The boxes returned by getDisjunctBoxes, or null if not computed yet. The
+  /// list is never modified once computed, so it can be shared between copies
+  /// and is accessed atomically, including when the set is copied, to allow
+  /// concurrent queries on the same set.
+  SharedCache<SmallVector<DisjunctBox, 2>> boxCache;
+
   friend class SetCoalescer;
 };
 
@@ -0,0 +1,159 @@
+//===- QueryCache.h - MLIR Presburger Query Cache ---------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A process-wide cache memoizing the results of expensive queries on
+// relations, such as integer sampling and subset checks.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_QUERYCACHE_H
+#define MLIR_ANALYSIS_PRESBURGER_QUERYCACHE_H
+
+#include "MPInt.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace mlir {
+namespace presburger {
+
+class IntegerRelation;
+class PresburgerRelation;
+
+/// Set the maximum number of query results kept in the cache. When the cache
+/// is full, the least recently used result is evicted. A capacity of zero,
+/// which is the default, disables the cache and drops all the results it
+/// holds.
+///
+/// While the cache is enabled, IntegerRelation::findIntegerSample (and hence
+/// isIntegerEmpty), IntegerRelation::countIntegerPoints and
+/// PresburgerRelation::isSubsetOf (and hence isEqual) return cached results
+/// for relations that are equal up to the order and GCD normalization of their
+/// constraints and the order of their disjuncts, without running Simplex.
+/// The cache can be used from multiple threads.
+///
+/// While a SolverContext with a cache of its own is current, its cache is used
+/// instead of this one.
+void setQueryCacheCapacity(size_t capacity);
+
+/// Return the value set by setQueryCacheCapacity.
+size_t getQueryCacheCapacity();
+
+/// Drop all the results held by the cache and reset its statistics.
+void clearQueryCache();
+
+struct QueryCacheStats {
+  uint64_t numHits = 0;
+  uint64_t numMisses = 0;
+  uint64_t numEvictions = 0;
+  /// The number of results currently held.
+  uint64_t numEntries = 0;
+};
+
+/// Return the statistics of the cache since it was last cleared.
+QueryCacheStats getQueryCacheStats();
+
+namespace detail {
+
+enum class QueryKind : unsigned {
+  FindIntegerSample,
+  IsSubsetOf,
+  CountIntegerPoints
+};
+
+/// A canonical encoding of a query and its operands. Two keys compare equal
+/// iff they are for the same kind of query on operands that are equal up to
+/// the order and GCD normalization of their constraints and the order of their
+/// disjuncts. In particular, the query has the same result for both.
+class QueryKey {
+public:
+  explicit QueryKey(QueryKind kind);
+
+  /// Append an operand to the query.
+  void append(const IntegerRelation &rel);
+  void append(const PresburgerRelation &rel);
+
+  size_t getHash() const;
+
+  bool operator==(const QueryKey &other) const {
+    return kind == other.kind && data == other.data;
+  }
+
+private:
+  QueryKind kind;
+  SmallVector<MPInt, 32> data;
+};
+
+/// The result of a cached query. For FindIntegerSample, `sample` holds the
+/// sample found, if any. For IsSubsetOf, `verdict` holds the answer. For
+/// CountIntegerPoints, `count` holds the number of points, if finite.
+struct QueryResult {
+  bool verdict = false;
+  std::optional<SmallVector<MPInt, 8>> sample;
+  std::optional<MPInt> count;
+};
+
+/// A bounded cache of query results with least recently used eviction. All
+/// accesses are serialized by a mutex; the queries themselves run outside it.
+class QueryCache {
+public:
+  std::optional<QueryResult> lookup(const QueryKey &key);
+  void insert(QueryKey key, QueryResult result);
+
+  void setCapacity(size_t newCapacity);
+  /// Return the capacity without taking the lock.
+  size_t getCapacity() const {
+    return capacity.load(std::memory_order_relaxed);
+  }
+
+  void clear();
+  QueryCacheStats getStats();
+
+private:
+  struct Entry {
+    QueryKey key;
+    size_t hash;
+    QueryResult result;
+  };
+
+  /// Return the entry for `key`, whose hash is `hash`, marking it as the most
+  /// recently used one, or nullptr if there is none.
+  Entry *find(const QueryKey &key, size_t hash);
+
+  /// Evict the least recently used entries until at most `capacity` remain.
+  void evictToCapacity();
+
+  std::mutex mutex;
+  /// The entries, from the most to the least recently used.
+  std::list<Entry> entries;
+  /// Maps the hash of each key to its entry.
+  std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+  /// Only modified with the mutex held, but read without it to check whether
+  /// the cache is enabled.
+  std::atomic<size_t> capacity{0};
+  QueryCacheStats stats;
+};
+
+/// Return whether the query cache is enabled, i.e., whether the cache of the
+/// current SolverContext or the process-wide cache has a nonzero capacity.
+bool isQueryCacheEnabled();
+
+/// Return the cached result of the query `key`, if any.
+std::optional<QueryResult> lookupQuery(const QueryKey &key);
+
+/// Cache `result` as the result of the query `key`.
+void insertQuery(QueryKey key, QueryResult result);
+
+} // namespace detail
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_QUERYCACHE_H
@@ -0,0 +1,211 @@
+//===- Serialization.h - MLIR Presburger Serialization ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A versioned binary format for spaces, relations and piece-wise functions,
+// and a read-only view of serialized data that can be backed by a memory
+// mapped file.
+//
+// A serialized archive holds a sequence of records, and is laid out as
+// follows. All the fixed-width integers are little-endian.
+//
+//   "FPSR"                magic
+//   u32                   format version
+//   u64                   number of records N
+//   u64 x N               offset of each record from the start of the archive
+//   records               each starting at a multiple of 8 bytes
+//
+// Each record starts with an 8-byte header holding its kind and encoding in
+// the first two bytes. In the varint encoding, the counts are unsigned LEB128
+// varints, and each coefficient is a varint v: if v is even, the coefficient
+// is the zigzag-decoded value of v / 2; otherwise (v - 1) / 2 is twice the
+// number of bytes of its magnitude, plus one if it is negative, and the bytes
+// of the magnitude follow, least significant first. In the fixed int64
+// encoding, which only IntegerRelation records use, the counts and the
+// coefficients are int64 values at naturally aligned offsets, so that the
+// constraints can be read in place.
+//
+// Identifiers attached to the variables of a space are not serialized.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_SERIALIZATION_H
+#define MLIR_ANALYSIS_PRESBURGER_SERIALIZATION_H
+
+#include "IntegerRelation.h"
+#include "PWMAFunction.h"
+#include "PresburgerRelation.h"
+#include "PresburgerSpace.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace mlir {
+namespace presburger {
+
+/// The version of the format written by SerializationWriter. Archives of other
+/// versions are rejected by SerializedArchive::get.
+constexpr uint32_t kSerializationVersion = 1;
+
+enum class RecordKind : uint8_t {
+  PresburgerSpace,
+  IntegerRelation,
+  PresburgerRelation,
+  PWMAFunction,
+};
+
+enum class CoefficientEncoding : uint8_t {
+  /// Varints with escapes for coefficients that do not fit in 64 bits. This is
+  /// the most compact encoding.
+  Varint,
+  /// Fixed-width int64 values, which SerializedArchive::getIntegerRelationView
+  /// can read without decoding. It only applies to IntegerRelation records
+  /// whose coefficients all fit in an int64_t; other records use Varint.
+  FixedInt64,
+};
+
+/// Builds a serialized archive out of a sequence of records.
+class SerializationWriter {
+public:
+  explicit SerializationWriter(
+      CoefficientEncoding encoding = CoefficientEncoding::Varint)
+      : encoding(encoding) {}
+
+  /// Append a record for the given object and return its index.
+  unsigned add(const PresburgerSpace &space);
+  unsigned add(const IntegerRelation &rel);
+  unsigned add(const PresburgerRelation &rel);
+  unsigned add(const PWMAFunction &func);
+
+  unsigned getNumRecords() const { return records.size(); }
+
+  /// Return the archive holding all the records added so far.
+  std::vector<uint8_t> finish() const;
+
+private:
+  /// Start a new record of the given kind and encoding.
+  void startRecord(RecordKind kind, CoefficientEncoding recordEncoding);
+
+  CoefficientEncoding encoding;
+  /// The offsets of the records in `data`.
+  SmallVector<uint64_t, 8> records;
+  /// The records, concatenated.
+  std::vector<uint8_t> data;
+};
+
+/// A view of an IntegerRelation record in the fixed int64 encoding, which
+/// reads the constraints in place. Like ArrayRef, it does not own the data.
+class IntegerRelationView {
+public:
+  const PresburgerSpace &getSpace() const { return space; }
+  unsigned getNumCols() const { return space.getNumVars() + 1; }
+  unsigned getNumEqualities() const { return numEqualities; }
+  unsigned getNumInequalities() const { return numInequalities; }
+
+  ArrayRef<int64_t> getEquality(unsigned idx) const {
+    assert(idx < numEqualities && "Invalid equality position");
+    return ArrayRef<int64_t>(equalities + idx * getNumCols(), getNumCols());
+  }
+  ArrayRef<int64_t> getInequality(unsigned idx) const {
+    assert(idx < numInequalities && "Invalid inequality position");
+    return ArrayRef<int64_t>(inequalities + idx * getNumCols(), getNumCols());
+  }
+
+  /// Return the relation the record holds.
+  IntegerRelation materialize() const;
+
+private:
+  friend class SerializedArchive;
+  IntegerRelationView(const PresburgerSpace &space, unsigned numEqualities,
+                      unsigned numInequalities, const int64_t *equalities,
+                      const int64_t *inequalities)
+      : space(space), numEqualities(numEqualities),
+        numInequalities(numInequalities), equalities(equalities),
+        inequalities(inequalities) {}
+
+  PresburgerSpace space;
+  unsigned numEqualities, numInequalities;
+  const int64_t *equalities, *inequalities;
+};
+
+/// A read-only view of a serialized archive. It does not own the data, which
+/// must outlive it. Only the header and the record offsets are checked when
+/// the view is created; records are decoded when they are requested, and
+/// malformed records make the accessors return std::nullopt.
+class SerializedArchive {
+public:
+  /// Return a view of the archive in `data`, or std::nullopt if `data` does
+  /// not start with a valid header of the current version.
+  static std::optional<SerializedArchive> get(ArrayRef<uint8_t> data);
+
+  unsigned getNumRecords() const { return offsets.size(); }
+  RecordKind getKind(unsigned idx) const;
+  CoefficientEncoding getEncoding(unsigned idx) const;
+
+  /// Decode the record at `idx`, which must be of the corresponding kind.
+  std::optional<PresburgerSpace> getSpace(unsigned idx) const;
+  std::optional<IntegerRelation> getIntegerRelation(unsigned idx) const;
+  std::optional<PresburgerRelation> getPresburgerRelation(unsigned idx) const;
+  std::optional<PWMAFunction> getPWMAFunction(unsigned idx) const;
+
+  /// Return a view of the IntegerRelation record at `idx`, if it uses the
+  /// fixed int64 encoding. This needs the archive to be 8-byte aligned, as
+  /// memory mapped files are, and a little-endian host; otherwise, or if the
+  /// record is malformed, std::nullopt is returned.
+  std::optional<IntegerRelationView> getIntegerRelationView(unsigned idx) const;
+
+private:
+  SerializedArchive(ArrayRef<uint8_t> data, ArrayRef<uint8_t> offsets)
+      : data(data), offsets(offsets.data(), offsets.size() / 8) {}
+
+  /// Return the bytes of the record at `idx`, header included.
+  ArrayRef<uint8_t> getRecord(unsigned idx) const;
+
+  ArrayRef<uint8_t> data;
+  /// The table of record offsets, which is not necessarily aligned. Each
+  /// element is the first byte of an 8-byte little-endian offset.
+  struct OffsetTable {
+    OffsetTable(const uint8_t *table, size_t size) : table(table), num(size) {}
+    size_t size() const { return num; }
+    uint64_t operator[](size_t idx) const;
+    const uint8_t *table;
+    size_t num;
+  } offsets;
+};
+
+/// A read-only memory mapping of a file, e.g. of a serialized archive.
+class MappedFile {
+public:
+  /// Map the file at `path`, returning std::nullopt if it cannot be opened or
+  /// mapped.
+  static std::optional<MappedFile> open(const char *path);
+
+  MappedFile(MappedFile &&other) noexcept
+      : data(other.data), size(other.size) {
+    other.data = nullptr;
+    other.size = 0;
+  }
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  ArrayRef<uint8_t> getData() const {
+    return ArrayRef<uint8_t>(static_cast<const uint8_t *>(data), size);
+  }
+
+private:
+  MappedFile(void *data, size_t size) : data(data), size(size) {}
+
+  void *data;
+  size_t size;
+};
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_SERIALIZATION_H
@@ -21,6 +21,7 @@
 #include "PWMAFunction.h"
 #include "Utils.h"
 #include <optional>
+#include <vector>
 
 namespace mlir {
 namespace presburger {
@@ -201,6 +202,20 @@ public:
   /// Add all the constraints from the given IntegerRelation.
   void intersectIntegerRelation(const IntegerRelation &rel);
 
+  /// Enable or disable sparse pivoting, which is enabled by default. When the
+  /// pivot row has a unit denominator and few non-zero entries, a pivot then
+  /// only updates the columns where the pivot row is non-zero, and skips
+  /// normalizing rows whose denominator stays one. The resulting tableau is
+  /// the same either way.
+  void setSparsePivoting(bool enable) { sparsePivoting = enable; }
+
+  /// Return the number of pivots this tableau has performed since it was
+  /// constructed or since the last call to resetNumPivots. Rollbacks do not
+  /// decrease it. Unlike the NumPivots statistic, this is always counted, so
+  /// the cost of individual queries can be measured in any build.
+  uint64_t getNumPivots() const { return numPivots; }
+  void resetNumPivots() { numPivots = 0; }
+
   /// Print the tableau's internal state.
   void print(raw_ostream &os) const;
   void dump() const;
@@ -338,6 +353,16 @@ protected:
   /// otherwise.
   bool empty;
 
+  /// Whether pivots may use the sparse update; see setSparsePivoting.
+  bool sparsePivoting = true;
+
+  /// A pivot row with a unit denominator is considered sparse if at most one
+  /// in this many of its columns is non-zero.
+  constexpr static unsigned kSparsePivotRatio = 4;
+
+  /// The number of pivots performed; see getNumPivots.
+  uint64_t numPivots = 0;
+
   /// Holds a log of operations, used for rolling back to a previous state.
   SmallVector<UndoLogEntry, 8> undoLog;
 
@@ -491,6 +516,12 @@ public:
   /// any integer sample, use Simplex::findIntegerSample as that is more robust.
   MaybeOptimum<SmallVector<MPInt, 8>> findIntegerLexMin();
 
+  /// The same as findIntegerLexMin, but writes the lexmin, if it is bounded,
+  /// to `sample`, which must have one element per variable, instead of
+  /// returning a new vector. Returns std::nullopt, leaving `sample`
+  /// unspecified, if some value of the lexmin does not fit in an int64_t.
+  std::optional<OptimumKind> findIntegerLexMin(MutableArrayRef<int64_t> sample);
+
   /// Return whether the specified inequality is redundant/separate for the
   /// polytope. Redundant means every point satisfies the given inequality, and
   /// separate means no point satisfies it.
@@ -511,6 +542,10 @@ private:
   /// Make the tableau configuration consistent.
   LogicalResult restoreRationalConsistency();
 
+  /// Make the tableau consistent and add cuts until the sample point is
+  /// integral. Returns failure if the polytope is integer empty.
+  LogicalResult restoreIntegerConsistency();
+
   /// Return whether the specified row is violated;
   bool rowIsViolated(unsigned row) const;
 
@@ -616,9 +651,23 @@ public:
   ///
   /// The spaces of the sets in the result are compatible with the symbolDomain
   /// passed in the SymbolicLexSimplex constructor.
-  SymbolicLexMin computeSymbolicIntegerLexMin();
+  ///
+  /// If `parallelSplitDepth` is non-zero, the subproblems reached after
+  /// splitting the symbol domain `parallelSplitDepth` times are solved
+  /// independently, on up to getMaxNumThreads() threads, each on its own copy
+  /// of the tableau. This yields at most 2^parallelSplitDepth subproblems. The
+  /// lexmin computed is the same function as in the serial case, but may be
+  /// split into pieces differently. It only depends on `parallelSplitDepth`,
+  /// not on the number of threads used.
+  SymbolicLexMin computeSymbolicIntegerLexMin(unsigned parallelSplitDepth = 0);
 
 private:
+  /// Explore the symbol domain, recording the lexmin found in each part of it
+  /// in `result`. If `parallelSplitDepth` is non-zero, the subproblems at that
+  /// split depth are not explored but appended to `subproblems` instead.
+  void exploreSymbolDomain(SymbolicLexMin &result, unsigned parallelSplitDepth,
+                           std::vector<SymbolicLexSimplex> &subproblems);
+
   /// Perform all pivots that do not require branching.
   ///
   /// Return failure if the tableau became empty, indicating that the polytope
@@ -690,6 +739,26 @@ class Simplex : public SimplexBase {
 public:
   enum class Direction { Up, Down };
 
+  /// The rules findPivot can use to choose the column to pivot on among those
+  /// that change the sample value of a row in the desired direction.
+  ///
+  /// Bland         The column whose unknown has the lowest index. This is the
+  ///               default, and never cycles.
+  /// LargestCoeff  The column with the largest coefficient in the row, i.e.,
+  ///               along which the sample value of the row changes fastest.
+  /// SteepestEdge  The column along which the sample value of the row changes
+  ///               fastest relative to the change of the sample values of the
+  ///               other rows, i.e., with the largest squared coefficient
+  ///               divided by one plus the squared norm of the column.
+  ///
+  /// The rules other than Bland often take fewer pivots on larger tableaus,
+  /// but can cycle on degenerate ones, so an optimization that performs more
+  /// than kMaxDegeneratePivots consecutive degenerate pivots uses Bland's rule
+  /// for the rest of its pivots. The ratio test that chooses the row is the
+  /// same for every rule. Optima do not depend on the rule, but the sample
+  /// points, and hence the integer samples found, may.
+  enum class PivotRule { Bland, LargestCoeff, SteepestEdge };
+
   Simplex() = delete;
   explicit Simplex(unsigned nVar) : SimplexBase(nVar, /*mustUseBigM=*/false) {}
   explicit Simplex(const IntegerRelation &constraints)
@@ -765,6 +834,13 @@ public:
   std::pair<MaybeOptimum<MPInt>, MaybeOptimum<MPInt>>
   computeIntegerBounds(ArrayRef<MPInt> coeffs);
 
+  /// The same as computeIntegerBounds, but for int64 coefficients and bounds,
+  /// which are computed without building Fractions. Returns false, leaving
+  /// `min` and `max` unspecified, if some bound does not fit in an int64_t.
+  bool computeIntegerBounds(ArrayRef<int64_t> coeffs,
+                            MaybeOptimum<int64_t> &min,
+                            MaybeOptimum<int64_t> &max);
+
   /// Returns true if the polytope is unbounded, i.e., extends to infinity in
   /// some direction. Otherwise, returns false.
   bool isUnbounded();
@@ -777,6 +853,29 @@ public:
   /// otherwise. This should only be called for bounded sets.
   std::optional<SmallVector<MPInt, 8>> findIntegerSample();
 
+  /// The same as findIntegerSample, but writes the sample to `sample`, which
+  /// must have one element per variable. If the current sample point is
+  /// integral, it is used without allocating, so the sample may differ from
+  /// the one findIntegerSample returns. Returns true if a sample was written,
+  /// false if there is none, and std::nullopt, leaving `sample` unspecified,
+  /// if some value of the sample does not fit in an int64_t.
+  std::optional<bool> findIntegerSample(MutableArrayRef<int64_t> sample);
+
+  /// Enable or disable incremental basis reduction, which is disabled by
+  /// default. When enabled, findIntegerSample builds the product simplex used
+  /// for basis reduction once and carries it across levels, rolling back and
+  /// adding the equalities for the directions fixed at the earlier levels,
+  /// instead of rebuilding it every time the basis is reduced. The sample found
+  /// may differ, since the reduced basis depends on the duals the product
+  /// simplex happens to find.
+  void setIncrementalBasisReduction(bool enable) {
+    incrementalBasisReduction = enable;
+  }
+
+  /// Set the rule used to choose pivot columns; see PivotRule.
+  void setPivotRule(PivotRule rule) { pivotRule = rule; }
+  PivotRule getPivotRule() const { return pivotRule; }
+
   enum class IneqType { Redundant, Cut, Separate };
 
   /// Returns the type of the inequality with coefficients `coeffs`.
@@ -801,13 +900,36 @@ public:
   /// std::nullopt.
   std::optional<SmallVector<MPInt, 8>> getSamplePointIfIntegral() const;
 
+  /// The same as getSamplePointIfIntegral, but writes the sample point to
+  /// `sample`, which must have one element per variable. Returns false if the
+  /// tableau is empty, or if the sample point is not integral or does not fit
+  /// in int64_t values.
+  bool getSamplePointIfIntegral(MutableArrayRef<int64_t> sample) const;
+
   /// Returns the current sample point, which may contain non-integer (rational)
   /// coordinates. Returns an empty optional when the tableau is empty.
   std::optional<SmallVector<Fraction, 8>> getRationalSample() const;
 
+  /// The same as getRationalSample, but writes the numerator and the positive
+  /// denominator of the sample value of each variable to `nums` and `dens`,
+  /// which must have one element per variable. Returns false if the tableau
+  /// is empty or if some value does not fit in an int64_t.
+  bool getRationalSample(MutableArrayRef<int64_t> nums,
+                         MutableArrayRef<int64_t> dens) const;
+
 private:
   friend class GBRSimplex;
 
+  /// Pivot until the given row reaches its optimum in the specified
+  /// direction, as in computeRowOptimum. Returns false if it is unbounded.
+  bool pivotRowToOptimum(Direction direction, unsigned row);
+
+  /// Compute the optimum of the given expression, rounded to the nearest
+  /// integer inside the polytope, into `result`, as in computeIntegerBounds.
+  /// Returns false if it does not fit in an int64_t.
+  bool computeIntegerOptimum(Direction direction, ArrayRef<MPInt> coeffs,
+                             MaybeOptimum<int64_t> &result);
+
   /// Restore the unknown to a non-negative sample value.
   ///
   /// Returns success if the unknown was successfully restored to a non-negative
@@ -820,9 +942,24 @@ private:
   /// negative value. The returned pivot row will be row if and only if the
   /// unknown is unbounded in the specified direction.
   ///
+  /// The column is chosen according to `rule`.
+  ///
   /// Returns a (row, col) pair denoting a pivot, or an empty Optional if
   /// no valid pivot exists.
-  std::optional<Pivot> findPivot(int row, Direction direction) const;
+  std::optional<Pivot> findPivot(int row, Direction direction,
+                                 PivotRule rule) const;
+
+  /// Return the score of pivoting on `col` to change the sample value of `row`
+  /// under `rule`, which must not be Bland. Higher scores are better. Returns
+  /// std::nullopt if an entry needed to compute it does not fit in an int64_t.
+  std::optional<double> getPivotColumnScore(unsigned row, unsigned col,
+                                            PivotRule rule) const;
+
+  /// Account for `pivot` being performed by an optimization that uses `rule`
+  /// and has performed `numDegenerate` consecutive degenerate pivots so far.
+  /// Switches `rule` to Bland once there are more than kMaxDegeneratePivots.
+  void guardAgainstCycling(Pivot pivot, PivotRule &rule,
+                           unsigned &numDegenerate) const;
 
   /// Find a row that can be used to pivot the column in the specified
   /// direction. If skipRow is not null, then this row is excluded
@@ -854,8 +991,22 @@ private:
   void markRowRedundant(Unknown &u);
 
   /// Reduce the given basis, starting at the specified level, using general
-  /// basis reduction.
-  void reduceBasis(Matrix &basis, unsigned level);
+  /// basis reduction with `gbrSimplex`, which must be the product simplex of
+  /// this simplex with itself. If known, `levelWidth` is the width of the
+  /// polytope along the basis vector at `level`.
+  void reduceBasis(Matrix &basis, unsigned level, GBRSimplex &gbrSimplex,
+                   std::optional<Fraction> levelWidth = {});
+
+  /// Whether findIntegerSample reuses the product simplex across levels; see
+  /// setIncrementalBasisReduction.
+  bool incrementalBasisReduction = false;
+
+  /// The rule used to choose pivot columns; see setPivotRule.
+  PivotRule pivotRule = PivotRule::Bland;
+
+  /// The number of consecutive degenerate pivots after which an optimization
+  /// falls back to Bland's rule.
+  constexpr static unsigned kMaxDegeneratePivots = 16;
 };
 
 /// Takes a snapshot of the simplex state on construction and rolls back to the
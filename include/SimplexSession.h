@@ -0,0 +1,139 @@
+//===- SimplexSession.h - MLIR SimplexSession Class -------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// An incremental interface for answering many emptiness queries on relations
+// that differ from a common base relation by a few constraints.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_SIMPLEXSESSION_H
+#define MLIR_ANALYSIS_PRESBURGER_SIMPLEXSESSION_H
+
+#include "IntegerRelation.h"
+#include "Simplex.h"
+#include <optional>
+
+namespace mlir {
+namespace presburger {
+
+/// A SimplexSession loads a base relation into a Simplex once, and then allows
+/// constraints to be pushed and popped in a stack-like fashion, answering
+/// emptiness queries about the base relation intersected with the constraints
+/// currently pushed. Constraints are added to the tableau incrementally and
+/// removed by rolling back to a snapshot, so each query only pays for the
+/// constraints that changed since the last one instead of rebuilding the
+/// tableau from scratch.
+///
+/// A typical use is:
+///
+///   SimplexSession session(base);
+///   for (...) {
+///     SimplexSession::Scope scope(session);
+///     session.addInequality(extraIneq);
+///     if (session.isIntegerEmpty())
+///       ...
+///   }
+///
+/// Integer queries on bounded sets are answered directly by the tableau. If the
+/// set is unbounded, the session falls back to
+/// IntegerRelation::findIntegerSample on a relation holding the base and the
+/// pushed constraints, which does not benefit from the incremental tableau.
+class SimplexSession {
+public:
+  /// Create a session whose base is `base`. All vars of `base`, including
+  /// locals, are treated as variables of the tableau.
+  explicit SimplexSession(const IntegerRelation &base);
+
+  SimplexSession(const SimplexSession &) = delete;
+  SimplexSession &operator=(const SimplexSession &) = delete;
+
+  /// Return the number of variables, i.e., the number of columns of the
+  /// constraints that can be added, minus one for the constant term.
+  unsigned getNumVars() const { return rel.getNumVars(); }
+
+  /// Return the number of levels pushed and not yet popped.
+  unsigned getDepth() const { return levels.size(); }
+
+  /// Start a new level. All constraints added after this call are removed by
+  /// the matching call to pop().
+  void push();
+
+  /// Remove all constraints added since the matching call to push(). There
+  /// must be at least one level to pop.
+  void pop();
+
+  /// Add an inequality or equality to the current level. The coefficients are
+  /// in the same format as IntegerRelation::addInequality/addEquality.
+  void addInequality(ArrayRef<MPInt> coeffs);
+  void addEquality(ArrayRef<MPInt> coeffs);
+
+  /// Add all the constraints of `other`, which must have the same space as the
+  /// base, to the current level.
+  void intersect(const IntegerRelation &other);
+
+  /// Return whether the current set has no rational points.
+  bool isEmpty() const { return simplex.isEmpty(); }
+
+  /// Return whether the current set has no integer points.
+  bool isIntegerEmpty() { return !findIntegerSample(); }
+
+  /// Find an integer sample of the current set, or return std::nullopt if it
+  /// has none. The tableau is left unchanged, so this can be freely mixed with
+  /// further additions.
+  std::optional<SmallVector<MPInt, 8>> findIntegerSample();
+
+  /// Return the current set as an IntegerRelation.
+  const IntegerRelation &getRelation() const { return rel; }
+
+  /// RAII helper that pushes a level on construction and pops it on
+  /// destruction.
+  class Scope {
+  public:
+    explicit Scope(SimplexSession &session) : session(session) {
+      session.push();
+    }
+    ~Scope() { session.pop(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    SimplexSession &session;
+  };
+
+private:
+  /// The state to restore when popping a level.
+  struct Level {
+    unsigned snapshot;
+    IntegerRelation::CountsSnapshot counts;
+  };
+
+  /// Return whether the current set is bounded, reusing the answer from a
+  /// previous query if the set has only gained constraints since then.
+  bool isBounded();
+
+  /// The tableau holding the base and all pushed constraints.
+  Simplex simplex;
+
+  /// The same constraints as `simplex`, kept around for the unbounded
+  /// fallback of findIntegerSample.
+  IntegerRelation rel;
+
+  /// The stack of pushed levels.
+  SmallVector<Level, 8> levels;
+
+  /// If set, the set was found to be bounded when the depth was this value.
+  /// Since levels at or below this depth can only add constraints, the set
+  /// stays bounded until a pop goes below it.
+  std::optional<unsigned> boundedDepth;
+};
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_SIMPLEXSESSION_H
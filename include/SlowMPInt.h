@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include <gmp.h>
 
@@ -39,7 +40,11 @@ public:
   explicit SlowMPInt(int64_t val);
   SlowMPInt();
   explicit SlowMPInt(const mpz_t &val);
-  SlowMPInt(const SlowMPInt& val);
+  SlowMPInt(const SlowMPInt &val);
+  SlowMPInt(SlowMPInt &&val) noexcept;
+  ~SlowMPInt();
+  SlowMPInt &operator=(const SlowMPInt &o);
+  SlowMPInt &operator=(SlowMPInt &&o) noexcept;
   SlowMPInt &operator=(int64_t val);
   explicit operator int64_t() const;
   SlowMPInt operator-() const;
@@ -63,17 +68,37 @@ public:
   SlowMPInt &operator++();
   SlowMPInt &operator--();
 
+  /// Compute *this += a * b, or *this -= a * b, in place and without
+  /// allocating temporaries.
+  SlowMPInt &addMul(const SlowMPInt &a, const SlowMPInt &b);
+  SlowMPInt &addMul(const SlowMPInt &a, int64_t b);
+  SlowMPInt &subMul(const SlowMPInt &a, const SlowMPInt &b);
+  SlowMPInt &subMul(const SlowMPInt &a, int64_t b);
+
   friend SlowMPInt abs(const SlowMPInt &x);
   friend SlowMPInt ceilDiv(const SlowMPInt &lhs, const SlowMPInt &rhs);
   friend SlowMPInt floorDiv(const SlowMPInt &lhs, const SlowMPInt &rhs);
   /// The operands must be non-negative for gcd.
   friend SlowMPInt gcd(const SlowMPInt &a, const SlowMPInt &b);
   friend class std::hash<SlowMPInt>;
+  friend SlowMPInt &operator+=(SlowMPInt &a, int64_t b);
+  friend SlowMPInt &operator-=(SlowMPInt &a, int64_t b);
+  friend SlowMPInt &operator*=(SlowMPInt &a, int64_t b);
 
   void print(std::ostream &os) const;
   void dump() const;
 
-  unsigned getBitWidth() const { return val.getBitWidth(); }
+  /// Return the number of bits needed to store the value in two's complement.
+  unsigned getBitWidth() const { return mpz_sizeinbase(val, 2) + 1; }
+
+  /// Store the magnitude of the value in `bytes`, least significant byte
+  /// first and without leading zero bytes, and return whether the value is
+  /// negative.
+  bool getMagnitudeBytes(std::vector<uint8_t> &bytes) const;
+  /// Return the value whose magnitude is stored in the `numBytes` bytes at
+  /// `bytes` as by getMagnitudeBytes, negated if `isNegative` is true.
+  static SlowMPInt fromMagnitudeBytes(const uint8_t *bytes, size_t numBytes,
+                                      bool isNegative);
 };
 
 std::ostream &operator<<(std::ostream &os, const SlowMPInt &x);
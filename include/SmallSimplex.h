@@ -0,0 +1,312 @@
+//===- SmallSimplex.h - MLIR SmallSimplex Class -----------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// A Simplex specialized at compile time for systems with few variables and
+// constraints, with a fixed-size int64_t tableau.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_SMALLSIMPLEX_H
+#define MLIR_ANALYSIS_PRESBURGER_SMALLSIMPLEX_H
+
+#include "MPInt.h"
+#include "Statistics.h"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+
+namespace mlir {
+namespace presburger {
+
+class IntegerRelation;
+
+/// A Simplex over at most `MaxVars` variables and `MaxRows` inequalities, for
+/// the tiny systems that make up most emptiness queries. It uses the same
+/// tableau layout and algorithm as Simplex, and a lowest-index pivot rule like
+/// it, though with the unknowns ordered differently, but the tableau is an
+/// std::array of int64_t values, so that the object lives on the stack, rows
+/// have a constant length that lets the compiler unroll the pivot loops, and
+/// a snapshot is a plain copy of the object. There is no undo log and no
+/// support for MPInts: an operation that exceeds the capacity of the tableau
+/// or overflows 64 bits marks the simplex as failed, after which its results
+/// are meaningless and the caller must fall back to Simplex.
+///
+/// Each row holds a common denominator in column 0, the constant term in
+/// column 1 and the coefficients of the column unknowns in the remaining
+/// columns. The unknowns are the variables followed by the constraints.
+template <unsigned MaxVars, unsigned MaxRows>
+class SmallSimplex {
+  static_assert(MaxVars + MaxRows <= 256,
+                "Unknown positions and indices are stored in 8 bits");
+
+public:
+  /// The number of columns of the tableau.
+  static constexpr unsigned kNumCols = MaxVars + 2;
+
+  explicit SmallSimplex(unsigned numVars) : numVars(numVars) {
+    assert(numVars <= MaxVars && "Too many variables!");
+    for (unsigned i = 0; i < numVars; ++i) {
+      colUnknown[2 + i] = i;
+      unknowns[i] = {/*isRow=*/false, /*pos=*/uint8_t(2 + i)};
+    }
+  }
+
+  unsigned getNumVars() const { return numVars; }
+  unsigned getNumRows() const { return numRows; }
+
+  /// Add the inequality c_0*x_0 + ... + c_{n-1}*x_{n-1} + c_n >= 0, where
+  /// `coeffs`, of length getNumVars() + 1, is c_0, ..., c_n, and try to make
+  /// its sample value non-negative. The tableau becomes empty if this is not
+  /// possible.
+  void addInequality(const int64_t *coeffs);
+
+  /// Whether the tableau is empty. Only meaningful if !hasFailed().
+  bool isEmpty() const { return empty; }
+
+  /// Whether an operation exceeded the capacity of the tableau or overflowed.
+  bool hasFailed() const { return failed; }
+
+  /// Return the sample value of variable `var` as a fraction with a positive
+  /// denominator.
+  std::pair<int64_t, int64_t> getSampleValue(unsigned var) const {
+    Unknown u = unknowns[var];
+    if (!u.isRow)
+      return {0, 1};
+    return {tableau[u.pos][1], tableau[u.pos][0]};
+  }
+
+private:
+  using Row = std::array<int64_t, kNumCols>;
+
+  struct Unknown {
+    bool isRow = false;
+    uint8_t pos = 0;
+  };
+
+  bool isRestricted(unsigned unknown) const { return unknown >= numVars; }
+
+  /// Divide the row by the GCD of its elements.
+  void normalizeRow(Row &row);
+
+  /// Pivot the unknowns of `pivotRow` and `pivotCol`, as in
+  /// SimplexBase::pivot.
+  void pivot(unsigned pivotRow, unsigned pivotCol);
+
+  /// Find a column whose change can increase the sample value of `row`, and a
+  /// row to pivot it with, like Simplex::findPivot does. The row is `row`
+  /// itself if the column is unbounded. Returns false if there is no such
+  /// column.
+  bool findPivotUp(unsigned row, unsigned &pivotRow, unsigned &pivotCol) const;
+
+  /// Pivot until the sample value of the row is non-negative, as in
+  /// Simplex::restoreRow. Returns false if this is not possible.
+  bool restoreRow(unsigned unknown);
+
+  std::array<Row, MaxRows> tableau{};
+  std::array<uint8_t, MaxRows> rowUnknown{};
+  std::array<uint8_t, kNumCols> colUnknown{};
+  std::array<Unknown, MaxVars + MaxRows> unknowns{};
+  unsigned numVars;
+  unsigned numRows = 0;
+  bool empty = false;
+  bool failed = false;
+};
+
+/// Decide whether `rel` is integer empty using a SmallSimplex, for relations
+/// small enough for one of the instantiations, and with all coefficients
+/// fitting in an int64_t. Integer points are searched by branch and bound on
+/// a fractional variable, with a limited number of nodes. Returns
+/// std::nullopt if the relation is too large or the search gives up, true if
+/// the relation is empty, and false if it is not, in which case `sample` is
+/// set to an integer point in it.
+std::optional<bool>
+isIntegerEmptyBySmallSimplex(const IntegerRelation &rel,
+                             SmallVectorImpl<MPInt> &sample);
+
+template <unsigned MaxVars, unsigned MaxRows>
+void SmallSimplex<MaxVars, MaxRows>::normalizeRow(Row &row) {
+  int64_t gcd = 0;
+  for (unsigned col = 0; col < kNumCols; ++col) {
+    // Taking the absolute value of the minimal int64_t overflows.
+    if (FP_UNLIKELY(row[col] == std::numeric_limits<int64_t>::min())) {
+      failed = true;
+      return;
+    }
+    gcd = std::gcd(gcd, row[col]);
+  }
+  if (gcd > 1)
+    for (unsigned col = 0; col < kNumCols; ++col)
+      row[col] /= gcd;
+}
+
+template <unsigned MaxVars, unsigned MaxRows>
+void SmallSimplex<MaxVars, MaxRows>::addInequality(const int64_t *coeffs) {
+  if (failed || empty)
+    return;
+  if (numRows == MaxRows) {
+    failed = true;
+    return;
+  }
+
+  unsigned newRow = numRows++;
+  Row &row = tableau[newRow];
+  row.fill(0);
+  row[0] = 1;
+  row[1] = coeffs[numVars];
+  bool overflow = false;
+  for (unsigned i = 0; i < numVars; ++i) {
+    if (coeffs[i] == 0)
+      continue;
+    Unknown u = unknowns[i];
+    if (!u.isRow) {
+      int64_t scaled;
+      overflow |= detail::mulOverflow(coeffs[i], row[0], scaled);
+      overflow |= detail::addOverflow(row[u.pos], scaled, row[u.pos]);
+      continue;
+    }
+    // Add the row of the variable, scaled by its coefficient, after
+    // bringing both rows to the lcm of their denominators.
+    const Row &varRow = tableau[u.pos];
+    int64_t gcd = std::gcd(row[0], varRow[0]);
+    int64_t newRowCoeff = varRow[0] / gcd;
+    int64_t varRowCoeff;
+    overflow |= detail::mulOverflow(coeffs[i], row[0] / gcd, varRowCoeff);
+    for (unsigned col = 0; col < kNumCols; ++col) {
+      int64_t scaled, delta;
+      overflow |= detail::mulOverflow(row[col], newRowCoeff, scaled);
+      overflow |= detail::mulOverflow(
+          varRowCoeff, col == 0 ? int64_t(0) : varRow[col], delta);
+      overflow |= detail::addOverflow(scaled, delta, row[col]);
+    }
+  }
+  if (FP_UNLIKELY(overflow)) {
+    failed = true;
+    return;
+  }
+  normalizeRow(row);
+
+  unsigned unknown = numVars + newRow;
+  rowUnknown[newRow] = unknown;
+  unknowns[unknown] = {/*isRow=*/true, /*pos=*/uint8_t(newRow)};
+  if (!restoreRow(unknown))
+    empty = true;
+}
+
+template <unsigned MaxVars, unsigned MaxRows>
+void SmallSimplex<MaxVars, MaxRows>::pivot(unsigned pivotRow,
+                                           unsigned pivotCol) {
+  FP_STAT_INC(NumPivots);
+  std::swap(rowUnknown[pivotRow], colUnknown[pivotCol]);
+  unknowns[rowUnknown[pivotRow]] = {/*isRow=*/true, uint8_t(pivotRow)};
+  unknowns[colUnknown[pivotCol]] = {/*isRow=*/false, uint8_t(pivotCol)};
+
+  // Transform the pivot row, as in SimplexBase::pivot.
+  Row &pRow = tableau[pivotRow];
+  std::swap(pRow[0], pRow[pivotCol]);
+  if (pRow[0] < 0) {
+    pRow[0] = -pRow[0];
+    pRow[pivotCol] = -pRow[pivotCol];
+  } else {
+    for (unsigned col = 1; col < kNumCols; ++col)
+      if (col != pivotCol)
+        pRow[col] = -pRow[col];
+  }
+  normalizeRow(pRow);
+
+  bool overflow = false;
+  for (unsigned r = 0; r < numRows; ++r) {
+    Row &row = tableau[r];
+    if (r == pivotRow || row[pivotCol] == 0)
+      continue;
+    int64_t pivotColCoeff = row[pivotCol];
+    for (unsigned col = 0; col < kNumCols; ++col) {
+      if (col == pivotCol)
+        continue;
+      // Add rather than subtract because the pivot row has been negated.
+      int64_t scaled, delta = 0;
+      overflow |= detail::mulOverflow(row[col], pRow[0], scaled);
+      if (col != 0)
+        overflow |= detail::mulOverflow(pivotColCoeff, pRow[col], delta);
+      overflow |= detail::addOverflow(scaled, delta, row[col]);
+    }
+    overflow |= detail::mulOverflow(pivotColCoeff, pRow[pivotCol],
+                                    row[pivotCol]);
+    normalizeRow(row);
+  }
+  failed |= overflow;
+}
+
+template <unsigned MaxVars, unsigned MaxRows>
+bool SmallSimplex<MaxVars, MaxRows>::findPivotUp(unsigned row,
+                                                 unsigned &pivotRow,
+                                                 unsigned &pivotCol) const {
+  // Prefer the column unknown with the lowest index. Here the variables come
+  // before the constraints, whereas Simplex numbers the constraints ~i and so
+  // prefers them to the variables; either order gives Bland's rule.
+  std::optional<unsigned> bestCol;
+  for (unsigned col = 2; col < numVars + 2; ++col) {
+    int64_t elem = tableau[row][col];
+    if (elem == 0)
+      continue;
+    if (isRestricted(colUnknown[col]) && elem < 0)
+      continue;
+    if (!bestCol || colUnknown[col] < colUnknown[*bestCol])
+      bestCol = col;
+  }
+  if (!bestCol)
+    return false;
+  pivotCol = *bestCol;
+
+  // The column moves up if its coefficient is positive, and down otherwise.
+  // Among the other restricted rows whose sample value this moves towards
+  // zero, pick the one that reaches it first, as in Simplex::findPivotRow.
+  bool isUp = tableau[row][pivotCol] > 0;
+  std::optional<unsigned> bestRow;
+  for (unsigned r = 0; r < numRows; ++r) {
+    if (r == row || !isRestricted(rowUnknown[r]))
+      continue;
+    int64_t elem = tableau[r][pivotCol];
+    if (elem == 0 || (elem > 0) == isUp)
+      continue;
+    if (!bestRow) {
+      bestRow = r;
+      continue;
+    }
+    // Compare the bounds c/|f| imposed by the rows. The products are computed
+    // as MPInts so that they cannot overflow.
+    MPInt diff = MPInt(tableau[*bestRow][1]) * MPInt(elem) -
+                 MPInt(tableau[r][1]) * MPInt(tableau[*bestRow][pivotCol]);
+    bool diffMatchesDirection = isUp ? diff > 0 : diff < 0;
+    if ((diff == 0 && rowUnknown[r] < rowUnknown[*bestRow]) ||
+        (diff != 0 && !diffMatchesDirection))
+      bestRow = r;
+  }
+  pivotRow = bestRow.value_or(row);
+  return true;
+}
+
+template <unsigned MaxVars, unsigned MaxRows>
+bool SmallSimplex<MaxVars, MaxRows>::restoreRow(unsigned unknown) {
+  while (!failed && tableau[unknowns[unknown].pos][1] < 0) {
+    unsigned pivotRow, pivotCol;
+    if (!findPivotUp(unknowns[unknown].pos, pivotRow, pivotCol))
+      break;
+    pivot(pivotRow, pivotCol);
+    // The unknown is unbounded above.
+    if (!unknowns[unknown].isRow)
+      return true;
+  }
+  return failed || tableau[unknowns[unknown].pos][1] >= 0;
+}
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_SMALLSIMPLEX_H
@@ -0,0 +1,147 @@
+//===- SolverContext.h - MLIR Presburger Solver Context ---------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// The thread-safety guarantees of the library, and SolverContext, which groups
+// the settings, caches, allocators and statistics used by queries so that
+// independent analyses can run on separate threads without sharing them.
+//
+// Thread safety
+// -------------
+//
+// - Const member functions of IntegerRelation, PresburgerRelation,
+//   PWMAFunction, MultiAffineFunction and Matrix may be called concurrently,
+//   on the same object or on distinct ones. Queries that need a Simplex build
+//   a private one. The only state they update in place is lazily computed
+//   and published atomically: the bounding boxes cached by
+//   PresburgerRelation, and the local representations cached by
+//   IntegerRelation (see getLocalReprs). Copying an object loads these caches
+//   atomically too, so it may race with such queries, but not with non-const
+//   member functions of the object being copied.
+// - Non-const member functions need exclusive access to the object they are
+//   called on, e.g., adding constraints, or enabling constraint uniquing on an
+//   IntegerRelation. The same holds for every member function of Simplex,
+//   LexSimplex, SymbolicLexSimplex and SimplexSession, whose queries change
+//   the tableau even when they look logically const; use one tableau per
+//   thread.
+// - MPInt values are independent: GMP only shares its memory functions
+//   between threads, and both its default ones and those installed by
+//   installMPIntArenaAllocator are thread-safe.
+// - The process-wide settings (setMaxNumThreads, setQueryCacheCapacity) may
+//   be changed at any time from any thread, and affect queries started after
+//   the change on every thread without a current SolverContext overriding
+//   them. installMPIntArenaAllocator must be called before any thread creates
+//   a large MPInt.
+// - Statistics are counted per thread; see Statistics.h.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MLIR_ANALYSIS_PRESBURGER_SOLVERCONTEXT_H
+#define MLIR_ANALYSIS_PRESBURGER_SOLVERCONTEXT_H
+
+#include "MPIntArena.h"
+#include "QueryCache.h"
+#include "Statistics.h"
+#include <atomic>
+#include <mutex>
+#include <optional>
+
+namespace mlir {
+namespace presburger {
+
+/// The settings, caches, allocators and statistics of a group of queries. A
+/// context takes effect on a thread while a SolverContextScope for it is
+/// alive, and is then propagated to the workers of parallelFor. This allows,
+/// e.g., one context per analyzed function, each with its own cache and
+/// statistics, with the analyses running concurrently.
+///
+/// A context may be current on several threads at once; all its members can
+/// be called from any thread. It must outlive all its scopes.
+class SolverContext {
+public:
+  SolverContext() = default;
+
+  SolverContext(const SolverContext &) = delete;
+  SolverContext &operator=(const SolverContext &) = delete;
+
+  /// Return the innermost context made current on the calling thread, or
+  /// nullptr if there is none.
+  static SolverContext *getCurrent();
+
+  /// Set the capacity of the query cache private to this context, with the
+  /// same meaning as setQueryCacheCapacity. With a capacity of zero, which is
+  /// the default, queries in this context use the process-wide cache.
+  void setQueryCacheCapacity(size_t capacity);
+  size_t getQueryCacheCapacity() const;
+  void clearQueryCache();
+  QueryCacheStats getQueryCacheStats() const;
+
+  /// Set the maximum number of threads used by parallel algorithms in this
+  /// context, with the same meaning as the process-wide setMaxNumThreads. A
+  /// value of zero, which is the default, uses the process-wide setting.
+  void setMaxNumThreads(unsigned numThreads);
+  unsigned getMaxNumThreads() const;
+
+  /// Make every scope of this context allocate the limbs of large MPInts from
+  /// an MPIntArenaScope with chunks of `chunkSize` bytes. A size of zero,
+  /// which is the default, disables this. This only has an effect if
+  /// installMPIntArenaAllocator has been called.
+  void setArenaChunkSize(size_t chunkSize);
+  size_t getArenaChunkSize() const;
+
+  /// Return the statistics of the work done on any thread while a scope of
+  /// this context was the outermost scope of this context on its thread,
+  /// since the last call to resetStatistics. Work is included when its scope
+  /// ends.
+  ::presburger::Statistics getStatistics() const;
+  void resetStatistics();
+
+  /// Return the cache private to this context, or nullptr if it is disabled.
+  detail::QueryCache *getOwnQueryCache() {
+    return queryCache.getCapacity() != 0 ? &queryCache : nullptr;
+  }
+
+private:
+  friend class SolverContextScope;
+
+  void addStatistics(const ::presburger::Statistics &stats);
+
+  mutable detail::QueryCache queryCache;
+  std::atomic<unsigned> maxNumThreads{0};
+  std::atomic<size_t> arenaChunkSize{0};
+
+  mutable std::mutex statsMutex;
+  ::presburger::Statistics stats;
+};
+
+/// Makes `context` the current context of the calling thread while alive.
+/// Scopes nest: when a scope ends, the context that was current when it was
+/// created becomes current again.
+class SolverContextScope {
+public:
+  explicit SolverContextScope(SolverContext &context);
+  ~SolverContextScope();
+
+  SolverContextScope(const SolverContextScope &) = delete;
+  SolverContextScope &operator=(const SolverContextScope &) = delete;
+
+private:
+  SolverContext &context;
+  /// The scope that was innermost on this thread when this one was created.
+  SolverContextScope *previous;
+  /// Whether an enclosing scope on this thread is for the same context, in
+  /// which case that scope counts the statistics.
+  bool isNested;
+  /// The statistics of this thread when the scope was created.
+  ::presburger::Statistics startStats;
+  std::optional<::presburger::MPIntArenaScope> arena;
+};
+
+} // namespace presburger
+} // namespace mlir
+
+#endif // MLIR_ANALYSIS_PRESBURGER_SOLVERCONTEXT_H
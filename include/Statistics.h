@@ -0,0 +1,200 @@
+//===- Statistics.h - MLIR Presburger Statistics ----------------*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Counters of internal events and timers of hot operations, used for profiling
+// the library.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FP_STATISTICS_H
+#define FP_STATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace presburger {
+
+/// A snapshot of the event counters and timers of the library.
+///
+/// The counters are only updated if the library is built with
+/// FP_ENABLE_STATISTICS defined; otherwise the FP_STAT_* macros compile to
+/// nothing and all counters stay zero.
+struct Statistics {
+  /// Number of pivots performed by Simplex tableaus.
+  uint64_t numPivots = 0;
+  /// Number of those pivots that left the sample value of the optimized row
+  /// unchanged.
+  uint64_t numDegeneratePivots = 0;
+  /// Number of optimizations whose pivot rule fell back to Bland's rule after
+  /// too many consecutive degenerate pivots.
+  uint64_t numPivotRuleFallbacks = 0;
+  /// Number of rollbacks of Simplex tableaus to a snapshot.
+  uint64_t numRollbacks = 0;
+  /// Number of MPInt results of arithmetic that were computed in, or that
+  /// switched to, the large representation.
+  uint64_t numMPIntPromotions = 0;
+  /// Number of levels of the integer sample search that were entered.
+  uint64_t numGBRLevels = 0;
+  /// Number of generalized basis reductions performed.
+  uint64_t numBasisReductions = 0;
+  /// Number of inequalities generated by Fourier-Motzkin elimination.
+  uint64_t numFMRowsGenerated = 0;
+  /// Number of frames pushed while computing set differences.
+  uint64_t numSubtractFrames = 0;
+  /// Number of pairs of disjuncts analyzed for coalescing.
+  uint64_t numCoalescePairs = 0;
+  /// Number of coalesced pairs where one disjunct contained the other.
+  uint64_t numCoalesceContained = 0;
+  /// Number of coalesced pairs that were merged by the cut case.
+  uint64_t numCoalesceCut = 0;
+
+  /// Time spent in the operations timed by FP_STAT_TIME, in nanoseconds.
+  uint64_t integerSampleNanoseconds = 0;
+  uint64_t fourierMotzkinNanoseconds = 0;
+  uint64_t subtractNanoseconds = 0;
+  uint64_t coalesceNanoseconds = 0;
+
+  Statistics &operator+=(const Statistics &other);
+  Statistics &operator-=(const Statistics &other);
+};
+
+inline Statistics operator+(Statistics lhs, const Statistics &rhs) {
+  return lhs += rhs;
+}
+
+/// Return the events that happened between the snapshots `rhs` and `lhs`.
+inline Statistics operator-(Statistics lhs, const Statistics &rhs) {
+  return lhs -= rhs;
+}
+
+/// Return whether the library was built with statistics enabled.
+constexpr bool areStatisticsEnabled() {
+#ifdef FP_ENABLE_STATISTICS
+  return true;
+#else
+  return false;
+#endif
+}
+
+/// Return the values of the counters summed over all threads, including the
+/// ones that have exited, since the last call to resetStatistics.
+Statistics getStatistics();
+
+/// Reset the counters returned by getStatistics to zero. This does not affect
+/// the values returned by getThreadStatistics.
+void resetStatistics();
+
+/// Return the values of the counters of the calling thread since its last call
+/// to resetThreadStatistics. Unlike getStatistics, this is not affected by the
+/// work of other threads, e.g., of the workers of parallelFor.
+Statistics getThreadStatistics();
+
+/// Reset the counters returned by getThreadStatistics to zero.
+void resetThreadStatistics();
+
+namespace detail {
+enum class StatKind : unsigned {
+  NumPivots,
+  NumDegeneratePivots,
+  NumPivotRuleFallbacks,
+  NumRollbacks,
+  NumMPIntPromotions,
+  NumGBRLevels,
+  NumBasisReductions,
+  NumFMRowsGenerated,
+  NumSubtractFrames,
+  NumCoalescePairs,
+  NumCoalesceContained,
+  NumCoalesceCut,
+  NumKinds
+};
+
+enum class TimerKind : unsigned {
+  IntegerSample,
+  FourierMotzkin,
+  Subtract,
+  Coalesce,
+  NumKinds
+};
+
+/// The counters of one thread. They only ever increase and are only written
+/// by their thread, so updating them needs no read-modify-write operation;
+/// they are atomics so that other threads can read them. Resets are
+/// implemented by remembering the values at the time of the reset.
+struct ThreadCounters {
+  ThreadCounters();
+  ~ThreadCounters();
+
+  std::atomic<uint64_t> counts[static_cast<unsigned>(StatKind::NumKinds)];
+  std::atomic<uint64_t>
+      nanoseconds[static_cast<unsigned>(TimerKind::NumKinds)];
+  /// The values at the last call to resetThreadStatistics.
+  Statistics threadBaseline;
+};
+
+extern thread_local ThreadCounters threadCounters;
+
+/// Return the values of the counters of the calling thread since it started,
+/// regardless of calls to resetThreadStatistics.
+Statistics getThreadTotals();
+
+inline void bumpCounter(std::atomic<uint64_t> &counter, uint64_t amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount,
+                std::memory_order_relaxed);
+}
+
+inline void incrementStat(StatKind kind, uint64_t amount = 1) {
+  bumpCounter(threadCounters.counts[static_cast<unsigned>(kind)], amount);
+}
+
+/// Adds the time between its construction and destruction to a timer.
+class ScopedStatTimer {
+public:
+  explicit ScopedStatTimer(TimerKind kind)
+      : kind(kind), start(std::chrono::steady_clock::now()) {}
+  ~ScopedStatTimer() {
+    std::chrono::nanoseconds elapsed =
+        std::chrono::steady_clock::now() - start;
+    bumpCounter(threadCounters.nanoseconds[static_cast<unsigned>(kind)],
+                elapsed.count());
+  }
+
+  ScopedStatTimer(const ScopedStatTimer &) = delete;
+  ScopedStatTimer &operator=(const ScopedStatTimer &) = delete;
+
+private:
+  TimerKind kind;
+  std::chrono::steady_clock::time_point start;
+};
+} // namespace detail
+
+} // namespace presburger
+
+#define FP_STAT_CONCAT_IMPL(A, B) A##B
+#define FP_STAT_CONCAT(A, B) FP_STAT_CONCAT_IMPL(A, B)
+
+/// FP_STAT_INC counts one event of the given StatKind and FP_STAT_ADD counts
+/// `AMOUNT` of them. FP_STAT_TIME adds the time spent in the rest of the
+/// enclosing scope to the timer of the given TimerKind.
+#ifdef FP_ENABLE_STATISTICS
+#define FP_STAT_INC(KIND)                                                      \
+  ::presburger::detail::incrementStat(::presburger::detail::StatKind::KIND)
+#define FP_STAT_ADD(KIND, AMOUNT)                                              \
+  ::presburger::detail::incrementStat(::presburger::detail::StatKind::KIND,    \
+                                      (AMOUNT))
+#define FP_STAT_TIME(KIND)                                                     \
+  ::presburger::detail::ScopedStatTimer FP_STAT_CONCAT(fpStatTimer, __LINE__)( \
+      ::presburger::detail::TimerKind::KIND)
+#else
+#define FP_STAT_INC(KIND) ((void)0)
+#define FP_STAT_ADD(KIND, AMOUNT) ((void)0)
+#define FP_STAT_TIME(KIND) ((void)0)
+#endif
+
+#endif // FP_STATISTICS_H
@@ -15,6 +15,7 @@
 
 #include "MPInt.h"
 #include "Matrix.h"
+#include <memory>
 #include <optional>
 
 namespace presburger {
@@ -164,6 +165,16 @@ public:
   // their division representation.
   SmallVector<std::optional<MPInt>, 4> divValuesAt(ArrayRef<MPInt> point) const;
 
+  // Batch version of divValuesAt for int64 points, which requires every
+  // division to have a representation. `values` holds `numPoints` points
+  // column-major, as in evaluateAffineBatch, with the values of the
+  // non-division variables followed by space for the division variables,
+  // which is filled in. Points for which the computation overflows are marked in `overflow`.
+  // Returns false, without computing anything, if some coefficient does not
+  // fit in an int64_t.
+  bool divValuesAtBatch(MutableArrayRef<int64_t> values, unsigned numPoints,
+                        MutableArrayRef<bool> overflow) const;
+
   // Get the `i^th` denominator.
   MPInt &getDenom(unsigned i) { return denoms[i]; }
   MPInt getDenom(unsigned i) const { return denoms[i]; }
@@ -225,6 +236,11 @@ SmallVector<MPInt, 8> getDivUpperBound(ArrayRef<MPInt> dividend,
 SmallVector<MPInt, 8> getDivLowerBound(ArrayRef<MPInt> dividend,
                                        const MPInt &divisor,
                                        unsigned localVarIdx);
+/// The same, but store the bound in `ineq`, reusing its storage.
+void getDivUpperBound(ArrayRef<MPInt> dividend, const MPInt &divisor,
+                      unsigned localVarIdx, SmallVectorImpl<MPInt> &ineq);
+void getDivLowerBound(ArrayRef<MPInt> dividend, const MPInt &divisor,
+                      unsigned localVarIdx, SmallVectorImpl<MPInt> &ineq);
 
 llvm::SmallBitVector getSubrangeBitVector(unsigned len, unsigned setOffset,
                                           unsigned numSet);
@@ -237,6 +253,22 @@ llvm::SmallBitVector getSubrangeBitVector(unsigned len, unsigned setOffset,
 SmallVector<MPInt, 8> getMPIntVec(ArrayRef<int64_t> range);
 /// Return the given array as an array of int64_t.
 SmallVector<int64_t, 8> getInt64Vec(ArrayRef<MPInt> range);
+/// The same, but store the result in `result`, reusing its storage.
+void getInt64Vec(ArrayRef<MPInt> range, SmallVectorImpl<int64_t> &result);
+/// If all the elements of `range` fit in an int64_t, store them in `result`
+/// and return true. Otherwise, return false.
+bool getInt64VecIfFits(ArrayRef<MPInt> range, SmallVectorImpl<int64_t> &result);
+
+/// Evaluate the affine expression `expr`, which has one coefficient per var
+/// followed by a constant, at `numPoints` points at once. The points are stored
+/// column-major in `points`, i.e., the value of the i^th var of the p^th point
+/// is `points[i * numPoints + p]`. The value at the p^th point is written to
+/// `out[p]`. If the computation overflows for the p^th point, `overflow[p]` is
+/// set to true and `out[p]` is unspecified; otherwise `overflow[p]` is left
+/// unchanged.
+void evaluateAffineBatch(ArrayRef<int64_t> expr, ArrayRef<int64_t> points,
+                         unsigned numPoints, MutableArrayRef<int64_t> out,
+                         MutableArrayRef<bool> overflow);
 
 /// Returns the `MaybeLocalRepr` struct which contains the indices of the
 /// constraints that can be expressed as a floordiv of an affine function. If
@@ -276,6 +308,20 @@ MPInt gcdRange(ArrayRef<MPInt> range);
 /// Divide the range by its gcd and return the gcd.
 MPInt normalizeRange(MutableArrayRef<MPInt> range);
 
+/// Normalize the constraint `row` into `normalized`, such that constraints that
+/// are equivalent over the integers up to a positive scaling normalize to the
+/// same row. The variable coefficients of an inequality are divided by their
+/// gcd and the constant term is replaced by the floor of its quotient by the
+/// gcd. An equality is divided by the gcd of all its coefficients and its sign
+/// is chosen to make the first non-zero coefficient positive. Returns false,
+/// leaving `normalized` unspecified, if all the variable coefficients are
+/// zero.
+bool normalizeConstraint(ArrayRef<MPInt> row, bool isEq,
+                         SmallVectorImpl<MPInt> &normalized);
+
+/// Combine the hashes of the elements of the range.
+hash_code hashRange(ArrayRef<MPInt> range);
+
 /// Normalize the given (numerator, denominator) pair by dividing out the
 /// common factors between them. The numerator here is an affine expression
 /// with integer coefficients. The denominator must be positive.
@@ -283,6 +329,9 @@ void normalizeDiv(MutableArrayRef<MPInt> num, MPInt &denom);
 
 /// Return `coeffs` with all the elements negated.
 SmallVector<MPInt, 8> getNegatedCoeffs(ArrayRef<MPInt> coeffs);
+/// The same, but store the result in `negated`, reusing its storage. `negated`
+/// must not alias `coeffs`.
+void getNegatedCoeffs(ArrayRef<MPInt> coeffs, SmallVectorImpl<MPInt> &negated);
 
 /// Return the complement of the given inequality.
 ///
@@ -290,6 +339,44 @@ SmallVector<MPInt, 8> getNegatedCoeffs(ArrayRef<MPInt> coeffs);
 /// a_1 x_1 + ... + a_n x_ + c < 0, i.e., -a_1 x_1 - ... - a_n x_ - c - 1 >= 0,
 /// since all the variables are constrained to be integers.
 SmallVector<MPInt, 8> getComplementIneq(ArrayRef<MPInt> ineq);
+/// The same, but store the result in `complement`, reusing its storage.
+/// `complement` must not alias `ineq`.
+void getComplementIneq(ArrayRef<MPInt> ineq,
+                       SmallVectorImpl<MPInt> &complement);
+
+/// Holds a lazily computed value that is never modified once computed, such
+/// as a cache filled by const queries. The const members access the pointer
+/// atomically, and so does copying the holder, so that an object can be
+/// queried or copied while another thread publishes its cache. The non-const
+/// members need exclusive access, like the non-const members of the object
+/// holding the cache, and are not atomic.
+template <typename T>
+class SharedCache {
+public:
+  SharedCache() = default;
+  SharedCache(const SharedCache &other) : ptr(other.load()) {}
+  SharedCache &operator=(const SharedCache &other) {
+    ptr = other.load();
+    return *this;
+  }
+
+  /// Return the cached value, or null if none has been published.
+  std::shared_ptr<const T> load() const { return std::atomic_load(&ptr); }
+  void store(std::shared_ptr<const T> value) { ptr = std::move(value); }
+  void reset() { ptr.reset(); }
+
+  /// Publish `value` unless another value has been published already, and
+  /// return the published value.
+  std::shared_ptr<const T> publish(std::shared_ptr<const T> value) const {
+    std::shared_ptr<const T> expected;
+    if (!std::atomic_compare_exchange_strong(&ptr, &expected, value))
+      return expected;
+    return value;
+  }
+
+private:
+  mutable std::shared_ptr<const T> ptr;
+};
 } // namespace presburger
 
 #endif // MLIR_ANALYSIS_PRESBURGER_UTILS_H
@@ -0,0 +1,283 @@
+//===- IntegerPointEnumerator.cpp - MLIR IntegerPointEnumerator -----------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "IntegerPointEnumerator.h"
+#include "Parallel.h"
+#include "Utils.h"
+#include <algorithm>
+
+using namespace mlir;
+using namespace presburger;
+
+using OuterRange = std::optional<std::pair<int64_t, int64_t>>;
+
+IntegerPointEnumerator::DisjunctEnumerator::DisjunctEnumerator(
+    const IntegerRelation &rel, OuterRange outerRange)
+    : rel(rel), simplex(rel), outerRange(outerRange),
+      numDims(rel.getNumDimAndSymbolVars()), row(rel.getNumCols(), MPInt(0)),
+      point(rel.getNumDimAndSymbolVars()) {
+  assert(rel.getNumSymbolVars() == 0 && "Symbols are not yet supported!");
+  bool localsAreDetermined =
+      rel.getNumLocalVars() == 0 || rel.getLocalReprs().hasAllReprs();
+  // Determined locals are enumerated too; each takes at most one value once
+  // the non-local vars are fixed.
+  numEnumerated = localsAreDetermined ? rel.getNumVars() : numDims;
+  isLastExact = localsAreDetermined;
+  values.resize(numEnumerated);
+  upper.resize(numEnumerated);
+  snapshots.resize(numEnumerated);
+
+  if (simplex.isEmpty())
+    return;
+  if (numEnumerated == 0) {
+    hasPendingEmptyPoint = isProjectionPoint();
+    return;
+  }
+  if (computeBounds(0))
+    depth = 1;
+}
+
+bool IntegerPointEnumerator::DisjunctEnumerator::computeBounds(
+    unsigned level) {
+  row[level] = 1;
+  auto [min, max] = simplex.computeIntegerBounds(row);
+  row[level] = 0;
+  // The values of the previous vars may leave no rational points.
+  if (min.isEmpty())
+    return false;
+  assert(min.isBounded() && max.isBounded() &&
+         "Var should only take finitely many values!");
+  if (*min > *max)
+    return false;
+  values[level] = int64FromMPInt(*min);
+  upper[level] = int64FromMPInt(*max);
+  if (level == 0 && outerRange) {
+    values[0] = std::max(values[0], outerRange->first);
+    upper[0] = std::min(upper[0], outerRange->second);
+  }
+  return values[level] <= upper[level];
+}
+
+void IntegerPointEnumerator::DisjunctEnumerator::ascend() {
+  --depth;
+  if (depth == 0)
+    return;
+  simplex.rollback(snapshots[depth - 1]);
+  ++values[depth - 1];
+}
+
+bool IntegerPointEnumerator::DisjunctEnumerator::isProjectionPoint() {
+  if (isLastExact)
+    return true;
+  for (unsigned i = 0; i < numDims; ++i)
+    point[i] = values[i];
+  return rel.containsPointNoLocal(point).has_value();
+}
+
+unsigned
+IntegerPointEnumerator::DisjunctEnumerator::getNextChunk(int64_t *out,
+                                                         unsigned maxPoints) {
+  if (hasPendingEmptyPoint && maxPoints != 0) {
+    hasPendingEmptyPoint = false;
+    return 1;
+  }
+
+  unsigned numWritten = 0;
+  while (depth != 0 && numWritten < maxPoints) {
+    unsigned level = depth - 1;
+    if (values[level] > upper[level]) {
+      ascend();
+      continue;
+    }
+
+    if (level + 1 == numEnumerated) {
+      // Write the points along the last var. The enumerated locals, if any,
+      // come after the non-local vars and are not part of the points.
+      for (; values[level] <= upper[level] && numWritten < maxPoints;
+           ++values[level]) {
+        if (!isProjectionPoint())
+          continue;
+        std::copy(values.begin(), values.begin() + numDims,
+                  out + numWritten * numDims);
+        ++numWritten;
+      }
+      continue;
+    }
+
+    // Fix the var of this level and descend into the next one.
+    snapshots[level] = simplex.getSnapshot();
+    row[level] = 1;
+    row.back() = -values[level];
+    simplex.addEquality(row);
+    row[level] = 0;
+    row.back() = 0;
+    if (computeBounds(level + 1)) {
+      ++depth;
+      continue;
+    }
+    simplex.rollback(snapshots[level]);
+    ++values[level];
+  }
+  return numWritten;
+}
+
+IntegerPointEnumerator::IntegerPointEnumerator(const IntegerRelation &rel)
+    : IntegerPointEnumerator(PresburgerRelation(rel)) {}
+
+IntegerPointEnumerator::IntegerPointEnumerator(const PresburgerRelation &rel) {
+  init(rel, std::nullopt);
+}
+
+IntegerPointEnumerator::IntegerPointEnumerator(const IntegerRelation &rel,
+                                               int64_t outerBegin,
+                                               int64_t outerEnd)
+    : IntegerPointEnumerator(PresburgerRelation(rel), outerBegin, outerEnd) {}
+
+IntegerPointEnumerator::IntegerPointEnumerator(const PresburgerRelation &rel,
+                                               int64_t outerBegin,
+                                               int64_t outerEnd) {
+  init(rel, std::make_pair(outerBegin, outerEnd));
+}
+
+void IntegerPointEnumerator::init(const PresburgerRelation &rel,
+                                  OuterRange outerRange) {
+  numDims = rel.getSpace().getNumDimAndSymbolVars();
+  if (rel.getNumDisjuncts() == 1) {
+    parts.emplace_back(rel.getDisjunct(0), outerRange);
+    return;
+  }
+  if (!rel.hasOnlyDivLocals()) {
+    init(rel.computeReprWithOnlyDivLocals(), outerRange);
+    return;
+  }
+
+  // Subtract the previous disjuncts from each one, so that the parts are
+  // pairwise disjoint, as in PresburgerRelation::countIntegerPoints. This
+  // needs the locals of the disjuncts to be divisions.
+  PresburgerRelation previous = PresburgerRelation::getEmpty(rel.getSpace());
+  for (const IntegerRelation &disjunct : rel.getAllDisjuncts()) {
+    PresburgerRelation part(disjunct);
+    if (previous.getNumDisjuncts() != 0)
+      part = part.subtract(previous);
+    for (const IntegerRelation &piece : part.getAllDisjuncts())
+      parts.emplace_back(piece, outerRange);
+    previous.unionInPlace(disjunct);
+  }
+  lookahead.resize(parts.size() * numDims);
+  hasLookahead.resize(parts.size());
+}
+
+void IntegerPointEnumerator::refill(unsigned part) {
+  hasLookahead[part] =
+      parts[part].getNextChunk(lookahead.data() + part * numDims, 1) == 1;
+}
+
+unsigned IntegerPointEnumerator::getNextChunk(MutableArrayRef<int64_t> buffer) {
+  unsigned maxPoints = numDims == 0 ? std::min<size_t>(buffer.size(), 1)
+                                    : buffer.size() / numDims;
+  // A single part produces its points in order.
+  if (parts.size() == 1)
+    return parts[0].getNextChunk(buffer.data(), maxPoints);
+
+  if (!isLookaheadInitialized) {
+    for (unsigned i = 0, e = parts.size(); i < e; ++i)
+      refill(i);
+    isLookaheadInitialized = true;
+  }
+
+  // Repeatedly take the lexicographically smallest lookahead point. The parts
+  // are disjoint, so no two lookahead points are equal.
+  auto getLookahead = [&](unsigned part) {
+    return ArrayRef<int64_t>(lookahead.data() + part * numDims, numDims);
+  };
+  unsigned numWritten = 0;
+  for (; numWritten < maxPoints; ++numWritten) {
+    std::optional<unsigned> min;
+    for (unsigned i = 0, e = parts.size(); i < e; ++i) {
+      if (!hasLookahead[i])
+        continue;
+      if (!min || std::lexicographical_compare(
+                      getLookahead(i).begin(), getLookahead(i).end(),
+                      getLookahead(*min).begin(), getLookahead(*min).end()))
+        min = i;
+    }
+    if (!min)
+      break;
+    std::copy(getLookahead(*min).begin(), getLookahead(*min).end(),
+              buffer.begin() + numWritten * numDims);
+    refill(*min);
+  }
+  return numWritten;
+}
+
+std::optional<std::pair<int64_t, int64_t>>
+IntegerPointEnumerator::getOuterBounds(const IntegerRelation &rel) {
+  if (rel.getNumDimAndSymbolVars() == 0)
+    return {};
+  Simplex simplex(rel);
+  if (simplex.isEmpty())
+    return {};
+  SmallVector<MPInt, 8> dim(rel.getNumCols(), MPInt(0));
+  dim[0] = 1;
+  auto [min, max] = simplex.computeIntegerBounds(dim);
+  assert(min.isBounded() && max.isBounded() && "Relation should be bounded!");
+  if (*min > *max)
+    return {};
+  return std::make_pair(int64FromMPInt(*min), int64FromMPInt(*max));
+}
+
+std::optional<std::pair<int64_t, int64_t>>
+IntegerPointEnumerator::getOuterBounds(const PresburgerRelation &rel) {
+  OuterRange result;
+  for (const IntegerRelation &disjunct : rel.getAllDisjuncts()) {
+    OuterRange bounds = getOuterBounds(disjunct);
+    if (!bounds)
+      continue;
+    if (!result) {
+      result = bounds;
+      continue;
+    }
+    result->first = std::min(result->first, bounds->first);
+    result->second = std::max(result->second, bounds->second);
+  }
+  return result;
+}
+
+void presburger::parallelForEachIntegerPointChunk(
+    const PresburgerRelation &rel, unsigned numParts, unsigned chunkSize,
+    llvm::function_ref<void(unsigned part, ArrayRef<int64_t> points)> fn) {
+  assert(numParts >= 1 && chunkSize >= 1 && "Invalid split!");
+  OuterRange bounds = IntegerPointEnumerator::getOuterBounds(rel);
+  if (!bounds) {
+    // Without a first var to split on, there is no parallelism to exploit.
+    IntegerPointEnumerator enumerator(rel);
+    SmallVector<int64_t, 8> buffer(std::max(chunkSize * enumerator.getNumDims(),
+                                            1u));
+    while (unsigned numPoints = enumerator.getNextChunk(buffer))
+      fn(0, ArrayRef<int64_t>(buffer).take_front(numPoints *
+                                                enumerator.getNumDims()));
+    return;
+  }
+
+  // Split the values of the first var into ranges whose sizes differ by at
+  // most one.
+  uint64_t numValues = uint64_t(bounds->second) - uint64_t(bounds->first) + 1;
+  numParts = std::min<uint64_t>(numParts, numValues);
+  uint64_t partSize = numValues / numParts, numLarger = numValues % numParts;
+  parallelFor(0, numParts, [&](unsigned part) {
+    uint64_t offset = partSize * part + std::min<uint64_t>(part, numLarger);
+    uint64_t size = partSize + (part < numLarger);
+    int64_t begin = int64_t(uint64_t(bounds->first) + offset);
+    int64_t end = int64_t(uint64_t(begin) + size - 1);
+    IntegerPointEnumerator enumerator(rel, begin, end);
+    SmallVector<int64_t, 8> buffer(chunkSize * enumerator.getNumDims());
+    while (unsigned numPoints = enumerator.getNextChunk(buffer))
+      fn(part, ArrayRef<int64_t>(buffer).take_front(numPoints *
+                                                   enumerator.getNumDims()));
+  });
+}
@@ -15,9 +15,14 @@
 #include "IntegerRelation.h"
 #include "LinearTransform.h"
 #include "PWMAFunction.h"
+#include "Parallel.h"
 #include "PresburgerRelation.h"
+#include "QueryCache.h"
 #include "Simplex.h"
+#include "SmallSimplex.h"
+#include "Statistics.h"
 #include "Utils.h"
+#include <algorithm>
 #include <numeric>
 #include <optional>
 
@@ -38,11 +43,13 @@ std::unique_ptr<IntegerPolyhedron> IntegerPolyhedron::clone() const {
 }
 
 void IntegerRelation::setSpace(const PresburgerSpace &oSpace) {
+  invalidateLocalReprs();
   assert(space.getNumVars() == oSpace.getNumVars() && "invalid space!");
   space = oSpace;
 }
 
 void IntegerRelation::setSpaceExceptLocals(const PresburgerSpace &oSpace) {
+  invalidateLocalReprs();
   assert(oSpace.getNumLocalVars() == 0 && "no locals should be present!");
   assert(oSpace.getNumVars() <= getNumVars() && "invalid space!");
   unsigned newNumLocals = getNumVars() - oSpace.getNumVars();
@@ -51,6 +58,7 @@ void IntegerRelation::setSpaceExceptLocals(const PresburgerSpace &oSpace) {
 }
 
 void IntegerRelation::append(const IntegerRelation &other) {
+  invalidateLocalReprs();
   assert(space.isEqual(other.getSpace()) && "Spaces must be equal.");
 
   inequalities.reserveRows(inequalities.getNumRows() +
@@ -163,6 +171,133 @@ void IntegerRelation::truncate(const CountsSnapshot &counts) {
   removeEqualityRange(counts.getNumEqs(), getNumEqualities());
 }
 
+unsigned IntegerRelation::getSnapshot() {
+  undo.isRecording = true;
+  return undo.entries.size();
+}
+
+void IntegerRelation::rollback(unsigned snapshot) {
+  assert(undo.isRecording && snapshot <= undo.entries.size() &&
+         "Invalid snapshot");
+  // Undoing an edit uses the same functions as making it, which must not
+  // record anything.
+  undo.isRecording = false;
+  while (undo.entries.size() > snapshot)
+    undoLastEntry();
+  undo.isRecording = true;
+}
+
+void IntegerRelation::discardUndoLog() { undo.clear(); }
+
+void IntegerRelation::recordRewriteConstraints() {
+  if (!undo.isRecording)
+    return;
+  undo.spaces.push_back(space);
+  undo.constraints.emplace_back(equalities, inequalities);
+  undo.entries.push_back({UndoLogEntry::Kind::RewriteConstraints});
+}
+
+void IntegerRelation::recordRemovedRows(bool isEq, unsigned start,
+                                        unsigned end) {
+  if (!undo.isRecording || start >= end)
+    return;
+  const Matrix &mat = isEq ? equalities : inequalities;
+  for (unsigned r = start; r < end; ++r)
+    undo.coeffs.append(mat.getRow(r).begin(), mat.getRow(r).end());
+  UndoLogEntry entry{isEq ? UndoLogEntry::Kind::RemoveEqualities
+                          : UndoLogEntry::Kind::RemoveInequalities};
+  entry.pos = start;
+  entry.num = end - start;
+  undo.entries.push_back(std::move(entry));
+}
+
+void IntegerRelation::addToColumn(unsigned srcPos, unsigned dstPos,
+                                  const MPInt &scale) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
+  if (undo.isRecording) {
+    UndoLogEntry entry{UndoLogEntry::Kind::AddToColumn};
+    entry.pos = srcPos;
+    entry.otherPos = dstPos;
+    entry.scale = scale;
+    undo.entries.push_back(std::move(entry));
+  }
+  inequalities.addToColumn(srcPos, dstPos, scale);
+  equalities.addToColumn(srcPos, dstPos, scale);
+}
+
+void IntegerRelation::undoLastEntry() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
+  UndoLogEntry entry = undo.entries.pop_back_val();
+  unsigned numCols = getNumCols();
+
+  // Copy the `numRows * width` saved coefficients ending at position `end`
+  // into the `numRows` rows of `mat` starting at `row`, in the `width` columns
+  // starting at `col`.
+  auto restoreCoeffs = [this](Matrix &mat, unsigned row, unsigned numRows,
+                              unsigned col, unsigned width, unsigned end) {
+    const MPInt *saved = undo.coeffs.data() + end - numRows * width;
+    for (unsigned r = 0; r < numRows; ++r)
+      for (unsigned c = 0; c < width; ++c)
+        mat(row + r, col + c) = *saved++;
+  };
+
+  switch (entry.kind) {
+  case UndoLogEntry::Kind::AppendEquality:
+    equalities.removeRow(equalities.getNumRows() - 1);
+    break;
+  case UndoLogEntry::Kind::AppendInequality:
+    inequalities.removeRow(inequalities.getNumRows() - 1);
+    break;
+  case UndoLogEntry::Kind::RemoveEqualities:
+  case UndoLogEntry::Kind::RemoveInequalities:
+  case UndoLogEntry::Kind::ReplaceInequality: {
+    Matrix &mat = entry.kind == UndoLogEntry::Kind::RemoveEqualities
+                      ? equalities
+                      : inequalities;
+    unsigned numRows =
+        entry.kind == UndoLogEntry::Kind::ReplaceInequality ? 1 : entry.num;
+    if (entry.kind != UndoLogEntry::Kind::ReplaceInequality)
+      mat.insertRows(entry.pos, numRows);
+    restoreCoeffs(mat, entry.pos, numRows, 0, numCols, undo.coeffs.size());
+    undo.coeffs.truncate(undo.coeffs.size() - numRows * numCols);
+    break;
+  }
+  case UndoLogEntry::Kind::InsertVars:
+    removeVarRange(entry.varKind, entry.pos, entry.pos + entry.num);
+    break;
+  case UndoLogEntry::Kind::RemoveVars: {
+    // The coefficients of the equalities were saved before those of the
+    // inequalities.
+    space = undo.spaces.pop_back_val();
+    unsigned col = space.getVarKindOffset(entry.varKind) + entry.pos;
+    equalities.insertColumns(col, entry.num);
+    inequalities.insertColumns(col, entry.num);
+    unsigned end = undo.coeffs.size();
+    restoreCoeffs(inequalities, 0, getNumInequalities(), col, entry.num, end);
+    end -= getNumInequalities() * entry.num;
+    restoreCoeffs(equalities, 0, getNumEqualities(), col, entry.num, end);
+    end -= getNumEqualities() * entry.num;
+    undo.coeffs.truncate(end);
+    break;
+  }
+  case UndoLogEntry::Kind::SwapVars:
+    swapVar(entry.pos, entry.otherPos);
+    break;
+  case UndoLogEntry::Kind::AddToColumn:
+    addToColumn(entry.pos, entry.otherPos, -entry.scale);
+    break;
+  case UndoLogEntry::Kind::RewriteConstraints: {
+    space = undo.spaces.pop_back_val();
+    std::pair<Matrix, Matrix> constraints = undo.constraints.pop_back_val();
+    equalities = std::move(constraints.first);
+    inequalities = std::move(constraints.second);
+    break;
+  }
+  }
+}
+
 PresburgerRelation IntegerRelation::computeReprWithOnlyDivLocals() const {
   // If there are no locals, we're done.
   if (getNumLocalVars() == 0)
@@ -224,7 +359,8 @@ PresburgerRelation IntegerRelation::computeReprWithOnlyDivLocals() const {
   return result;
 }
 
-SymbolicLexMin IntegerRelation::findSymbolicIntegerLexMin() const {
+SymbolicLexMin
+IntegerRelation::findSymbolicIntegerLexMin(unsigned parallelSplitDepth) const {
   // Symbol and Domain vars will be used as symbols for symbolic lexmin.
   // In other words, for every value of the symbols and domain, return the
   // lexmin value of the (range, locals).
@@ -242,7 +378,7 @@ SymbolicLexMin IntegerRelation::findSymbolicIntegerLexMin() const {
                              /*numDims=*/getNumDomainVars(),
                              /*numSymbols=*/getNumSymbolVars())),
                          isSymbol)
-          .computeSymbolicIntegerLexMin();
+          .computeSymbolicIntegerLexMin(parallelSplitDepth);
 
   // We want to return only the lexmin over the dims, so strip the locals from
   // the computed lexmin.
@@ -259,9 +395,29 @@ IntegerRelation::subtract(const PresburgerRelation &set) const {
 unsigned IntegerRelation::insertVar(VarKind kind, unsigned pos, unsigned num) {
   assert(pos <= getNumVarKind(kind));
 
+  // Inserted locals appear in no constraint, so they have no representation
+  // and leave those of the other locals unchanged.
+  if (kind != VarKind::Local) {
+    invalidateLocalReprs();
+    invalidateConstraintIndex();
+  } else if (std::shared_ptr<const LocalReprs> cached = localReprCache.load();
+             cached && num != 0) {
+    auto reprs = std::make_shared<LocalReprs>(*cached);
+    reprs->divs.insertDiv(pos, num);
+    reprs->reprs.insert(reprs->reprs.begin() + pos, num, MaybeLocalRepr());
+    localReprCache.store(std::move(reprs));
+  }
+
   unsigned insertPos = space.insertVar(kind, pos, num);
   inequalities.insertColumns(insertPos, num);
   equalities.insertColumns(insertPos, num);
+  if (undo.isRecording && num != 0) {
+    UndoLogEntry entry{UndoLogEntry::Kind::InsertVars};
+    entry.varKind = kind;
+    entry.pos = pos;
+    entry.num = num;
+    undo.entries.push_back(std::move(entry));
+  }
   return insertPos;
 }
 
@@ -271,17 +427,106 @@ unsigned IntegerRelation::appendVar(VarKind kind, unsigned num) {
 }
 
 void IntegerRelation::addEquality(ArrayRef<MPInt> eq) {
+  invalidateLocalReprs();
   assert(eq.size() == getNumCols());
+  if (constraintIndex && !uniqueConstraint(eq, /*isEq=*/true))
+    return;
   unsigned row = equalities.appendExtraRow();
   for (unsigned i = 0, e = eq.size(); i < e; ++i)
     equalities(row, i) = eq[i];
+  if (undo.isRecording)
+    undo.entries.push_back({UndoLogEntry::Kind::AppendEquality});
 }
 
 void IntegerRelation::addInequality(ArrayRef<MPInt> inEq) {
+  invalidateLocalReprs();
   assert(inEq.size() == getNumCols());
+  if (constraintIndex && !uniqueConstraint(inEq, /*isEq=*/false))
+    return;
   unsigned row = inequalities.appendExtraRow();
   for (unsigned i = 0, e = inEq.size(); i < e; ++i)
     inequalities(row, i) = inEq[i];
+  if (undo.isRecording)
+    undo.entries.push_back({UndoLogEntry::Kind::AppendInequality});
+}
+
+void IntegerRelation::setConstraintUniquing(bool enable) {
+  if (!enable) {
+    constraintIndex.reset();
+    return;
+  }
+  if (!constraintIndex)
+    rebuildConstraintIndex();
+}
+
+void IntegerRelation::rebuildConstraintIndex() {
+  constraintIndex.emplace();
+  constraintIndex->numCols = getNumCols();
+  SmallVector<MPInt, 8> normalized;
+  for (unsigned r = 0, e = getNumEqualities(); r < e; ++r)
+    if (normalizeConstraint(getEquality(r), /*isEq=*/true, normalized))
+      constraintIndex->equalities.emplace(hashRange(normalized), r);
+  for (unsigned r = 0, e = getNumInequalities(); r < e; ++r)
+    if (normalizeConstraint(getInequality(r), /*isEq=*/false, normalized))
+      constraintIndex->inequalities.emplace(
+          hashRange(ArrayRef<MPInt>(normalized).drop_back()), r);
+}
+
+bool IntegerRelation::uniqueConstraint(ArrayRef<MPInt> row, bool isEq) {
+  assert(constraintIndex && "constraint uniquing not enabled!");
+  if (constraintIndex->isStale || constraintIndex->numCols != getNumCols())
+    rebuildConstraintIndex();
+
+  SmallVector<MPInt, 8> normalized;
+  if (!normalizeConstraint(row, isEq, normalized)) {
+    // Drop the constraint if it is trivially true. Otherwise, the relation is
+    // empty; keep the constraint, but there is no need to index it.
+    return isEq ? row.back() != 0 : row.back() < 0;
+  }
+
+  // The constant term of an inequality is not part of its key.
+  ArrayRef<MPInt> key = normalized;
+  if (!isEq)
+    key = key.drop_back();
+  size_t hash = hashRange(key);
+  Matrix &mat = isEq ? equalities : inequalities;
+  std::unordered_multimap<size_t, unsigned> &map =
+      isEq ? constraintIndex->equalities : constraintIndex->inequalities;
+
+  SmallVector<MPInt, 8> existing;
+  auto range = map.equal_range(hash);
+  for (auto it = range.first; it != range.second;) {
+    unsigned r = it->second;
+    bool isValid = r < mat.getNumRows() &&
+                   normalizeConstraint(mat.getRow(r), isEq, existing);
+    ArrayRef<MPInt> existingKey = existing;
+    if (isValid && !isEq)
+      existingKey = existingKey.drop_back();
+    if (!isValid || size_t(hashRange(existingKey)) != hash) {
+      // The row has been moved or modified since it was indexed.
+      it = map.erase(it);
+      continue;
+    }
+    if (existingKey != key) {
+      // A hash collision.
+      ++it;
+      continue;
+    }
+    // For inequalities, keep the one with the smallest normalized constant.
+    if (!isEq && normalized.back() < existing.back()) {
+      if (undo.isRecording) {
+        undo.coeffs.append(mat.getRow(r).begin(), mat.getRow(r).end());
+        UndoLogEntry entry{UndoLogEntry::Kind::ReplaceInequality};
+        entry.pos = r;
+        undo.entries.push_back(std::move(entry));
+      }
+      mat.setRow(r, row);
+    }
+    return false;
+  }
+
+  map.emplace(hash, mat.getNumRows());
+  return true;
 }
 
 void IntegerRelation::removeVar(VarKind kind, unsigned pos) {
@@ -292,6 +537,8 @@ void IntegerRelation::removeVar(unsigned pos) { removeVarRange(pos, pos + 1); }
 
 void IntegerRelation::removeVarRange(VarKind kind, unsigned varStart,
                                      unsigned varLimit) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   assert(varLimit <= getNumVarKind(kind));
 
   if (varStart >= varLimit)
@@ -299,6 +546,18 @@ void IntegerRelation::removeVarRange(VarKind kind, unsigned varStart,
 
   // Remove eliminated variables from the constraints.
   unsigned offset = getVarKindOffset(kind);
+  if (undo.isRecording) {
+    for (const Matrix *mat : {&equalities, &inequalities})
+      for (unsigned r = 0, e = mat->getNumRows(); r < e; ++r)
+        undo.coeffs.append(mat->getRow(r).begin() + offset + varStart,
+                          mat->getRow(r).begin() + offset + varLimit);
+    undo.spaces.push_back(space);
+    UndoLogEntry entry{UndoLogEntry::Kind::RemoveVars};
+    entry.varKind = kind;
+    entry.pos = varStart;
+    entry.num = varLimit - varStart;
+    undo.entries.push_back(std::move(entry));
+  }
   equalities.removeColumns(offset + varStart, varLimit - varStart);
   inequalities.removeColumns(offset + varStart, varLimit - varStart);
 
@@ -345,26 +604,40 @@ void IntegerRelation::removeVarRange(unsigned varStart, unsigned varLimit) {
 }
 
 void IntegerRelation::removeEquality(unsigned pos) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
+  recordRemovedRows(/*isEq=*/true, pos, pos + 1);
   equalities.removeRow(pos);
 }
 
 void IntegerRelation::removeInequality(unsigned pos) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
+  recordRemovedRows(/*isEq=*/false, pos, pos + 1);
   inequalities.removeRow(pos);
 }
 
 void IntegerRelation::removeEqualityRange(unsigned start, unsigned end) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   if (start >= end)
     return;
+  recordRemovedRows(/*isEq=*/true, start, end);
   equalities.removeRows(start, end - start);
 }
 
 void IntegerRelation::removeInequalityRange(unsigned start, unsigned end) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   if (start >= end)
     return;
+  recordRemovedRows(/*isEq=*/false, start, end);
   inequalities.removeRows(start, end - start);
 }
 
 void IntegerRelation::swapVar(unsigned posA, unsigned posB) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   assert(posA < getNumVars() && "invalid position A");
   assert(posB < getNumVars() && "invalid position B");
 
@@ -373,9 +646,19 @@ void IntegerRelation::swapVar(unsigned posA, unsigned posB) {
 
   inequalities.swapColumns(posA, posB);
   equalities.swapColumns(posA, posB);
+  if (undo.isRecording) {
+    UndoLogEntry entry{UndoLogEntry::Kind::SwapVars};
+    entry.pos = posA;
+    entry.otherPos = posB;
+    undo.entries.push_back(std::move(entry));
+  }
 }
 
 void IntegerRelation::clearConstraints() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
+  recordRemovedRows(/*isEq=*/true, 0, getNumEqualities());
+  recordRemovedRows(/*isEq=*/false, 0, getNumInequalities());
   equalities.resizeVertically(0);
   inequalities.resizeVertically(0);
 }
@@ -407,14 +690,15 @@ void IntegerRelation::getLowerAndUpperBoundIndices(
   // Gather all lower bounds and upper bounds of the variable. Since the
   // canonical form c_1*x_1 + c_2*x_2 + ... + c_0 >= 0, a constraint is a lower
   // bound for x_i if c_i >= 1, and an upper bound if c_i <= -1.
+  StridedArrayRef ineqCoeffs = getInequalityColumn(pos);
   for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
     // The bounds are to be independent of [offset, offset + num) columns.
     if (containsConstraintDependentOnRange(r, /*isEq=*/false))
       continue;
-    if (atIneq(r, pos) >= 1) {
+    if (ineqCoeffs[r] >= 1) {
       // Lower bound.
       lbIndices->push_back(r);
-    } else if (atIneq(r, pos) <= -1) {
+    } else if (ineqCoeffs[r] <= -1) {
       // Upper bound.
       ubIndices->push_back(r);
     }
@@ -425,8 +709,9 @@ void IntegerRelation::getLowerAndUpperBoundIndices(
   if (!eqIndices)
     return;
 
+  StridedArrayRef eqCoeffs = getEqualityColumn(pos);
   for (unsigned r = 0, e = getNumEqualities(); r < e; r++) {
-    if (atEq(r, pos) == 0)
+    if (eqCoeffs[r] == 0)
       continue;
     if (containsConstraintDependentOnRange(r, /*isEq=*/true))
       continue;
@@ -452,14 +737,17 @@ void IntegerRelation::setAndEliminate(unsigned pos, ArrayRef<MPInt> values) {
   // pos, pos + 1, ... pos + values.size() - 1.
   unsigned constantColPos = getNumCols() - 1;
   for (unsigned i = 0, numVals = values.size(); i < numVals; ++i)
-    inequalities.addToColumn(i + pos, constantColPos, values[i]);
-  for (unsigned i = 0, numVals = values.size(); i < numVals; ++i)
-    equalities.addToColumn(i + pos, constantColPos, values[i]);
+    addToColumn(i + pos, constantColPos, values[i]);
   removeVarRange(pos, pos + values.size());
 }
 
 void IntegerRelation::clearAndCopyFrom(const IntegerRelation &other) {
+  recordRewriteConstraints();
+  bool wasUniquing = isConstraintUniquingEnabled();
   *this = other;
+  // Keep uniquing the constraints of the new contents.
+  if (wasUniquing && !constraintIndex)
+    rebuildConstraintIndex();
 }
 
 // Searches for a constraint with a non-zero coefficient at `colIdx` in
@@ -481,6 +769,8 @@ bool IntegerRelation::findConstraintWithNonZeroAt(unsigned colIdx, bool isEq,
 }
 
 void IntegerRelation::normalizeConstraintsByGCD() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   for (unsigned i = 0, e = getNumEqualities(); i < e; ++i)
     equalities.normalizeRow(i);
   for (unsigned i = 0, e = getNumInequalities(); i < e; ++i)
@@ -564,10 +854,10 @@ static unsigned getBestVarToEliminate(const IntegerRelation &cst,
   auto getProductOfNumLowerUpperBounds = [&](unsigned pos) {
     unsigned numLb = 0;
     unsigned numUb = 0;
-    for (unsigned r = 0, e = cst.getNumInequalities(); r < e; r++) {
-      if (cst.atIneq(r, pos) > 0) {
+    for (const MPInt &coeff : cst.getInequalityColumn(pos)) {
+      if (coeff > 0) {
         ++numLb;
-      } else if (cst.atIneq(r, pos) < 0) {
+      } else if (coeff < 0) {
         ++numUb;
       }
     }
@@ -591,8 +881,9 @@ static unsigned getBestVarToEliminate(const IntegerRelation &cst,
 // invalid constraints. Returns 'true' if the constraint system is found to be
 // empty; false otherwise.
 bool IntegerRelation::isEmpty() const {
-  if (isEmptyByGCDTest() || hasInvalidConstraint())
-    return true;
+  EmptinessPrefilterResult prefilter = runEmptinessPrefilter();
+  if (prefilter.isEmpty)
+    return *prefilter.isEmpty;
 
   IntegerRelation tmpCst(*this);
 
@@ -666,6 +957,169 @@ bool IntegerRelation::isEmptyByGCDTest() const {
   return false;
 }
 
+/// The number of rounds of bound propagation run by runEmptinessPrefilter.
+static constexpr unsigned kNumPropagationRounds = 2;
+
+/// Tighten the bounds `lb` and `ub` on the variables using the constraint
+/// `row` >= 0, which is an inequality over all the variables followed by the
+/// constant term. Returns false if the constraint is found to be
+/// unsatisfiable within the bounds, i.e., if some range becomes empty.
+static bool propagateBounds(ArrayRef<MPInt> row,
+                            MutableArrayRef<std::optional<MPInt>> lb,
+                            MutableArrayRef<std::optional<MPInt>> ub) {
+  unsigned numVars = lb.size();
+  // The maximum of the sum of the bounded terms of the row over the box, and
+  // the number of terms whose maximum is unbounded, together with the position
+  // of the last one.
+  MPInt maxSum(0);
+  unsigned numUnbounded = 0, unboundedPos = 0;
+  auto getMaxTerm = [&](unsigned i) -> std::optional<MPInt> {
+    const std::optional<MPInt> &bound = row[i] > 0 ? ub[i] : lb[i];
+    if (!bound)
+      return {};
+    return row[i] * *bound;
+  };
+  for (unsigned i = 0; i < numVars; ++i) {
+    if (row[i] == 0)
+      continue;
+    if (std::optional<MPInt> term = getMaxTerm(i)) {
+      maxSum += *term;
+    } else {
+      ++numUnbounded;
+      unboundedPos = i;
+    }
+  }
+  const MPInt &constTerm = row.back();
+  if (numUnbounded == 0 && maxSum + constTerm < 0)
+    return false;
+  if (numUnbounded > 1)
+    return true;
+
+  // For every variable x_j, a_j*x_j >= -c - (max of the other terms).
+  for (unsigned j = 0; j < numVars; ++j) {
+    if (row[j] == 0 || (numUnbounded == 1 && j != unboundedPos))
+      continue;
+    MPInt rest = maxSum;
+    if (numUnbounded == 0)
+      rest -= *getMaxTerm(j);
+    if (row[j] > 0) {
+      MPInt bound = ceilDiv(-constTerm - rest, row[j]);
+      if (!lb[j] || *lb[j] < bound)
+        lb[j] = bound;
+    } else {
+      MPInt bound = floorDiv(constTerm + rest, -row[j]);
+      if (!ub[j] || *ub[j] > bound)
+        ub[j] = bound;
+    }
+    if (lb[j] && ub[j] && *lb[j] > *ub[j])
+      return false;
+  }
+  return true;
+}
+
+IntegerRelation::EmptinessPrefilterResult
+IntegerRelation::runEmptinessPrefilter() const {
+  EmptinessPrefilterResult result;
+  auto decide = [&](EmptinessStage stage, bool isEmpty) {
+    result.stage = stage;
+    result.isEmpty = isEmpty;
+    return result;
+  };
+
+  // Tiny systems are decided by a Simplex with a fixed-size tableau, without
+  // the allocations of the stages below.
+  if (std::optional<bool> isEmpty =
+          isIntegerEmptyBySmallSimplex(*this, result.sample))
+    return decide(EmptinessStage::SmallSimplex, *isEmpty);
+
+  if (hasInvalidConstraint())
+    return decide(EmptinessStage::InvalidConstraint, true);
+  if (isEmptyByGCDTest())
+    return decide(EmptinessStage::GCDTest, true);
+
+  // Look for a pair of inequalities a.x + c1 >= 0 and -a.x + c2 >= 0, after
+  // normalization, with c1 + c2 < 0. The inequalities are indexed by the hash
+  // of their normalized variable coefficients.
+  unsigned numVars = getNumVars();
+  SmallVector<SmallVector<MPInt, 8>, 8> normalized(getNumInequalities());
+  std::unordered_multimap<size_t, unsigned> ineqIndex;
+  SmallVector<MPInt, 8> negated;
+  for (unsigned r = 0, e = getNumInequalities(); r < e; ++r) {
+    if (!normalizeConstraint(getInequality(r), /*isEq=*/false, normalized[r]))
+      continue;
+    ArrayRef<MPInt> coeffs = ArrayRef<MPInt>(normalized[r]).drop_back();
+    negated = getNegatedCoeffs(coeffs);
+    auto range = ineqIndex.equal_range(hashRange(negated));
+    for (auto it = range.first; it != range.second; ++it) {
+      ArrayRef<MPInt> other = normalized[it->second];
+      if (other.drop_back() == ArrayRef<MPInt>(negated) &&
+          other.back() + normalized[r].back() < 0)
+        return decide(EmptinessStage::OpposingInequalities, true);
+    }
+    ineqIndex.emplace(hashRange(coeffs), r);
+  }
+
+  // Propagate constant bounds on the variables, starting from the constraints
+  // on single variables. Equalities are treated as pairs of inequalities.
+  SmallVector<std::optional<MPInt>, 8> lb(numVars), ub(numVars);
+  SmallVector<SmallVector<MPInt, 8>, 8> rows;
+  rows.reserve(getNumInequalities() + 2 * getNumEqualities());
+  for (unsigned r = 0, e = getNumInequalities(); r < e; ++r)
+    rows.emplace_back(getInequality(r).begin(), getInequality(r).end());
+  for (unsigned r = 0, e = getNumEqualities(); r < e; ++r) {
+    rows.emplace_back(getEquality(r).begin(), getEquality(r).end());
+    rows.push_back(getNegatedCoeffs(getEquality(r)));
+  }
+  // Constraints on at most one variable are exactly captured by the bounds
+  // after one pass; only the others need to be propagated further.
+  SmallVector<unsigned, 8> multiVarRows;
+  for (unsigned r = 0, e = rows.size(); r < e; ++r) {
+    if (!propagateBounds(rows[r], lb, ub))
+      return decide(EmptinessStage::ConstantBounds, true);
+    if (llvm::count_if(ArrayRef<MPInt>(rows[r]).drop_back(),
+                       [](const MPInt &c) { return c != 0; }) > 1)
+      multiVarRows.push_back(r);
+  }
+  for (unsigned round = 0; round < kNumPropagationRounds; ++round)
+    for (unsigned r : multiVarRows)
+      if (!propagateBounds(rows[r], lb, ub))
+        return decide(EmptinessStage::ConstantBounds, true);
+
+  // If the bounds enclose few points, check all of them.
+  bool isSmallBox = true;
+  MPInt numPoints(1);
+  for (unsigned i = 0; i < numVars && isSmallBox; ++i) {
+    if (!lb[i] || !ub[i]) {
+      isSmallBox = false;
+      break;
+    }
+    numPoints *= *ub[i] - *lb[i] + 1;
+    isSmallBox = numPoints <= kMaxPrefilterPoints;
+  }
+  if (isSmallBox) {
+    SmallVector<MPInt, 8> point(numVars);
+    for (unsigned i = 0; i < numVars; ++i)
+      point[i] = *lb[i];
+    while (true) {
+      if (containsPoint(point)) {
+        result.sample = point;
+        return decide(EmptinessStage::SmallSystem, false);
+      }
+      // Advance to the next point in the box, in lexicographic order.
+      unsigned i = numVars;
+      while (i > 0 && point[i - 1] == *ub[i - 1]) {
+        point[i - 1] = *lb[i - 1];
+        --i;
+      }
+      if (i == 0)
+        break;
+      ++point[i - 1];
+    }
+    return decide(EmptinessStage::SmallSystem, true);
+  }
+  return result;
+}
+
 // Returns a matrix where each row is a vector along which the polytope is
 // bounded. The span of the returned vectors is guaranteed to contain all
 // such vectors. The returned vectors are NOT guaranteed to be linearly
@@ -763,9 +1217,30 @@ bool IntegerRelation::isIntegerEmpty() const { return !findIntegerSample(); }
 /// returned sample T*v is a sample in S.
 std::optional<SmallVector<MPInt, 8>>
 IntegerRelation::findIntegerSample() const {
-  // First, try the GCD test heuristic.
-  if (isEmptyByGCDTest())
-    return {};
+  if (!detail::isQueryCacheEnabled())
+    return computeIntegerSample();
+
+  detail::QueryKey key(detail::QueryKind::FindIntegerSample);
+  key.append(*this);
+  if (std::optional<detail::QueryResult> cached = detail::lookupQuery(key))
+    return std::move(cached->sample);
+  detail::QueryResult result;
+  result.sample = computeIntegerSample();
+  std::optional<SmallVector<MPInt, 8>> sample = result.sample;
+  detail::insertQuery(std::move(key), std::move(result));
+  return sample;
+}
+
+std::optional<SmallVector<MPInt, 8>>
+IntegerRelation::computeIntegerSample() const {
+  FP_STAT_TIME(IntegerSample);
+  // First, try the cheap checks that do not need a Simplex.
+  EmptinessPrefilterResult prefilter = runEmptinessPrefilter();
+  if (prefilter.isEmpty) {
+    if (*prefilter.isEmpty)
+      return {};
+    return std::move(prefilter.sample);
+  }
 
   Simplex simplex(*this);
   if (simplex.isEmpty())
@@ -911,14 +1386,15 @@ IntegerRelation::containsPointNoLocal(ArrayRef<MPInt> point) const {
   return copy.findIntegerSample();
 }
 
-DivisionRepr
-IntegerRelation::getLocalReprs(std::vector<MaybeLocalRepr> *repr) const {
+IntegerRelation::LocalReprs IntegerRelation::computeLocalReprs() const {
   SmallVector<bool, 8> foundRepr(getNumVars(), false);
   for (unsigned i = 0, e = getNumDimAndSymbolVars(); i < e; ++i)
     foundRepr[i] = true;
 
   unsigned localOffset = getVarKindOffset(VarKind::Local);
-  DivisionRepr divs(getNumVars(), getNumLocalVars());
+  LocalReprs result{DivisionRepr(getNumVars(), getNumLocalVars()),
+                    std::vector<MaybeLocalRepr>(getNumLocalVars())};
+  DivisionRepr &divs = result.divs;
   bool changed;
   do {
     // Each time changed is true, at end of this iteration, one or more local
@@ -936,14 +1412,30 @@ IntegerRelation::getLocalReprs(std::vector<MaybeLocalRepr> *repr) const {
           continue;
         }
         foundRepr[localOffset + i] = true;
-        if (repr)
-          (*repr)[i] = res;
+        result.reprs[i] = res;
         changed = true;
       }
     }
   } while (changed);
 
-  return divs;
+  return result;
+}
+
+DivisionRepr
+IntegerRelation::getLocalReprs(std::vector<MaybeLocalRepr> *repr) const {
+  std::shared_ptr<const LocalReprs> reprs = localReprCache.load();
+  // Another thread may compute the same representations concurrently; only
+  // the first one to finish is published.
+  if (!reprs)
+    reprs = localReprCache.publish(
+        std::make_shared<LocalReprs>(computeLocalReprs()));
+
+  if (repr) {
+    for (unsigned i = 0, e = getNumLocalVars(); i < e; ++i)
+      if (reprs->reprs[i])
+        (*repr)[i] = reprs->reprs[i];
+  }
+  return reprs->divs;
 }
 
 /// Tightens inequalities given that we are dealing with integer spaces. This is
@@ -955,6 +1447,8 @@ IntegerRelation::getLocalReprs(std::vector<MaybeLocalRepr> *repr) const {
 // 64*i >= 100, j = 64*i; without a tightening, elimination of i would yield
 // j >= 100 instead of the tighter (exact) j >= 128.
 void IntegerRelation::gcdTightenInequalities() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   unsigned numCols = getNumCols();
   for (unsigned i = 0, e = getNumInequalities(); i < e; ++i) {
     // Normalize the constraint and tighten the constant term by the GCD.
@@ -968,6 +1462,8 @@ void IntegerRelation::gcdTightenInequalities() {
 // Returns the number of variables eliminated.
 unsigned IntegerRelation::gaussianEliminateVars(unsigned posStart,
                                                 unsigned posLimit) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   // Return if variable positions to eliminate are out of range.
   assert(posLimit <= getNumVars());
   assert(hasConsistentState());
@@ -1014,28 +1510,114 @@ unsigned IntegerRelation::gaussianEliminateVars(unsigned posStart,
   return posLimit - posStart;
 }
 
+/// Mark in `redun` the inequalities of `rel` that are implied by a single
+/// other inequality: those with no variable and a non-negative constant term,
+/// and those whose normalized form has the same variable coefficients as that
+/// of another inequality and a constant term that is not smaller. Of several
+/// equal normalized inequalities, the first is kept. The inequalities are
+/// indexed by the hash of their normalized variable coefficients, so this
+/// takes linear time.
+static void markDominatedInequalities(const IntegerRelation &rel,
+                                      MutableArrayRef<bool> redun) {
+  SmallVector<SmallVector<MPInt, 8>, 8> normalized(rel.getNumInequalities());
+  std::unordered_multimap<size_t, unsigned> ineqIndex;
+  for (unsigned r = 0, e = rel.getNumInequalities(); r < e; ++r) {
+    if (redun[r])
+      continue;
+    if (!normalizeConstraint(rel.getInequality(r), /*isEq=*/false,
+                             normalized[r])) {
+      redun[r] = rel.atIneq(r, rel.getNumCols() - 1) >= 0;
+      continue;
+    }
+    ArrayRef<MPInt> coeffs = ArrayRef<MPInt>(normalized[r]).drop_back();
+    size_t hash = hashRange(coeffs);
+    auto range = ineqIndex.equal_range(hash);
+    auto kept = std::find_if(range.first, range.second, [&](const auto &entry) {
+      return ArrayRef<MPInt>(normalized[entry.second]).drop_back() == coeffs;
+    });
+    if (kept == range.second) {
+      ineqIndex.emplace(hash, r);
+      continue;
+    }
+    if (normalized[r].back() >= normalized[kept->second].back()) {
+      redun[r] = true;
+      continue;
+    }
+    redun[kept->second] = true;
+    kept->second = r;
+  }
+}
+
+/// The minimum number of inequalities for removeRedundantInequalities to
+/// screen them in parallel.
+static constexpr unsigned kMinParallelRedundancyIneqs = 32;
+
 // A more complex check to eliminate redundant inequalities. Uses FourierMotzkin
 // to check if a constraint is redundant.
 void IntegerRelation::removeRedundantInequalities() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   SmallVector<bool, 32> redun(getNumInequalities(), false);
+  // First drop the inequalities implied by a single other one, which needs no
+  // emptiness check.
+  markDominatedInequalities(*this, redun);
+  for (unsigned r = 0, e = getNumInequalities(); r < e; ++r)
+    if (redun[r])
+      inequalities.fillRow(r, /*value=*/0);
+
+  // With several threads, first run in parallel the emptiness check of each
+  // complement against all the other constraints. Until the serial pass below
+  // removes an inequality, it checks exactly these systems, so it reuses the
+  // answers as they are. After that, it only reuses the complements that
+  // contain an integer point, since those are not redundant given any subset
+  // of the other constraints. This makes the result independent of the number
+  // of threads.
+  enum class Screen : uint8_t { None, Empty, NonEmpty, HasPoint };
+  SmallVector<Screen, 32> screen(getNumInequalities(), Screen::None);
+  if (getMaxNumThreads() > 1 &&
+      getNumInequalities() >= kMinParallelRedundancyIneqs) {
+    parallelFor(0, getNumInequalities(), [&](unsigned r) {
+      if (redun[r])
+        return;
+      IntegerRelation complement(*this);
+      complement.inequalities.negateRow(r);
+      --complement.atIneq(r, complement.getNumCols() - 1);
+      if (complement.isEmpty())
+        screen[r] = Screen::Empty;
+      else if (complement.findIntegerSample())
+        screen[r] = Screen::HasPoint;
+      else
+        screen[r] = Screen::NonEmpty;
+    });
+  }
+
   // To check if an inequality is redundant, we replace the inequality by its
   // complement (for eg., i - 1 >= 0 by i <= 0), and check if the resulting
   // system is empty. If it is, the inequality is redundant.
   IntegerRelation tmpCst(*this);
+  bool removedAny = false;
   for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
-    // Change the inequality to its complement.
-    tmpCst.inequalities.negateRow(r);
-    --tmpCst.atIneq(r, tmpCst.getNumCols() - 1);
-    if (tmpCst.isEmpty()) {
-      redun[r] = true;
-      // Zero fill the redundant inequality.
-      inequalities.fillRow(r, /*value=*/0);
-      tmpCst.inequalities.fillRow(r, /*value=*/0);
+    if (redun[r] || screen[r] == Screen::HasPoint)
+      continue;
+    bool isRedundant;
+    if (screen[r] != Screen::None && !removedAny) {
+      isRedundant = screen[r] == Screen::Empty;
     } else {
+      // Change the inequality to its complement.
+      tmpCst.inequalities.negateRow(r);
+      --tmpCst.atIneq(r, tmpCst.getNumCols() - 1);
+      isRedundant = tmpCst.isEmpty();
       // Reverse the change (to avoid recreating tmpCst each time).
       ++tmpCst.atIneq(r, tmpCst.getNumCols() - 1);
       tmpCst.inequalities.negateRow(r);
     }
+    if (isRedundant) {
+      redun[r] = true;
+      removedAny = true;
+      // Zero fill the redundant inequality.
+      inequalities.fillRow(r, /*value=*/0);
+      tmpCst.inequalities.fillRow(r, /*value=*/0);
+    }
   }
 
   unsigned pos = 0;
@@ -1049,14 +1631,29 @@ void IntegerRelation::removeRedundantInequalities() {
 // A more complex check to eliminate redundant inequalities and equalities. Uses
 // Simplex to check if a constraint is redundant.
 void IntegerRelation::removeRedundantConstraints() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   // First, we run gcdTightenInequalities. This allows us to catch some
   // constraints which are not redundant when considering rational solutions
   // but are redundant in terms of integer solutions.
   gcdTightenInequalities();
+
+  // Drop the inequalities implied by a single other one before building the
+  // Simplex, so that they neither take part in its pivots nor need a
+  // redundancy check.
+  SmallVector<bool, 32> dominated(getNumInequalities(), false);
+  markDominatedInequalities(*this, dominated);
+  unsigned pos = 0;
+  for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
+    if (!dominated[r])
+      inequalities.copyRow(r, pos++);
+  }
+  inequalities.resizeVertically(pos);
+
   Simplex simplex(*this);
   simplex.detectRedundant();
 
-  unsigned pos = 0;
+  pos = 0;
   unsigned numIneqs = getNumInequalities();
   // Scan to get rid of all inequalities marked redundant, in-place. In Simplex,
   // the first constraints added are the inequalities.
@@ -1135,6 +1732,151 @@ std::optional<MPInt> IntegerRelation::computeVolume() const {
   return count;
 }
 
+namespace {
+/// Counts the integer points of a relation whose vars take finitely many
+/// integer values, by fixing the vars one at a time, in order, to each integer
+/// value within their bounds given the values of the previous vars.
+///
+/// If the locals are determined by the non-local vars, e.g., because they are
+/// divisions, the points are in one-to-one correspondence with those of the
+/// projection, so all the vars are enumerated and the values of the last one
+/// are counted in closed form. Otherwise, only the non-local vars are
+/// enumerated, and each of their points is checked for an integer assignment
+/// to the locals.
+class IntegerPointCounter {
+public:
+  IntegerPointCounter(const IntegerRelation &rel, bool localsAreDetermined)
+      : rel(rel), simplex(rel),
+        numEnumerated(localsAreDetermined ? rel.getNumVars()
+                                          : rel.getNumDimAndSymbolVars()),
+        countLastInClosedForm(localsAreDetermined ||
+                              rel.getNumLocalVars() == 0),
+        point(numEnumerated), row(rel.getNumCols(), MPInt(0)) {}
+
+  MPInt count() {
+    if (simplex.isEmpty())
+      return MPInt(0);
+    // With no vars to enumerate, the single point of the projection is in it
+    // iff the locals have an integer assignment.
+    if (numEnumerated == 0)
+      return MPInt(countLastInClosedForm ||
+                   rel.containsPointNoLocal(ArrayRef<MPInt>()).has_value());
+    countFrom(0);
+    return total;
+  }
+
+private:
+  void countFrom(unsigned var) {
+    row[var] = 1;
+    auto [min, max] = simplex.computeIntegerBounds(row);
+    row[var] = 0;
+    // The constraints fixing the previous vars may leave no rational points.
+    if (min.isEmpty())
+      return;
+    assert(min.isBounded() && max.isBounded() &&
+           "Var should only take finitely many values!");
+    if (*min > *max)
+      return;
+
+    bool isLast = var + 1 == numEnumerated;
+    if (isLast && countLastInClosedForm) {
+      total += *max - *min + 1;
+      return;
+    }
+
+    for (MPInt value = *min; value <= *max; ++value) {
+      point[var] = value;
+      if (isLast) {
+        if (rel.containsPointNoLocal(point))
+          ++total;
+        continue;
+      }
+      unsigned snapshot = simplex.getSnapshot();
+      row[var] = 1;
+      row.back() = -value;
+      simplex.addEquality(row);
+      row[var] = 0;
+      row.back() = 0;
+      countFrom(var + 1);
+      simplex.rollback(snapshot);
+    }
+  }
+
+  const IntegerRelation &rel;
+  Simplex simplex;
+  unsigned numEnumerated;
+  bool countLastInClosedForm;
+  /// The values of the enumerated vars.
+  SmallVector<MPInt, 8> point;
+  /// Scratch space for the constraint and objective rows.
+  SmallVector<MPInt, 8> row;
+  MPInt total = MPInt(0);
+};
+} // namespace
+
+std::optional<MPInt> IntegerRelation::countIntegerPoints() const {
+  if (!detail::isQueryCacheEnabled())
+    return computeIntegerPointCount();
+
+  detail::QueryKey key(detail::QueryKind::CountIntegerPoints);
+  key.append(*this);
+  if (std::optional<detail::QueryResult> cached = detail::lookupQuery(key))
+    return std::move(cached->count);
+  detail::QueryResult result;
+  result.count = computeIntegerPointCount();
+  std::optional<MPInt> count = result.count;
+  detail::insertQuery(std::move(key), std::move(result));
+  return count;
+}
+
+std::optional<MPInt> IntegerRelation::computeIntegerPointCount() const {
+  assert(getNumSymbolVars() == 0 && "Symbols are not yet supported!");
+
+  // Every constraint of a hyper-rectangular relation bounds a single var, so
+  // the bounding box computed by computeVolume is exact.
+  if (getNumLocalVars() == 0 &&
+      (getNumVars() == 0 || isHyperRectangular(0, getNumVars())))
+    return computeVolume();
+
+  // The projection is infinite iff some non-local var is unbounded and the
+  // relation has an integer point: then the relation has a rational ray along
+  // which that var changes, and the multiples of the ray that are integer
+  // vectors, added to the point, give infinitely many distinct points of the
+  // projection.
+  Simplex simplex(*this);
+  if (simplex.isEmpty())
+    return MPInt(0);
+  SmallVector<MPInt, 8> dim(getNumCols(), MPInt(0));
+  for (unsigned i = 0, e = getNumDimAndSymbolVars(); i < e; ++i) {
+    dim[i] = 1;
+    bool isBounded = simplex.computeOptimum(Simplex::Direction::Down, dim)
+                         .isBounded() &&
+                     simplex.computeOptimum(Simplex::Direction::Up, dim)
+                         .isBounded();
+    dim[i] = 0;
+    if (!isBounded)
+      return isIntegerEmpty() ? std::optional<MPInt>(0) : std::nullopt;
+  }
+
+  bool localsAreDetermined = getLocalReprs().hasAllReprs();
+  if (getNumLocalVars() != 0 || getNumEqualities() == 0)
+    return IntegerPointCounter(*this, localsAreDetermined).count();
+
+  // Count the points of S*T for a unimodular transform T that brings the
+  // equalities to column echelon form. This maps the integer points of S
+  // one-to-one to those of S*T, where the equalities fix the first vars in
+  // turn, so that only the remaining ones need to be enumerated.
+  Matrix eqCoeffs(getNumEqualities(), getNumVars());
+  for (unsigned r = 0, e = getNumEqualities(); r < e; ++r)
+    for (unsigned c = 0, f = getNumVars(); c < f; ++c)
+      eqCoeffs(r, c) = atEq(r, c);
+  LinearTransform transform =
+      LinearTransform::makeTransformToColumnEchelon(eqCoeffs).second;
+  IntegerRelation transformed = transform.applyTo(*this);
+  return IntegerPointCounter(transformed, /*localsAreDetermined=*/true)
+      .count();
+}
+
 void IntegerRelation::eliminateRedundantLocalVar(unsigned posA, unsigned posB) {
   assert(posA < getNumLocalVars() && "Invalid local var position");
   assert(posB < getNumLocalVars() && "Invalid local var position");
@@ -1142,8 +1884,7 @@ void IntegerRelation::eliminateRedundantLocalVar(unsigned posA, unsigned posB) {
   unsigned localOffset = getVarKindOffset(VarKind::Local);
   posA += localOffset;
   posB += localOffset;
-  inequalities.addToColumn(posB, posA, 1);
-  equalities.addToColumn(posB, posA, 1);
+  addToColumn(posB, posA, MPInt(1));
   removeVar(posB);
 }
 
@@ -1211,6 +1952,8 @@ void IntegerRelation::removeDuplicateDivs() {
 /// each constraint and then removed. The equality used to replace this local
 /// variable is also removed.
 void IntegerRelation::removeRedundantLocalVars() {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   // Normalize the equality constraints to reduce coefficients of local
   // variables to 1 wherever possible.
   for (unsigned i = 0, e = getNumEqualities(); i < e; ++i)
@@ -1281,7 +2024,21 @@ void IntegerRelation::convertVarKind(VarKind srcKind, unsigned varStart,
 
 void IntegerRelation::addBound(BoundType type, unsigned pos,
                                const MPInt &value) {
+  invalidateLocalReprs();
   assert(pos < getNumCols());
+  if (constraintIndex) {
+    SmallVector<MPInt, 8> row(getNumCols(), MPInt(0));
+    if (type == BoundType::EQ) {
+      row[pos] = 1;
+      row.back() = -value;
+      addEquality(row);
+    } else {
+      row[pos] = type == BoundType::LB ? 1 : -1;
+      row.back() = type == BoundType::LB ? -value : value;
+      addInequality(row);
+    }
+    return;
+  }
   if (type == BoundType::EQ) {
     unsigned row = equalities.appendExtraRow();
     equalities(row, pos) = 1;
@@ -1292,17 +2049,33 @@ void IntegerRelation::addBound(BoundType type, unsigned pos,
     inequalities(row, getNumCols() - 1) =
         type == BoundType::LB ? -value : value;
   }
+  if (undo.isRecording)
+    undo.entries.push_back({type == BoundType::EQ
+                           ? UndoLogEntry::Kind::AppendEquality
+                           : UndoLogEntry::Kind::AppendInequality});
 }
 
 void IntegerRelation::addBound(BoundType type, ArrayRef<MPInt> expr,
                                const MPInt &value) {
+  invalidateLocalReprs();
   assert(type != BoundType::EQ && "EQ not implemented");
   assert(expr.size() == getNumCols());
+  if (constraintIndex) {
+    SmallVector<MPInt, 8> row(expr.begin(), expr.end());
+    if (type == BoundType::UB)
+      for (MPInt &c : row)
+        c = -c;
+    row.back() += type == BoundType::LB ? -value : value;
+    addInequality(row);
+    return;
+  }
   unsigned row = inequalities.appendExtraRow();
   for (unsigned i = 0, e = expr.size(); i < e; ++i)
     inequalities(row, i) = type == BoundType::LB ? expr[i] : -expr[i];
   inequalities(inequalities.getNumRows() - 1, getNumCols() - 1) +=
       type == BoundType::LB ? -value : value;
+  if (undo.isRecording)
+    undo.entries.push_back({UndoLogEntry::Kind::AppendInequality});
 }
 
 /// Adds a new local variable as the floordiv of an affine function of other
@@ -1623,6 +2396,12 @@ bool IntegerRelation::isHyperRectangular(unsigned pos, unsigned num) const {
 //  Uses a DenseSet to hash and detect duplicates followed by a linear scan to
 //  remove duplicates in place.
 void IntegerRelation::removeTrivialRedundancy() {
+  removeTrivialRedundancy(nullptr);
+}
+
+void IntegerRelation::removeTrivialRedundancy(FMHistory *history) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   gcdTightenInequalities();
   normalizeConstraintsByGCD();
 
@@ -1631,8 +2410,8 @@ void IntegerRelation::removeTrivialRedundancy() {
   // for a given row.
   SmallDenseMap<ArrayRef<MPInt>, std::pair<unsigned, MPInt>>
       rowsWithoutConstTerm;
-  // To unique rows.
-  SmallDenseSet<ArrayRef<MPInt>, 8> rowSet;
+  // To unique rows. The value stored is the position of the row kept.
+  SmallDenseMap<ArrayRef<MPInt>, unsigned, 8> rowSet;
 
   // Check if constraint is of the form <non-negative-constant> >= 0.
   auto isTriviallyValid = [&](unsigned r) -> bool {
@@ -1648,10 +2427,17 @@ void IntegerRelation::removeTrivialRedundancy() {
   for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
     MPInt *rowStart = &inequalities(r, 0);
     auto row = ArrayRef<MPInt>(rowStart, getNumCols());
-    if (isTriviallyValid(r) || !rowSet.insert(row).second) {
+    if (isTriviallyValid(r)) {
       redunIneq[r] = true;
       continue;
     }
+    const auto &dup = rowSet.insert({row, r});
+    if (!dup.second) {
+      redunIneq[r] = true;
+      if (history)
+        history->merge(dup.first->second, r);
+      continue;
+    }
 
     // Among constraints that only differ in the constant term part, mark
     // everything other than the one with the smallest constant term redundant.
@@ -1667,21 +2453,32 @@ void IntegerRelation::removeTrivialRedundancy() {
       if (val.second > constTerm) {
         // The stored row is redundant. Mark it so, and update with this one.
         redunIneq[val.first] = true;
+        if (history)
+          history->merge(r, val.first);
         val = {r, constTerm};
       } else {
         // The one stored makes this one redundant.
         redunIneq[r] = true;
+        if (history)
+          history->merge(val.first, r);
       }
     }
   }
 
   // Scan to get rid of all rows marked redundant, in-place.
   unsigned pos = 0;
-  for (unsigned r = 0, e = getNumInequalities(); r < e; r++)
-    if (!redunIneq[r])
-      inequalities.copyRow(r, pos++);
+  for (unsigned r = 0, e = getNumInequalities(); r < e; r++) {
+    if (redunIneq[r])
+      continue;
+    inequalities.copyRow(r, pos);
+    if (history)
+      history->moveRow(r, pos);
+    ++pos;
+  }
 
   inequalities.resizeVertically(pos);
+  if (history)
+    history->truncate(pos);
 
   // TODO: consider doing this for equalities as well, but probably not worth
   // the savings.
@@ -1690,6 +2487,91 @@ void IntegerRelation::removeTrivialRedundancy() {
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "fm"
 
+/// The history of the inequalities of an IntegerRelation while several
+/// variables are eliminated from it by Fourier-Motzkin.
+///
+/// For every inequality, we track the set of original inequalities it was
+/// combined from, and the set of original variables appearing in any of them.
+/// After k variables have been eliminated, an inequality combined from more
+/// than k + 1 original inequalities is redundant (Chernikov's rule). More
+/// precisely, it is redundant if it was combined from more than e + 1 original
+/// inequalities, e being the number of variables that appear in those original
+/// inequalities but not in the combined one, as all such variables were either
+/// effectively or implicitly eliminated (Imbert's first acceleration theorem).
+/// Such inequalities can be dropped as soon as they are generated, which keeps
+/// the number of inequalities from growing doubly exponentially.
+///
+/// When removeTrivialRedundancy drops an inequality in favour of one that
+/// implies it, the history of the kept inequality takes the intersection of the
+/// two sets of original inequalities and the union of the two sets of original
+/// variables. Both checks above then remain sound for every way in which either
+/// inequality could have been derived.
+struct IntegerRelation::FMHistory {
+  explicit FMHistory(const IntegerRelation &rel)
+      : numOriginalVars(rel.getNumVars()) {
+    varIds.resize(numOriginalVars);
+    std::iota(varIds.begin(), varIds.end(), 0);
+    reset(rel);
+  }
+
+  /// Start tracking afresh, considering the current inequalities of `rel` to
+  /// be the original ones.
+  void reset(const IntegerRelation &rel) {
+    unsigned numIneqs = rel.getNumInequalities();
+    combinedFrom.assign(numIneqs, llvm::SmallBitVector(numIneqs));
+    originalVars.assign(numIneqs, llvm::SmallBitVector(numOriginalVars));
+    for (unsigned r = 0; r < numIneqs; ++r) {
+      combinedFrom[r].set(r);
+      originalVars[r] = getVarsIn(rel.getInequality(r));
+    }
+    numEliminated = 0;
+  }
+
+  /// Return the set of original variables with a non-zero coefficient in the
+  /// inequality `ineq`, which must have a coefficient for every current
+  /// variable followed by the constant term.
+  llvm::SmallBitVector getVarsIn(ArrayRef<MPInt> ineq) const {
+    assert(ineq.size() == varIds.size() + 1 && "incorrect number of columns!");
+    llvm::SmallBitVector vars(numOriginalVars);
+    for (unsigned i = 0, e = varIds.size(); i < e; ++i)
+      if (ineq[i] != 0)
+        vars.set(varIds[i]);
+    return vars;
+  }
+
+  /// Record that the inequality at `kept` implies the one at `dropped`, which
+  /// is about to be removed.
+  void merge(unsigned kept, unsigned dropped) {
+    combinedFrom[kept] &= combinedFrom[dropped];
+    originalVars[kept] |= originalVars[dropped];
+  }
+
+  void moveRow(unsigned from, unsigned to) {
+    if (from == to)
+      return;
+    combinedFrom[to] = std::move(combinedFrom[from]);
+    originalVars[to] = std::move(originalVars[from]);
+  }
+
+  void truncate(unsigned numIneqs) {
+    combinedFrom.truncate(numIneqs);
+    originalVars.truncate(numIneqs);
+  }
+
+  /// The number of variables when tracking began.
+  unsigned numOriginalVars;
+  /// For each inequality, the original inequalities it was combined from.
+  SmallVector<llvm::SmallBitVector, 8> combinedFrom;
+  /// For each inequality, the original variables appearing in any of the
+  /// original inequalities it was combined from.
+  SmallVector<llvm::SmallBitVector, 8> originalVars;
+  /// The original variable corresponding to each current variable.
+  SmallVector<unsigned, 8> varIds;
+  /// The number of variables eliminated by Fourier-Motzkin since tracking
+  /// (re)started.
+  unsigned numEliminated = 0;
+};
+
 /// Eliminates variable at the specified position using Fourier-Motzkin
 /// variable elimination. This technique is exact for rational spaces but
 /// conservative (in "rare" cases) for integer spaces. The operation corresponds
@@ -1735,6 +2617,18 @@ void IntegerRelation::removeTrivialRedundancy() {
 // which can prove the existence of a solution if there is one.
 void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
                                               bool *isResultIntegerExact) {
+  fourierMotzkinEliminateImpl(pos, darkShadow, isResultIntegerExact,
+                              /*history=*/nullptr);
+}
+
+void IntegerRelation::fourierMotzkinEliminateImpl(unsigned pos,
+                                                  bool darkShadow,
+                                                  bool *isResultIntegerExact,
+                                                  FMHistory *history) {
+  invalidateLocalReprs();
+  FP_STAT_TIME(FourierMotzkin);
+  assert(!(darkShadow && history) &&
+         "redundancy pruning only applies to the rational shadow");
   LLVM_DEBUG(llvm::dbgs() << "FM input (eliminate pos " << pos << "):\n");
   LLVM_DEBUG(dump());
   assert(pos < getNumVars() && "invalid position");
@@ -1747,6 +2641,12 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
       LogicalResult ret = gaussianEliminateVar(pos);
       (void)ret;
       assert(succeeded(ret) && "Gaussian elimination guaranteed to succeed");
+      // The substitution changes every inequality involving the variable, so
+      // start tracking afresh.
+      if (history) {
+        history->varIds.erase(history->varIds.begin() + pos);
+        history->reset(*this);
+      }
       LLVM_DEBUG(llvm::dbgs() << "FM output (through Gaussian elimination):\n");
       LLVM_DEBUG(dump());
       return;
@@ -1761,6 +2661,8 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
     // If it doesn't appear, just remove the column and return.
     // TODO: refactor removeColumns to use it from here.
     removeVar(pos);
+    if (history)
+      history->varIds.erase(history->varIds.begin() + pos);
     LLVM_DEBUG(llvm::dbgs() << "FM output:\n");
     LLVM_DEBUG(dump());
     return;
@@ -1802,6 +2704,11 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
   // This will be used to check if the elimination was integer exact.
   bool allLCMsAreOne = true;
 
+  // The histories of the inequalities of newRel, in order.
+  SmallVector<llvm::SmallBitVector, 8> newCombinedFrom, newOriginalVars;
+  if (history)
+    ++history->numEliminated;
+
   // Let x be the variable we are eliminating.
   // For each lower bound, lb <= c_l*x, and each upper bound c_u*x <= ub, (note
   // that c_l, c_u >= 1) we have:
@@ -1814,6 +2721,14 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
   // integer exact.
   for (auto ubPos : ubIndices) {
     for (auto lbPos : lbIndices) {
+      llvm::SmallBitVector combinedFrom;
+      if (history) {
+        combinedFrom = history->combinedFrom[lbPos];
+        combinedFrom |= history->combinedFrom[ubPos];
+        // Chernikov's rule.
+        if (combinedFrom.count() > history->numEliminated + 1)
+          continue;
+      }
       SmallVector<MPInt, 4> ineq;
       ineq.reserve(newRel.getNumCols());
       MPInt lbCoeff = atIneq(lbPos, pos);
@@ -1838,9 +2753,24 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
         // there is a point here, it proves the existence of a solution.
         ineq[ineq.size() - 1] += lbCoeff * ubCoeff - lbCoeff - ubCoeff + 1;
       }
+      if (history) {
+        llvm::SmallBitVector originalVars = history->originalVars[lbPos];
+        originalVars |= history->originalVars[ubPos];
+        // Imbert's first acceleration theorem. `ineq` has no column for the
+        // variable being eliminated.
+        llvm::SmallBitVector eliminatedVars = originalVars;
+        for (unsigned l = 0, e = ineq.size() - 1; l < e; ++l)
+          if (ineq[l] != 0)
+            eliminatedVars.reset(history->varIds[l < pos ? l : l + 1]);
+        if (combinedFrom.count() > eliminatedVars.count() + 1)
+          continue;
+        newCombinedFrom.push_back(std::move(combinedFrom));
+        newOriginalVars.push_back(std::move(originalVars));
+      }
       // TODO: we need to have a way to add inequalities in-place in
       // IntegerRelation instead of creating and copying over.
       newRel.addInequality(ineq);
+      FP_STAT_INC(NumFMRowsGenerated);
     }
   }
 
@@ -1859,10 +2789,16 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
       ineq.push_back(atIneq(nbPos, l));
     }
     newRel.addInequality(ineq);
+    if (history) {
+      newCombinedFrom.push_back(history->combinedFrom[nbPos]);
+      newOriginalVars.push_back(history->originalVars[nbPos]);
+    }
   }
 
-  assert(newRel.getNumConstraints() ==
-         lbIndices.size() * ubIndices.size() + nbIndices.size());
+  assert((history || newRel.getNumConstraints() ==
+                         lbIndices.size() * ubIndices.size() +
+                             nbIndices.size()) &&
+         "unexpected number of constraints");
 
   // Copy over the equalities.
   for (unsigned r = 0, e = getNumEqualities(); r < e; r++) {
@@ -1880,7 +2816,12 @@ void IntegerRelation::fourierMotzkinEliminate(unsigned pos, bool darkShadow,
   // redundant constraints.
   newRel.gcdTightenInequalities();
   newRel.normalizeConstraintsByGCD();
-  newRel.removeTrivialRedundancy();
+  if (history) {
+    history->combinedFrom = std::move(newCombinedFrom);
+    history->originalVars = std::move(newOriginalVars);
+    history->varIds.erase(history->varIds.begin() + pos);
+  }
+  newRel.removeTrivialRedundancy(history);
   clearAndCopyFrom(newRel);
   LLVM_DEBUG(llvm::dbgs() << "FM output:\n");
   LLVM_DEBUG(dump());
@@ -1897,6 +2838,12 @@ void IntegerRelation::projectOut(unsigned pos, unsigned num) {
   assert((getNumCols() < 2 || pos <= getNumCols() - 2) && "invalid position");
   assert(pos + num < getNumCols() && "invalid range");
 
+  // Elimination rewrites most of the constraints, so the undo log keeps a copy
+  // of them instead of recording the individual edits.
+  bool wasRecording = undo.isRecording;
+  recordRewriteConstraints();
+  undo.isRecording = false;
+
   // Eliminate as many variables as possible using Gaussian elimination.
   unsigned currentPos = pos;
   unsigned numToEliminate = num;
@@ -1910,11 +2857,19 @@ void IntegerRelation::projectOut(unsigned pos, unsigned num) {
     numGaussianEliminated += curNumEliminated;
   }
 
-  // Eliminate the remaining using Fourier-Motzkin.
-  for (unsigned i = 0; i < num - numGaussianEliminated; i++) {
-    unsigned numToEliminate = num - numGaussianEliminated - i;
-    fourierMotzkinEliminate(
-        getBestVarToEliminate(*this, pos, pos + numToEliminate));
+  // Eliminate the remaining using Fourier-Motzkin. When more than one variable
+  // is eliminated this way, combined inequalities that are redundant by
+  // construction are pruned as they are generated.
+  unsigned numFMEliminated = num - numGaussianEliminated;
+  std::optional<FMHistory> history;
+  if (numFMEliminated > 1)
+    history.emplace(*this);
+  for (unsigned i = 0; i < numFMEliminated; i++) {
+    unsigned numToEliminate = numFMEliminated - i;
+    fourierMotzkinEliminateImpl(
+        getBestVarToEliminate(*this, pos, pos + numToEliminate),
+        /*darkShadow=*/false, /*isResultIntegerExact=*/nullptr,
+        history ? &*history : nullptr);
   }
 
   // Fast/trivial simplifications.
@@ -1922,6 +2877,7 @@ void IntegerRelation::projectOut(unsigned pos, unsigned num) {
   // Normalize constraints after tightening since the latter impacts this, but
   // not the other way round.
   normalizeConstraintsByGCD();
+  undo.isRecording = wasRecording;
 }
 
 namespace {
@@ -1974,6 +2930,8 @@ static void getCommonConstraints(const IntegerRelation &a,
 // lower bounds and the max of the upper bounds along each of the dimensions.
 LogicalResult
 IntegerRelation::unionBoundingBox(const IntegerRelation &otherCst) {
+  invalidateLocalReprs();
+  invalidateConstraintIndex();
   assert(space.isEqual(otherCst.getSpace()) && "Spaces should match.");
   assert(getNumLocalVars() == 0 && "local ids not supported yet here");
 
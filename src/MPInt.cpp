@@ -9,6 +9,7 @@
 #include "MPInt.h"
 
 #include <iostream>
+#include <limits>
 
 using namespace presburger;
 
@@ -29,6 +30,38 @@ std::ostream &MPInt::print(std::ostream &os) const {
 
 void MPInt::dump() const { print(std::cerr); }
 
+/// ---------------------------------------------------------------------------
+/// Conversion to and from bytes.
+/// ---------------------------------------------------------------------------
+bool MPInt::getMagnitudeBytes(std::vector<uint8_t> &bytes) const {
+  if (isLarge())
+    return valLarge.getMagnitudeBytes(bytes);
+  // Negating in uint64_t also handles the minimum int64_t value.
+  uint64_t magnitude = valSmall < 0 ? -uint64_t(valSmall) : uint64_t(valSmall);
+  bytes.clear();
+  for (; magnitude != 0; magnitude >>= 8)
+    bytes.push_back(uint8_t(magnitude));
+  return valSmall < 0;
+}
+
+MPInt MPInt::fromMagnitudeBytes(const uint8_t *bytes, size_t numBytes,
+                                bool isNegative) {
+  while (numBytes > 0 && bytes[numBytes - 1] == 0)
+    --numBytes;
+  if (numBytes <= 8) {
+    uint64_t magnitude = 0;
+    for (size_t i = numBytes; i > 0; --i)
+      magnitude = (magnitude << 8) | bytes[i - 1];
+    uint64_t limit = uint64_t(std::numeric_limits<int64_t>::max());
+    if (magnitude <= limit)
+      return MPInt(isNegative ? -int64_t(magnitude) : int64_t(magnitude));
+    if (isNegative && magnitude == limit + 1)
+      return MPInt(std::numeric_limits<int64_t>::min());
+  }
+  return MPInt(detail::SlowMPInt::fromMagnitudeBytes(bytes, numBytes,
+                                                     isNegative));
+}
+
 std::ostream &presburger::operator<<(std::ostream &os, const MPInt &x) {
   x.print(os);
   return os;
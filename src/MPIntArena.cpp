@@ -0,0 +1,226 @@
+//===- MPIntArena.cpp - MLIR MPIntArena Class -----------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "MPIntArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <gmp.h>
+
+using namespace presburger;
+using namespace detail;
+
+namespace {
+/// Every block handed out to GMP is preceded by this header, so that blocks
+/// can be returned to the right place no matter which arena, if any, is active
+/// when GMP frees them. The alignment keeps the limbs that follow it aligned.
+struct alignas(16) BlockHeader {
+  /// The arena the block was carved out of, or nullptr if it was obtained
+  /// directly from malloc.
+  LimbArena *owner;
+  /// The size class of the block; see getSizeClass.
+  size_t sizeClass;
+};
+} // namespace
+
+/// Allocation granularity, in bytes, of the blocks handed out by an arena.
+static constexpr size_t kGranule = 16;
+/// Number of size classes served by an arena. Larger requests go to malloc.
+static constexpr size_t kNumSizeClasses = 64;
+/// Size of the largest block served by an arena, including its header.
+static constexpr size_t kMaxBlockSize =
+    sizeof(BlockHeader) + kNumSizeClasses * kGranule;
+
+/// Return the size class for a request of `size` bytes. Blocks of class `c`
+/// can hold `c * kGranule` bytes.
+static size_t getSizeClass(size_t size) {
+  return std::max<size_t>(1, (size + kGranule - 1) / kGranule);
+}
+
+static void *checkedMalloc(size_t size) {
+  void *result = std::malloc(size);
+  if (!result) {
+    std::fputs("MPIntArena: out of memory\n", stderr);
+    std::abort();
+  }
+  return result;
+}
+
+namespace presburger {
+namespace detail {
+/// The storage behind an MPIntArenaScope.
+///
+/// The arena is reference counted: the scope holds one reference, and every
+/// block that has been handed out and not yet freed holds another. The arena
+/// deletes itself, releasing its chunks, when the count drops to zero.
+class LimbArena {
+public:
+  explicit LimbArena(size_t chunkSize)
+      : chunkSize(std::max(chunkSize, kMaxBlockSize)), refCount(1) {
+    std::fill(std::begin(freeLists), std::end(freeLists), nullptr);
+  }
+  ~LimbArena() {
+    for (void *chunk : chunks)
+      std::free(chunk);
+  }
+
+  /// Return a block of the given size class, reusing a freed block if possible.
+  BlockHeader *allocate(size_t sizeClass) {
+    assert(sizeClass >= 1 && sizeClass <= kNumSizeClasses &&
+           "size class not served by the arena!");
+    refCount.fetch_add(1, std::memory_order_relaxed);
+    BlockHeader *&freeList = freeLists[sizeClass - 1];
+    if (BlockHeader *block = freeList) {
+      // A free block stores the next free block just after its header.
+      std::memcpy(&freeList, block + 1, sizeof(BlockHeader *));
+      return block;
+    }
+
+    size_t blockSize = sizeof(BlockHeader) + sizeClass * kGranule;
+    if (static_cast<size_t>(end - cur) < blockSize) {
+      cur = static_cast<char *>(checkedMalloc(chunkSize));
+      end = cur + chunkSize;
+      chunks.push_back(cur);
+    }
+    BlockHeader *block = reinterpret_cast<BlockHeader *>(cur);
+    cur += blockSize;
+    block->owner = this;
+    block->sizeClass = sizeClass;
+    return block;
+  }
+
+  /// Put `block`, which must have been allocated by this arena, on the free
+  /// list of its size class. This must only be called by the thread owning the
+  /// arena while its scope is alive.
+  void recycle(BlockHeader *block) {
+    assert(block->owner == this && "block not owned by this arena!");
+    BlockHeader *&freeList = freeLists[block->sizeClass - 1];
+    std::memcpy(block + 1, &freeList, sizeof(BlockHeader *));
+    freeList = block;
+  }
+
+  /// Drop one reference, deleting the arena if it was the last one.
+  void release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      delete this;
+  }
+
+  size_t getNumChunks() const { return chunks.size(); }
+
+  size_t getNumReferences() const {
+    return refCount.load(std::memory_order_relaxed);
+  }
+
+private:
+  /// The size of each chunk that blocks are carved out of.
+  size_t chunkSize;
+  /// All the chunks allocated so far.
+  std::vector<void *> chunks;
+  /// The unused part of the most recently allocated chunk.
+  char *cur = nullptr;
+  char *end = nullptr;
+  /// The heads of the free lists for each size class.
+  BlockHeader *freeLists[kNumSizeClasses];
+  /// One reference for the scope plus one for each live block.
+  std::atomic<size_t> refCount;
+};
+} // namespace detail
+} // namespace presburger
+
+/// The arena of the innermost MPIntArenaScope alive on this thread, if any.
+static thread_local LimbArena *currentArena = nullptr;
+
+static std::atomic<bool> allocatorInstalled(false);
+
+static void *allocateLimbs(size_t size) {
+  size_t sizeClass = getSizeClass(size);
+  BlockHeader *block;
+  if (currentArena && sizeClass <= kNumSizeClasses) {
+    block = currentArena->allocate(sizeClass);
+  } else {
+    block =
+        static_cast<BlockHeader *>(checkedMalloc(sizeof(BlockHeader) + size));
+    block->owner = nullptr;
+    block->sizeClass = sizeClass;
+  }
+  return block + 1;
+}
+
+static void freeLimbs(void *ptr, size_t /*size*/) {
+  BlockHeader *block = static_cast<BlockHeader *>(ptr) - 1;
+  LimbArena *owner = block->owner;
+  if (!owner) {
+    std::free(block);
+    return;
+  }
+  // Only the innermost arena of this thread is known to be alive and not
+  // accessed concurrently, so only its blocks can be recycled.
+  if (owner == currentArena)
+    owner->recycle(block);
+  owner->release();
+}
+
+static void *reallocateLimbs(void *ptr, size_t oldSize, size_t newSize) {
+  BlockHeader *block = static_cast<BlockHeader *>(ptr) - 1;
+  // The block is already large enough.
+  if (block->owner && getSizeClass(newSize) <= block->sizeClass)
+    return ptr;
+  // Blocks from malloc can be grown in place when no arena is active.
+  if (!block->owner && !currentArena) {
+    void *newBlock = std::realloc(block, sizeof(BlockHeader) + newSize);
+    if (!newBlock) {
+      std::fputs("MPIntArena: out of memory\n", stderr);
+      std::abort();
+    }
+    block = static_cast<BlockHeader *>(newBlock);
+    block->sizeClass = getSizeClass(newSize);
+    return block + 1;
+  }
+  void *newPtr = allocateLimbs(newSize);
+  std::memcpy(newPtr, ptr, std::min(oldSize, newSize));
+  freeLimbs(ptr, oldSize);
+  return newPtr;
+}
+
+void presburger::installMPIntArenaAllocator() {
+  static std::once_flag flag;
+  std::call_once(flag, [] {
+    mp_set_memory_functions(allocateLimbs, reallocateLimbs, freeLimbs);
+    allocatorInstalled.store(true, std::memory_order_release);
+  });
+}
+
+bool presburger::isMPIntArenaAllocatorInstalled() {
+  return allocatorInstalled.load(std::memory_order_acquire);
+}
+
+MPIntArenaScope::MPIntArenaScope(size_t chunkSize)
+    : arena(new LimbArena(chunkSize)), previous(currentArena) {
+  currentArena = arena;
+}
+
+MPIntArenaScope::~MPIntArenaScope() {
+  assert(currentArena == arena &&
+         "MPIntArenaScopes must be destroyed in reverse order of creation!");
+  currentArena = previous;
+  arena->release();
+}
+
+size_t MPIntArenaScope::getNumChunks() const { return arena->getNumChunks(); }
+
+size_t MPIntArenaScope::getNumLiveBlocks() const {
+  // The scope itself holds one reference.
+  return arena->getNumReferences() - 1;
+}
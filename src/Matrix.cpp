@@ -200,7 +200,7 @@ void Matrix::addToRow(unsigned row, ArrayRef<MPInt> rowVec,
   if (scale == 0)
     return;
   for (unsigned col = 0; col < nColumns; ++col)
-    at(row, col) += scale * rowVec[col];
+    at(row, col).addMul(scale, rowVec[col]);
 }
 
 void Matrix::addToColumn(unsigned sourceColumn, unsigned targetColumn,
@@ -208,7 +208,7 @@ void Matrix::addToColumn(unsigned sourceColumn, unsigned targetColumn,
   if (scale == 0)
     return;
   for (unsigned row = 0, e = getNumRows(); row < e; ++row)
-    at(row, targetColumn) += scale * at(row, sourceColumn);
+    at(row, targetColumn).addMul(scale, at(row, sourceColumn));
 }
 
 void Matrix::negateColumn(unsigned column) {
@@ -265,6 +265,21 @@ static void modEntryColumnOperation(Matrix &m, unsigned row, unsigned sourceCol,
   otherMatrix.addToColumn(sourceCol, targetCol, ratio);
 }
 
+/// Replace columns `colA` and `colB` of `m` by their combinations
+/// colA * t[0][0] + colB * t[1][0] and colA * t[0][1] + colB * t[1][1]
+/// respectively, in rows `startRow` onwards.
+static void applyColumnTransform(Matrix &m, unsigned colA, unsigned colB,
+                                 const MPInt (&t)[2][2], unsigned startRow) {
+  for (unsigned row = startRow, e = m.getNumRows(); row < e; ++row) {
+    MPInt a = m(row, colA);
+    MPInt &b = m(row, colB);
+    m(row, colA) = t[0][0] * a;
+    m(row, colA).addMul(t[1][0], b);
+    b *= t[1][1];
+    b.addMul(t[0][1], a);
+  }
+}
+
 std::pair<Matrix, Matrix> Matrix::computeHermiteNormalForm() const {
   // We start with u as an identity matrix and perform operations on h until h
   // is in hermite normal form. We apply the same sequence of operations on u to
@@ -315,7 +330,11 @@ std::pair<Matrix, Matrix> Matrix::computeHermiteNormalForm() const {
         u.negateColumn(i);
       }
 
-      unsigned targetCol = i, sourceCol = echelonCol;
+      // Index 0 stands for echelonCol and index 1 for i below.
+      unsigned targetCol = 1, sourceCol = 0;
+      MPInt vals[2] = {h(row, echelonCol), h(row, i)};
+      if (vals[1] == 0)
+        continue;
       // At every step, we set h(row, targetCol) %= h(row, sourceCol), and
       // swap the indices sourceCol and targetCol. (not the columns themselves)
       // This modulo is implemented as a subtraction
@@ -327,17 +346,31 @@ std::pair<Matrix, Matrix> Matrix::computeHermiteNormalForm() const {
       // for every row, i.e., the above subtraction is done as a column
       // operation. This does not affect any rows above us since they are
       // guaranteed to be zero at these columns.
-      while (h(row, targetCol) != 0 && h(row, sourceCol) != 0) {
-        modEntryColumnOperation(h, row, sourceCol, targetCol, u);
+      //
+      // The steps only depend on the entries in this row, so we run them on
+      // these entries alone, accumulating the column operations in the 2x2
+      // transform t, and apply t to the whole columns once at the end. The
+      // result is exactly the same as performing each step on the columns,
+      // but the intermediate values, which can be much larger than the final
+      // ones, never appear in the other rows.
+      MPInt t[2][2] = {{MPInt(1), MPInt(0)}, {MPInt(0), MPInt(1)}};
+      while (vals[targetCol] != 0 && vals[sourceCol] != 0) {
+        assert(vals[sourceCol] > 0 && "Source must be positive!");
+        MPInt ratio = -floorDiv(vals[targetCol], vals[sourceCol]);
+        vals[targetCol].addMul(ratio, vals[sourceCol]);
+        t[0][targetCol].addMul(ratio, t[0][sourceCol]);
+        t[1][targetCol].addMul(ratio, t[1][sourceCol]);
         std::swap(targetCol, sourceCol);
       }
 
       // One of (row, echelonCol) and (row, i) is zero and the other is the gcd.
       // Make it so that (row, echelonCol) holds the non-zero value.
-      if (h(row, echelonCol) == 0) {
-        h.swapColumns(i, echelonCol);
-        u.swapColumns(i, echelonCol);
+      if (vals[0] == 0) {
+        std::swap(t[0][0], t[0][1]);
+        std::swap(t[1][0], t[1][1]);
       }
+      applyColumnTransform(h, echelonCol, i, t, row);
+      applyColumnTransform(u, echelonCol, i, t, 0);
     }
 
     // Make all entries before echelonCol non-negative and strictly smaller
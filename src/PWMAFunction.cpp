@@ -8,6 +8,8 @@
 
 #include "PWMAFunction.h"
 #include "Simplex.h"
+#include <limits>
+#include <numeric>
 #include <optional>
 
 using namespace mlir;
@@ -80,6 +82,52 @@ MultiAffineFunction::valueAt(ArrayRef<MPInt> point) const {
   return result;
 }
 
+LogicalResult
+MultiAffineFunction::valueAtBatch(ArrayRef<int64_t> points, unsigned numPoints,
+                                  MutableArrayRef<int64_t> out) const {
+  unsigned numInputs = getNumDomainVars() + getNumSymbolVars();
+  assert(points.size() >= size_t(numInputs) * numPoints &&
+         "too few values for the points");
+  assert(out.size() >= size_t(getNumOutputs()) * numPoints &&
+         "output buffer is too small");
+
+  // The values of all the vars the outputs depend on, i.e., the inputs
+  // followed by the divisions, for all the points.
+  SmallVector<int64_t, 64> values(size_t(numInputs + getNumDivs()) * numPoints);
+  std::copy(points.begin(), points.begin() + size_t(numInputs) * numPoints,
+            values.begin());
+  SmallVector<bool, 64> overflow(numPoints, false);
+  bool fits = divs.divValuesAtBatch(values, numPoints, overflow);
+  SmallVector<int64_t, 8> expr;
+  for (unsigned o = 0, e = getNumOutputs(); fits && o < e; ++o) {
+    fits = getInt64VecIfFits(output.getRow(o), expr);
+    if (fits)
+      evaluateAffineBatch(expr, values, numPoints,
+                          out.slice(size_t(o) * numPoints, numPoints),
+                          overflow);
+  }
+  // If the coefficients themselves are too large, evaluate every point
+  // exactly.
+  if (!fits)
+    std::fill(overflow.begin(), overflow.end(), true);
+
+  SmallVector<MPInt, 8> point(numInputs);
+  for (unsigned p = 0; p < numPoints; ++p) {
+    if (!overflow[p])
+      continue;
+    for (unsigned v = 0; v < numInputs; ++v)
+      point[v] = points[size_t(v) * numPoints + p];
+    SmallVector<MPInt, 8> result = valueAt(point);
+    for (unsigned o = 0, e = getNumOutputs(); o < e; ++o) {
+      if (result[o] < std::numeric_limits<int64_t>::min() ||
+          result[o] > std::numeric_limits<int64_t>::max())
+        return failure();
+      out[size_t(o) * numPoints + p] = int64_t(result[o]);
+    }
+  }
+  return success();
+}
+
 bool MultiAffineFunction::isEqual(const MultiAffineFunction &other) const {
   assert(space.isCompatible(other.space) &&
          "Spaces should be compatible for equality check.");
@@ -460,3 +508,62 @@ PWMAFunction::valueAt(ArrayRef<MPInt> point) const {
       return piece.output.valueAt(point);
   return std::nullopt;
 }
+
+/// Store in `result` the points at positions `indices` of the batch `points`
+/// of `numPoints` points with `numVars` vars each. Both batches are stored
+/// column-major.
+static void gatherPoints(ArrayRef<int64_t> points, unsigned numPoints,
+                         unsigned numVars, ArrayRef<unsigned> indices,
+                         SmallVectorImpl<int64_t> &result) {
+  result.resize(size_t(numVars) * indices.size());
+  for (unsigned v = 0; v < numVars; ++v) {
+    const int64_t *column = points.data() + size_t(v) * numPoints;
+    int64_t *resultColumn = result.data() + size_t(v) * indices.size();
+    for (unsigned k = 0, e = indices.size(); k < e; ++k)
+      resultColumn[k] = column[indices[k]];
+  }
+}
+
+LogicalResult PWMAFunction::valueAtBatch(ArrayRef<int64_t> points,
+                                         unsigned numPoints,
+                                         MutableArrayRef<int64_t> out,
+                                         MutableArrayRef<bool> defined) const {
+  unsigned numInputs = getNumDomainVars() + getNumSymbolVars();
+  assert(defined.size() >= numPoints && "defined buffer is too small");
+  std::fill(defined.begin(), defined.begin() + numPoints, false);
+
+  // The points not yet found to lie in the domain of some piece. Since the
+  // domains are disjoint, each point is evaluated by at most one piece.
+  SmallVector<unsigned, 64> remaining(numPoints);
+  std::iota(remaining.begin(), remaining.end(), 0);
+  SmallVector<unsigned, 64> selected, stillRemaining;
+  SmallVector<int64_t, 64> subPoints, subOut;
+  SmallVector<bool, 64> inPiece;
+  for (const Piece &piece : pieces) {
+    if (remaining.empty())
+      break;
+    gatherPoints(points, numPoints, numInputs, remaining, subPoints);
+    inPiece.resize(remaining.size());
+    piece.domain.containsPointBatch(subPoints, remaining.size(), inPiece);
+
+    selected.clear();
+    stillRemaining.clear();
+    for (unsigned k = 0, e = remaining.size(); k < e; ++k)
+      (inPiece[k] ? selected : stillRemaining).push_back(remaining[k]);
+    remaining.swap(stillRemaining);
+    if (selected.empty())
+      continue;
+
+    gatherPoints(points, numPoints, numInputs, selected, subPoints);
+    subOut.resize(size_t(getNumOutputs()) * selected.size());
+    if (piece.output.valueAtBatch(subPoints, selected.size(), subOut).failed())
+      return failure();
+    for (unsigned o = 0, e = getNumOutputs(); o < e; ++o)
+      for (unsigned k = 0, f = selected.size(); k < f; ++k)
+        out[size_t(o) * numPoints + selected[k]] =
+            subOut[size_t(o) * selected.size() + k];
+    for (unsigned p : selected)
+      defined[p] = true;
+  }
+  return success();
+}
@@ -0,0 +1,72 @@
+//===- Parallel.cpp - MLIR Presburger Parallelism Utilities ---------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Parallel.h"
+#include "SolverContext.h"
+#include <atomic>
+#include <cassert>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace mlir;
+using namespace presburger;
+
+static std::atomic<unsigned> maxNumThreads(1);
+
+/// Whether the current thread is running a task of some parallelFor.
+static thread_local bool inParallelRegion = false;
+
+void presburger::setMaxNumThreads(unsigned numThreads) {
+  assert(numThreads >= 1 && "at least one thread is needed!");
+  maxNumThreads.store(numThreads, std::memory_order_relaxed);
+}
+
+unsigned presburger::getMaxNumThreads() {
+  if (SolverContext *context = SolverContext::getCurrent())
+    if (unsigned numThreads = context->getMaxNumThreads())
+      return numThreads;
+  return maxNumThreads.load(std::memory_order_relaxed);
+}
+
+void presburger::parallelFor(unsigned begin, unsigned end,
+                             llvm::function_ref<void(unsigned)> fn) {
+  if (begin >= end)
+    return;
+  unsigned numThreads = std::min(getMaxNumThreads(), end - begin);
+  if (numThreads <= 1 || inParallelRegion) {
+    for (unsigned i = begin; i < end; ++i)
+      fn(i);
+    return;
+  }
+
+  std::atomic<unsigned> next(begin);
+  SolverContext *context = SolverContext::getCurrent();
+  auto worker = [&] {
+    // Run the tasks in the caller's context, which the calling thread already
+    // has.
+    std::optional<SolverContextScope> scope;
+    if (context && SolverContext::getCurrent() != context)
+      scope.emplace(*context);
+    bool wasInParallelRegion = inParallelRegion;
+    inParallelRegion = true;
+    for (unsigned i = next.fetch_add(1, std::memory_order_relaxed); i < end;
+         i = next.fetch_add(1, std::memory_order_relaxed))
+      fn(i);
+    inParallelRegion = wasInParallelRegion;
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (unsigned t = 1; t < numThreads; ++t)
+    threads.emplace_back(worker);
+  // The calling thread takes part in the work instead of idling.
+  worker();
+  for (std::thread &thread : threads)
+    thread.join();
+}
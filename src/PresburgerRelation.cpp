@@ -7,8 +7,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "PresburgerRelation.h"
+#include "Parallel.h"
+#include "QueryCache.h"
 #include "Simplex.h"
+#include "Statistics.h"
 #include "Utils.h"
+#include <atomic>
 #include <optional>
 
 using namespace mlir;
@@ -24,6 +28,7 @@ void PresburgerRelation::setSpace(const PresburgerSpace &oSpace) {
   space = oSpace;
   for (IntegerRelation &disjunct : disjuncts)
     disjunct.setSpaceExceptLocals(space);
+  invalidateDisjunctBoxes();
 }
 
 unsigned PresburgerRelation::getNumDisjuncts() const {
@@ -44,6 +49,7 @@ const IntegerRelation &PresburgerRelation::getDisjunct(unsigned index) const {
 void PresburgerRelation::unionInPlace(const IntegerRelation &disjunct) {
   assert(space.isCompatible(disjunct.getSpace()) && "Spaces should match");
   disjuncts.push_back(disjunct);
+  invalidateDisjunctBoxes();
 }
 
 /// Mutate this set, turning it into the union of this set and the given set.
@@ -66,10 +72,153 @@ PresburgerRelation::unionSet(const PresburgerRelation &set) const {
 }
 
 /// A point is contained in the union iff any of the parts contain the point.
+///
+/// Computing the boxes costs a Simplex per disjunct, which is much more than
+/// checking a single point, so the boxes are only used if already cached.
 bool PresburgerRelation::containsPoint(ArrayRef<MPInt> point) const {
-  return llvm::any_of(disjuncts, [&](const IntegerRelation &disjunct) {
-    return (disjunct.containsPointNoLocal(point));
-  });
+  std::shared_ptr<const SmallVector<DisjunctBox, 2>> boxes =
+      getCachedDisjunctBoxes();
+  for (unsigned i = 0, e = disjuncts.size(); i < e; ++i) {
+    if (boxes && !(*boxes)[i].mayContain(point))
+      continue;
+    if (disjuncts[i].containsPointNoLocal(point))
+      return true;
+  }
+  return false;
+}
+
+void PresburgerRelation::containsPointBatch(
+    ArrayRef<int64_t> points, unsigned numPoints,
+    MutableArrayRef<bool> result) const {
+  unsigned numVars = getNumVars();
+  assert(points.size() >= size_t(numVars) * numPoints &&
+         "too few values for the points");
+  assert(result.size() >= numPoints && "result buffer is too small");
+  std::fill(result.begin(), result.begin() + numPoints, false);
+
+  ArrayRef<DisjunctBox> boxes = getDisjunctBoxes();
+  SmallVector<int64_t, 64> values(numPoints);
+  SmallVector<bool, 64> satisfied(numPoints), overflow(numPoints);
+  SmallVector<int64_t, 8> expr;
+  SmallVector<MPInt, 8> point(numVars);
+  for (unsigned i = 0, e = disjuncts.size(); i < e; ++i) {
+    const IntegerRelation &disjunct = disjuncts[i];
+    if (boxes[i].empty)
+      continue;
+
+    // Evaluate the constraints in int64 for all points at once. This is only
+    // possible without locals, since their values are not known.
+    bool fits = disjunct.getNumLocalVars() == 0;
+    std::fill(satisfied.begin(), satisfied.end(), true);
+    std::fill(overflow.begin(), overflow.end(), false);
+    for (unsigned r = 0, f = disjunct.getNumInequalities(); fits && r < f;
+         ++r) {
+      fits = getInt64VecIfFits(disjunct.getInequality(r), expr);
+      if (!fits)
+        break;
+      evaluateAffineBatch(expr, points, numPoints, values, overflow);
+      for (unsigned p = 0; p < numPoints; ++p)
+        satisfied[p] = satisfied[p] & (values[p] >= 0);
+    }
+    for (unsigned r = 0, f = disjunct.getNumEqualities(); fits && r < f; ++r) {
+      fits = getInt64VecIfFits(disjunct.getEquality(r), expr);
+      if (!fits)
+        break;
+      evaluateAffineBatch(expr, points, numPoints, values, overflow);
+      for (unsigned p = 0; p < numPoints; ++p)
+        satisfied[p] = satisfied[p] & (values[p] == 0);
+    }
+
+    for (unsigned p = 0; p < numPoints; ++p) {
+      if (result[p])
+        continue;
+      if (fits && !overflow[p]) {
+        result[p] = satisfied[p];
+        continue;
+      }
+      // Fall back to checking this point exactly.
+      for (unsigned v = 0; v < numVars; ++v)
+        point[v] = points[size_t(v) * numPoints + p];
+      if (!boxes[i].mayContain(point))
+        continue;
+      result[p] = disjunct.getNumLocalVars() == 0
+                      ? disjunct.containsPoint(point)
+                      : disjunct.containsPointNoLocal(point).has_value();
+    }
+  }
+}
+
+bool PresburgerRelation::DisjunctBox::mayOverlap(
+    const DisjunctBox &other) const {
+  if (empty || other.empty)
+    return false;
+  assert(lb.size() == other.lb.size() && "boxes must have the same dimension");
+  for (unsigned k = 0, e = lb.size(); k < e; ++k) {
+    if (ub[k] && other.lb[k] && *ub[k] < *other.lb[k])
+      return false;
+    if (other.ub[k] && lb[k] && *other.ub[k] < *lb[k])
+      return false;
+  }
+  return true;
+}
+
+bool PresburgerRelation::DisjunctBox::mayContain(
+    ArrayRef<MPInt> point) const {
+  if (empty)
+    return false;
+  assert(point.size() == lb.size() && "point must have one value per var");
+  for (unsigned k = 0, e = lb.size(); k < e; ++k) {
+    if (lb[k] && point[k] < *lb[k])
+      return false;
+    if (ub[k] && point[k] > *ub[k])
+      return false;
+  }
+  return true;
+}
+
+PresburgerRelation::DisjunctBox
+PresburgerRelation::computeDisjunctBox(Simplex &simp, unsigned numVars) {
+  assert(numVars <= simp.getNumVariables() && "too many vars requested");
+  DisjunctBox box;
+  if (simp.isEmpty()) {
+    box.empty = true;
+    return box;
+  }
+
+  box.lb.reserve(numVars);
+  box.ub.reserve(numVars);
+  SmallVector<MPInt, 8> dir(simp.getNumVariables() + 1, MPInt(0));
+  for (unsigned k = 0; k < numVars; ++k) {
+    dir[k] = 1;
+    MaybeOptimum<Fraction> min =
+        simp.computeOptimum(Simplex::Direction::Down, dir);
+    MaybeOptimum<Fraction> max =
+        simp.computeOptimum(Simplex::Direction::Up, dir);
+    box.lb.push_back(min.isBounded() ? std::optional<MPInt>(floor(*min))
+                                     : std::nullopt);
+    box.ub.push_back(max.isBounded() ? std::optional<MPInt>(ceil(*max))
+                                     : std::nullopt);
+    dir[k] = 0;
+  }
+  return box;
+}
+
+ArrayRef<PresburgerRelation::DisjunctBox>
+PresburgerRelation::getDisjunctBoxes() const {
+  if (std::shared_ptr<const SmallVector<DisjunctBox, 2>> boxes =
+          boxCache.load())
+    return *boxes;
+
+  auto computed = std::make_shared<SmallVector<DisjunctBox, 2>>();
+  computed->reserve(disjuncts.size());
+  for (const IntegerRelation &disjunct : disjuncts) {
+    Simplex simplex(disjunct);
+    computed->push_back(computeDisjunctBox(simplex, getNumVars()));
+  }
+
+  // If another thread got there first, use its boxes, so that the returned
+  // list is the one owned by the cache.
+  return *boxCache.publish(std::move(computed));
 }
 
 PresburgerRelation
@@ -94,10 +243,16 @@ PresburgerRelation
 PresburgerRelation::intersect(const PresburgerRelation &set) const {
   assert(space.isCompatible(set.getSpace()) && "Spaces should match");
 
+  ArrayRef<DisjunctBox> boxesA = getDisjunctBoxes();
+  ArrayRef<DisjunctBox> boxesB = set.getDisjunctBoxes();
+
   PresburgerRelation result(getSpace());
-  for (const IntegerRelation &csA : disjuncts) {
-    for (const IntegerRelation &csB : set.disjuncts) {
-      IntegerRelation intersection = csA.intersect(csB);
+  for (unsigned i = 0, e = disjuncts.size(); i < e; ++i) {
+    for (unsigned j = 0, f = set.disjuncts.size(); j < f; ++j) {
+      // Disjuncts with disjoint boxes have an empty intersection.
+      if (!boxesA[i].mayOverlap(boxesB[j]))
+        continue;
+      IntegerRelation intersection = disjuncts[i].intersect(set.disjuncts[j]);
       if (!intersection.isEmpty())
         result.unionInPlace(intersection);
     }
@@ -119,19 +274,24 @@ PresburgerRelation::intersect(const PresburgerRelation &set) const {
 ///
 /// For every eq `coeffs == 0` there are two possible ineqs to index into.
 /// The first is coeffs >= 0 and the second is coeffs <= 0.
-static SmallVector<MPInt, 8> getIneqCoeffsFromIdx(const IntegerRelation &rel,
-                                                  unsigned idx) {
+///
+/// The returned coefficients refer to a row of `rel` when possible; only the
+/// negation of an equality is materialized, in `scratch`.
+static ArrayRef<MPInt> getIneqCoeffsFromIdx(const IntegerRelation &rel,
+                                            unsigned idx,
+                                            SmallVectorImpl<MPInt> &scratch) {
   assert(idx < rel.getNumInequalities() + 2 * rel.getNumEqualities() &&
          "idx out of bounds!");
   if (idx < rel.getNumInequalities())
-    return llvm::to_vector<8>(rel.getInequality(idx));
+    return rel.getInequality(idx);
 
   idx -= rel.getNumInequalities();
   ArrayRef<MPInt> eqCoeffs = rel.getEquality(idx / 2);
 
   if (idx % 2 == 0)
-    return llvm::to_vector<8>(eqCoeffs);
-  return getNegatedCoeffs(eqCoeffs);
+    return eqCoeffs;
+  getNegatedCoeffs(eqCoeffs, scratch);
+  return scratch;
 }
 
 PresburgerRelation PresburgerRelation::computeReprWithOnlyDivLocals() const {
@@ -214,6 +374,10 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
   };
   SmallVector<Frame, 2> frames;
 
+  // Buffers for the constraints added to `b` and `simplex` below, reused
+  // across levels to avoid materializing a fresh vector for each of them.
+  SmallVector<MPInt, 8> scratch, ineq;
+
   // When we "recurse", we ensure the current frame is stored in `frames` and
   // increment `level`. When we return, we decrement `level`.
   unsigned level = 1;
@@ -296,12 +460,12 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
           // need not be considered, same as above, and they automatically will
           // not be because they were never a part of sI; we just infer them
           // from the equality and add them only to b.
-          b.addInequality(
-              getDivLowerBound(divs.getDividend(i), divs.getDenom(i),
-                               sI.getVarKindOffset(VarKind::Local) + i));
-          b.addInequality(
-              getDivUpperBound(divs.getDividend(i), divs.getDenom(i),
-                               sI.getVarKindOffset(VarKind::Local) + i));
+          getDivLowerBound(divs.getDividend(i), divs.getDenom(i),
+                           sI.getVarKindOffset(VarKind::Local) + i, ineq);
+          b.addInequality(ineq);
+          getDivUpperBound(divs.getDividend(i), divs.getDenom(i),
+                           sI.getVarKindOffset(VarKind::Local) + i, ineq);
+          b.addInequality(ineq);
         }
       }
 
@@ -324,7 +488,8 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
         //
         // TODO: consider supporting tail recursion directly if this becomes
         // relevant for performance.
-        frames.push_back(Frame{initialSnapshot, initBCounts, sI,
+        FP_STAT_INC(NumSubtractFrames);
+        frames.push_back(Frame{initialSnapshot, initBCounts, std::move(sI),
                                /*ineqsToProcess=*/{},
                                /*lastIneqProcessed=*/{}});
         ++level;
@@ -366,7 +531,9 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
 
       unsigned simplexSnapshot = simplex.getSnapshot();
       IntegerRelation::CountsSnapshot bCounts = b.getCounts();
-      frames.push_back(Frame{simplexSnapshot, bCounts, sI, ineqsToProcess,
+      FP_STAT_INC(NumSubtractFrames);
+      frames.push_back(Frame{simplexSnapshot, bCounts, std::move(sI),
+                             std::move(ineqsToProcess),
                              /*lastIneqProcessed=*/std::nullopt});
       // We have completed the initial setup for this level.
       // Fallthrough to the main recursive part below.
@@ -387,10 +554,10 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
         // state before adding this complement constraint, and add s_ij to b.
         simplex.rollback(frame.simplexSnapshot);
         b.truncate(frame.bCounts);
-        SmallVector<MPInt, 8> ineq =
-            getIneqCoeffsFromIdx(frame.sI, *frame.lastIneqProcessed);
-        b.addInequality(ineq);
-        simplex.addInequality(ineq);
+        ArrayRef<MPInt> lastIneq =
+            getIneqCoeffsFromIdx(frame.sI, *frame.lastIneqProcessed, scratch);
+        b.addInequality(lastIneq);
+        simplex.addInequality(lastIneq);
       }
 
       if (frame.ineqsToProcess.empty()) {
@@ -405,8 +572,7 @@ static PresburgerRelation getSetDifference(IntegerRelation b,
       frame.simplexSnapshot = simplex.getSnapshot();
 
       unsigned idx = frame.ineqsToProcess.back();
-      SmallVector<MPInt, 8> ineq =
-          getComplementIneq(getIneqCoeffsFromIdx(frame.sI, idx));
+      getComplementIneq(getIneqCoeffsFromIdx(frame.sI, idx, scratch), ineq);
       b.addInequality(ineq);
       simplex.addInequality(ineq);
 
@@ -429,11 +595,32 @@ PresburgerRelation PresburgerRelation::complement() const {
 /// return `this \ set`.
 PresburgerRelation
 PresburgerRelation::subtract(const PresburgerRelation &set) const {
+  FP_STAT_TIME(Subtract);
   assert(space.isCompatible(set.getSpace()) && "Spaces should match");
   PresburgerRelation result(getSpace());
-  // We compute (U_i t_i) \ (U_i set_i) as U_i (t_i \ V_i set_i).
-  for (const IntegerRelation &disjunct : disjuncts)
-    result.unionInPlace(getSetDifference(disjunct, set));
+  // We compute (U_i t_i) \ (U_i set_i) as U_i (t_i \ V_i set_i). The
+  // differences are independent of each other, so they can be computed in
+  // parallel. They are collected in disjunct order, so that the result does not
+  // depend on the number of threads used.
+  //
+  // Disjuncts of `set` whose boxes are disjoint from that of t_i do not
+  // intersect t_i, so they are dropped before computing t_i \ V_i set_i.
+  ArrayRef<DisjunctBox> boxes = getDisjunctBoxes();
+  ArrayRef<DisjunctBox> setBoxes = set.getDisjunctBoxes();
+  SmallVector<std::optional<PresburgerRelation>, 4> differences(
+      disjuncts.size());
+  parallelFor(0, disjuncts.size(), [&](unsigned i) {
+    if (boxes[i].empty)
+      return;
+    PresburgerRelation overlapping(set.getSpace());
+    for (unsigned j = 0, e = set.disjuncts.size(); j < e; ++j)
+      if (boxes[i].mayOverlap(setBoxes[j]))
+        overlapping.disjuncts.push_back(set.disjuncts[j]);
+    differences[i] = getSetDifference(disjuncts[i], overlapping);
+  });
+  for (const std::optional<PresburgerRelation> &difference : differences)
+    if (difference)
+      result.unionInPlace(*difference);
   return result;
 }
 
@@ -441,7 +628,19 @@ PresburgerRelation::subtract(const PresburgerRelation &set) const {
 /// point then this is a point that is contained in T but not S, and
 /// if T contains a point that is not in S, this also lies in T \ S.
 bool PresburgerRelation::isSubsetOf(const PresburgerRelation &set) const {
-  return this->subtract(set).isIntegerEmpty();
+  if (!detail::isQueryCacheEnabled())
+    return this->subtract(set).isIntegerEmpty();
+
+  detail::QueryKey key(detail::QueryKind::IsSubsetOf);
+  key.append(*this);
+  key.append(set);
+  if (std::optional<detail::QueryResult> cached = detail::lookupQuery(key))
+    return cached->verdict;
+  detail::QueryResult result;
+  result.verdict = this->subtract(set).isIntegerEmpty();
+  bool verdict = result.verdict;
+  detail::insertQuery(std::move(key), std::move(result));
+  return verdict;
 }
 
 /// Two sets are equal iff they are subsets of each other.
@@ -483,12 +682,43 @@ std::optional<MPInt> PresburgerRelation::computeVolume() const {
   return result;
 }
 
+std::optional<MPInt> PresburgerRelation::countIntegerPoints() const {
+  assert(getNumSymbolVars() == 0 && "Symbols are not yet supported!");
+  // Subtracting needs the locals of the disjuncts to be divisions.
+  if (disjuncts.size() > 1 && !hasOnlyDivLocals())
+    return computeReprWithOnlyDivLocals().countIntegerPoints();
+
+  // The disjuncts of a set difference are pairwise disjoint, so the parts
+  // d_i \ (d_0 U ... U d_{i-1}) partition the union and their disjuncts can be
+  // counted separately.
+  MPInt result(0);
+  PresburgerRelation previous = getEmpty(getSpace());
+  for (const IntegerRelation &disjunct : disjuncts) {
+    PresburgerRelation part(disjunct);
+    if (previous.getNumDisjuncts() != 0)
+      part = part.subtract(previous);
+    for (const IntegerRelation &piece : part.getAllDisjuncts()) {
+      std::optional<MPInt> count = piece.countIntegerPoints();
+      if (!count)
+        return {};
+      result += *count;
+    }
+    previous.unionInPlace(disjunct);
+  }
+  return result;
+}
+
 /// The SetCoalescer class contains all functionality concerning the coalesce
 /// heuristic. It is built from a `PresburgerRelation` and has the `coalesce()`
 /// function as its main API. The coalesce heuristic simplifies the
 /// representation of a PresburgerRelation. In particular, it removes all
 /// disjuncts which are subsets of other disjuncts in the union and it combines
 /// sets that overlap and can be combined in a convex way.
+///
+/// Before any pair of disjuncts is typed against each other, the pair is
+/// checked for overlap using the bounding boxes of the disjuncts, and the
+/// remaining pairs for a given disjunct are attempted in parallel when
+/// setMaxNumThreads allows it.
 class presburger::SetCoalescer {
 
 public:
@@ -499,6 +729,39 @@ public:
   SetCoalescer(const PresburgerRelation &s);
 
 private:
+  /// The constraints of a pair of disjuncts `a` and `b`, typed with respect to
+  /// each other. `redundantIneqsA` is the inequalities of `a` that are
+  /// redundant for `b` (similarly for `cuttingIneqsA`, `redundantIneqsB`, and
+  /// `cuttingIneqsB`).
+  struct PairTyping {
+    /// The list of all inversed equalities during typing. This ensures that
+    /// the constraints exist even after the typing function has concluded.
+    SmallVector<SmallVector<MPInt, 2>, 2> negEqs;
+
+    SmallVector<ArrayRef<MPInt>, 2> redundantIneqsA;
+    SmallVector<ArrayRef<MPInt>, 2> cuttingIneqsA;
+
+    SmallVector<ArrayRef<MPInt>, 2> redundantIneqsB;
+    SmallVector<ArrayRef<MPInt>, 2> cuttingIneqsB;
+  };
+
+  /// The way in which a pair of disjuncts at positions `i` and `j` can be
+  /// coalesced.
+  struct PairOutcome {
+    enum class Kind {
+      /// The disjunct at `i` is contained in the one at `j`.
+      EraseI,
+      /// The disjunct at `j` is contained in the one at `i`.
+      EraseJ,
+      /// The cut case applies to (`i`, `j`), giving `coalesced`.
+      CutCaseIJ,
+      /// The cut case applies to (`j`, `i`), giving `coalesced`.
+      CutCaseJI
+    };
+    Kind kind;
+    std::optional<IntegerRelation> coalesced;
+  };
+
   /// The space of the set the SetCoalescer is coalescing.
   PresburgerSpace space;
 
@@ -507,32 +770,31 @@ private:
   SmallVector<IntegerRelation, 2> disjuncts;
   /// The list of `Simplex`s constructed from the elements of `disjuncts`.
   SmallVector<Simplex, 2> simplices;
-
-  /// The list of all inversed equalities during typing. This ensures that
-  /// the constraints exist even after the typing function has concluded.
-  SmallVector<SmallVector<MPInt, 2>, 2> negEqs;
-
-  /// `redundantIneqsA` is the inequalities of `a` that are redundant for `b`
-  /// (similarly for `cuttingIneqsA`, `redundantIneqsB`, and `cuttingIneqsB`).
-  SmallVector<ArrayRef<MPInt>, 2> redundantIneqsA;
-  SmallVector<ArrayRef<MPInt>, 2> cuttingIneqsA;
-
-  SmallVector<ArrayRef<MPInt>, 2> redundantIneqsB;
-  SmallVector<ArrayRef<MPInt>, 2> cuttingIneqsB;
+  /// The bounding boxes of the elements of `disjuncts`.
+  SmallVector<PresburgerRelation::DisjunctBox, 2> boxes;
+
+  /// Compute the bounding box of the set represented by `simp` over all its
+  /// vars.
+  static PresburgerRelation::DisjunctBox computeBoundingBox(Simplex &simp) {
+    return PresburgerRelation::computeDisjunctBox(simp,
+                                                  simp.getNumVariables());
+  }
 
   /// Given a Simplex `simp` and one of its inequalities `ineq`, check
   /// that the facet of `simp` where `ineq` holds as an equality is contained
   /// within `a`.
-  bool isFacetContained(ArrayRef<MPInt> ineq, Simplex &simp);
+  static bool isFacetContained(ArrayRef<MPInt> ineq, Simplex &simp,
+                               const PairTyping &typing);
 
   /// Removes redundant constraints from `disjunct`, adds it to `disjuncts` and
-  /// removes the disjuncts at position `i` and `j`. Updates `simplices` to
-  /// reflect the changes. `i` and `j` cannot be equal.
+  /// removes the disjuncts at position `i` and `j`. Updates `simplices` and
+  /// `boxes` to reflect the changes. `i` and `j` cannot be equal.
   void addCoalescedDisjunct(unsigned i, unsigned j,
                             const IntegerRelation &disjunct);
 
-  /// Checks whether `a` and `b` can be combined in a convex sense, if there
-  /// exist cutting inequalities.
+  /// Checks whether `a`, whose simplex is `simpA`, and `b` can be combined in
+  /// a convex sense, if there exist cutting inequalities. Returns the combined
+  /// disjunct if so.
   ///
   /// An example of this case:
   ///    ___________        ___________
@@ -542,29 +804,46 @@ private:
   ///     \___\|/            \_____/
   ///
   ///
-  LogicalResult coalescePairCutCase(unsigned i, unsigned j);
+  static std::optional<IntegerRelation>
+  coalescePairCutCase(const IntegerRelation &a, Simplex &simpA,
+                      const PairTyping &typing);
 
   /// Types the inequality `ineq` according to its `IneqType` for `simp` into
-  /// `redundantIneqsB` and `cuttingIneqsB`. Returns success, if no separate
-  /// inequalities were encountered. Otherwise, returns failure.
-  LogicalResult typeInequality(ArrayRef<MPInt> ineq, Simplex &simp);
+  /// `redundantIneqsB` and `cuttingIneqsB` of `typing`. Returns success, if no
+  /// separate inequalities were encountered. Otherwise, returns failure.
+  static LogicalResult typeInequality(ArrayRef<MPInt> ineq, Simplex &simp,
+                                      PairTyping &typing);
 
   /// Types the equality `eq`, i.e. for `eq` == 0, types both `eq` >= 0 and
   /// -`eq` >= 0 according to their `IneqType` for `simp` into
-  /// `redundantIneqsB` and `cuttingIneqsB`. Returns success, if no separate
-  /// inequalities were encountered. Otherwise, returns failure.
-  LogicalResult typeEquality(ArrayRef<MPInt> eq, Simplex &simp);
+  /// `redundantIneqsB` and `cuttingIneqsB` of `typing`. Returns success, if no
+  /// separate inequalities were encountered. Otherwise, returns failure.
+  static LogicalResult typeEquality(ArrayRef<MPInt> eq, Simplex &simp,
+                                    PairTyping &typing);
 
   /// Replaces the element at position `i` with the last element and erases
-  /// the last element for both `disjuncts` and `simplices`.
+  /// the last element for `disjuncts`, `simplices` and `boxes`.
   void eraseDisjunct(unsigned i);
 
-  /// Attempts to coalesce the two IntegerRelations at position `i` and `j`
-  /// in `disjuncts` in-place. Returns whether the disjuncts were
-  /// successfully coalesced. The simplices in `simplices` need to be the ones
-  /// constructed from `disjuncts`. At this point, there are no empty
-  /// disjuncts in `disjuncts` left.
-  LogicalResult coalescePair(unsigned i, unsigned j);
+  /// Checks whether the IntegerRelations at position `i` and `j` in
+  /// `disjuncts` can be coalesced, without modifying `disjuncts`. `simpI` and
+  /// `simpJ` must represent the same sets as the simplices in `simplices` at
+  /// these positions; they may be pivoted, but their constraints are left
+  /// unchanged. At this point, there are no empty disjuncts in `disjuncts`
+  /// left.
+  std::optional<PairOutcome> analyzePair(unsigned i, unsigned j, Simplex &simpI,
+                                         Simplex &simpJ) const;
+
+  /// Coalesces the disjuncts at position `i` and `j` as described by
+  /// `outcome`.
+  void applyOutcome(unsigned i, unsigned j, const PairOutcome &outcome);
+
+  /// Returns the first `j` in `candidates` such that the disjuncts at `i` and
+  /// `j` can be coalesced, along with how to coalesce them. The candidates
+  /// are attempted in parallel if possible, but the result is always the same
+  /// as when attempting them one after the other.
+  std::optional<std::pair<unsigned, PairOutcome>>
+  findFirstCoalescablePair(unsigned i, ArrayRef<unsigned> candidates);
 };
 
 /// Constructs a `SetCoalescer` from a `PresburgerRelation`. Only adds non-empty
@@ -574,6 +853,7 @@ SetCoalescer::SetCoalescer(const PresburgerRelation &s) : space(s.getSpace()) {
   disjuncts = s.disjuncts;
 
   simplices.reserve(s.getNumDisjuncts());
+  boxes.reserve(s.getNumDisjuncts());
   // Note that disjuncts.size() changes during the loop.
   for (unsigned i = 0; i < disjuncts.size();) {
     disjuncts[i].removeRedundantConstraints();
@@ -585,6 +865,7 @@ SetCoalescer::SetCoalescer(const PresburgerRelation &s) : space(s.getSpace()) {
     }
     ++i;
     simplices.push_back(simp);
+    boxes.push_back(computeBoundingBox(simplices.back()));
   }
 }
 
@@ -595,29 +876,38 @@ PresburgerRelation SetCoalescer::coalesce() {
   // is swapped with the last element of `disjuncts` and subsequently erased
   // and similarly for simplices.
   for (unsigned i = 0; i < disjuncts.size();) {
+    /// Handling of local ids is not yet implemented, so these cases are
+    /// skipped.
+    /// TODO: implement local id support.
+    if (disjuncts[i].getNumLocalVars() != 0) {
+      ++i;
+      continue;
+    }
 
+    // A coalesced pair is replaced by a convex set equal to their union, so
+    // only pairs that intersect can be coalesced. Pairs whose bounding boxes
+    // are disjoint are not attempted.
+    //
     // TODO: This does some comparisons two times (index 0 with 1 and index 1
     // with 0).
-    bool broken = false;
+    SmallVector<unsigned, 8> candidates;
     for (unsigned j = 0, e = disjuncts.size(); j < e; ++j) {
-      negEqs.clear();
-      redundantIneqsA.clear();
-      redundantIneqsB.clear();
-      cuttingIneqsA.clear();
-      cuttingIneqsB.clear();
-      if (i == j)
+      if (i == j || disjuncts[j].getNumLocalVars() != 0)
         continue;
-      if (coalescePair(i, j).succeeded()) {
-        broken = true;
-        break;
-      }
+      if (boxes[i].mayOverlap(boxes[j]))
+        candidates.push_back(j);
     }
 
-    // Only if the inner loop was not broken, i is incremented. This is
-    // required as otherwise, if a coalescing occurs, the IntegerRelation
-    // now at position i is not compared.
-    if (!broken)
+    // Only if no pair was coalesced, i is incremented. This is required as
+    // otherwise, if a coalescing occurs, the IntegerRelation now at position
+    // i is not compared.
+    std::optional<std::pair<unsigned, PairOutcome>> found =
+        findFirstCoalescablePair(i, candidates);
+    if (!found) {
       ++i;
+      continue;
+    }
+    applyOutcome(i, found->first, found->second);
   }
 
   PresburgerRelation newSet = PresburgerRelation::getEmpty(space);
@@ -630,10 +920,11 @@ PresburgerRelation SetCoalescer::coalesce() {
 /// Given a Simplex `simp` and one of its inequalities `ineq`, check
 /// that all inequalities of `cuttingIneqsB` are redundant for the facet of
 /// `simp` where `ineq` holds as an equality is contained within `a`.
-bool SetCoalescer::isFacetContained(ArrayRef<MPInt> ineq, Simplex &simp) {
+bool SetCoalescer::isFacetContained(ArrayRef<MPInt> ineq, Simplex &simp,
+                                    const PairTyping &typing) {
   SimplexRollbackScopeExit scopeExit(simp);
   simp.addEquality(ineq);
-  return llvm::all_of(cuttingIneqsB, [&simp](ArrayRef<MPInt> curr) {
+  return llvm::all_of(typing.cuttingIneqsB, [&simp](ArrayRef<MPInt> curr) {
     return simp.isRedundantInequality(curr);
   });
 }
@@ -655,6 +946,8 @@ void SetCoalescer::addCoalescedDisjunct(unsigned i, unsigned j,
     simplices.pop_back();
     simplices[n - 2] = Simplex(disjuncts[n - 2]);
 
+    boxes[i] = boxes[n - 2];
+    boxes.pop_back();
   } else {
     // Other possible edge cases are correct since for `j` or `i` == `n` -
     // 2, the `IntegerRelation` at position `n` - 2 should be lost. The
@@ -671,16 +964,20 @@ void SetCoalescer::addCoalescedDisjunct(unsigned i, unsigned j,
     simplices[j] = simplices[n - 2];
     simplices.pop_back();
     simplices[n - 2] = Simplex(disjuncts[n - 2]);
+
+    boxes[i] = boxes[n - 1];
+    boxes[j] = boxes[n - 2];
+    boxes.pop_back();
   }
+  boxes[n - 2] = computeBoundingBox(simplices[n - 2]);
 }
 
-/// Given two polyhedra `a` and `b` at positions `i` and `j` in
-/// `disjuncts` and `redundantIneqsA` being the inequalities of `a` that
-/// are redundant for `b` (similarly for `cuttingIneqsA`, `redundantIneqsB`,
-/// and `cuttingIneqsB`), Checks whether the facets of all cutting
-/// inequalites of `a` are contained in `b`. If so, a new polyhedron
-/// consisting of all redundant inequalites of `a` and `b` and all
-/// equalities of both is created.
+/// Given two polyhedra `a` and `b` and `redundantIneqsA` being the
+/// inequalities of `a` that are redundant for `b` (similarly for
+/// `cuttingIneqsA`, `redundantIneqsB`, and `cuttingIneqsB`), Checks whether
+/// the facets of all cutting inequalites of `a` are contained in `b`. If so, a
+/// new polyhedron consisting of all redundant inequalites of `a` and `b` and
+/// all equalities of both is created.
 ///
 /// An example of this case:
 ///    ___________        ___________
@@ -690,124 +987,187 @@ void SetCoalescer::addCoalescedDisjunct(unsigned i, unsigned j,
 ///     \___\|/            \_____/
 ///
 ///
-LogicalResult SetCoalescer::coalescePairCutCase(unsigned i, unsigned j) {
+std::optional<IntegerRelation>
+SetCoalescer::coalescePairCutCase(const IntegerRelation &a, Simplex &simpA,
+                                  const PairTyping &typing) {
   /// All inequalities of `b` need to be redundant. We already know that the
   /// redundant ones are, so only the cutting ones remain to be checked.
-  Simplex &simp = simplices[i];
-  IntegerRelation &disjunct = disjuncts[i];
-  if (llvm::any_of(cuttingIneqsA, [this, &simp](ArrayRef<MPInt> curr) {
-        return !isFacetContained(curr, simp);
+  if (llvm::any_of(typing.cuttingIneqsA, [&](ArrayRef<MPInt> curr) {
+        return !isFacetContained(curr, simpA, typing);
       }))
-    return failure();
-  IntegerRelation newSet(disjunct.getSpace());
+    return {};
+  IntegerRelation newSet(a.getSpace());
 
-  for (ArrayRef<MPInt> curr : redundantIneqsA)
+  for (ArrayRef<MPInt> curr : typing.redundantIneqsA)
     newSet.addInequality(curr);
 
-  for (ArrayRef<MPInt> curr : redundantIneqsB)
+  for (ArrayRef<MPInt> curr : typing.redundantIneqsB)
     newSet.addInequality(curr);
 
-  addCoalescedDisjunct(i, j, newSet);
-  return success();
+  return newSet;
 }
 
-LogicalResult SetCoalescer::typeInequality(ArrayRef<MPInt> ineq,
-                                           Simplex &simp) {
+LogicalResult SetCoalescer::typeInequality(ArrayRef<MPInt> ineq, Simplex &simp,
+                                           PairTyping &typing) {
   Simplex::IneqType type = simp.findIneqType(ineq);
   if (type == Simplex::IneqType::Redundant)
-    redundantIneqsB.push_back(ineq);
+    typing.redundantIneqsB.push_back(ineq);
   else if (type == Simplex::IneqType::Cut)
-    cuttingIneqsB.push_back(ineq);
+    typing.cuttingIneqsB.push_back(ineq);
   else
     return failure();
   return success();
 }
 
-LogicalResult SetCoalescer::typeEquality(ArrayRef<MPInt> eq, Simplex &simp) {
-  if (typeInequality(eq, simp).failed())
+LogicalResult SetCoalescer::typeEquality(ArrayRef<MPInt> eq, Simplex &simp,
+                                         PairTyping &typing) {
+  if (typeInequality(eq, simp, typing).failed())
     return failure();
-  negEqs.push_back(getNegatedCoeffs(eq));
-  ArrayRef<MPInt> inv(negEqs.back());
-  if (typeInequality(inv, simp).failed())
+  typing.negEqs.push_back(getNegatedCoeffs(eq));
+  ArrayRef<MPInt> inv(typing.negEqs.back());
+  if (typeInequality(inv, simp, typing).failed())
     return failure();
   return success();
 }
 
 void SetCoalescer::eraseDisjunct(unsigned i) {
   assert(simplices.size() == disjuncts.size() &&
-         "simplices and disjuncts must be equally as long");
+         boxes.size() == disjuncts.size() &&
+         "simplices, boxes and disjuncts must be equally as long");
   disjuncts[i] = disjuncts.back();
   disjuncts.pop_back();
   simplices[i] = simplices.back();
   simplices.pop_back();
+  boxes[i] = boxes.back();
+  boxes.pop_back();
 }
 
-LogicalResult SetCoalescer::coalescePair(unsigned i, unsigned j) {
+std::optional<SetCoalescer::PairOutcome>
+SetCoalescer::analyzePair(unsigned i, unsigned j, Simplex &simpI,
+                          Simplex &simpJ) const {
+  FP_STAT_INC(NumCoalescePairs);
 
-  IntegerRelation &a = disjuncts[i];
-  IntegerRelation &b = disjuncts[j];
+  const IntegerRelation &a = disjuncts[i];
+  const IntegerRelation &b = disjuncts[j];
   /// Handling of local ids is not yet implemented, so these cases are
   /// skipped.
   /// TODO: implement local id support.
   if (a.getNumLocalVars() != 0 || b.getNumLocalVars() != 0)
-    return failure();
-  Simplex &simpA = simplices[i];
-  Simplex &simpB = simplices[j];
+    return {};
 
   // Organize all inequalities and equalities of `a` according to their type
   // for `b` into `redundantIneqsA` and `cuttingIneqsA` (and vice versa for
   // all inequalities of `b` according to their type in `a`). If a separate
   // inequality is encountered during typing, the two IntegerRelations
   // cannot be coalesced.
+  PairTyping typing;
   for (int k = 0, e = a.getNumInequalities(); k < e; ++k)
-    if (typeInequality(a.getInequality(k), simpB).failed())
-      return failure();
+    if (typeInequality(a.getInequality(k), simpJ, typing).failed())
+      return {};
 
   for (int k = 0, e = a.getNumEqualities(); k < e; ++k)
-    if (typeEquality(a.getEquality(k), simpB).failed())
-      return failure();
+    if (typeEquality(a.getEquality(k), simpJ, typing).failed())
+      return {};
 
-  std::swap(redundantIneqsA, redundantIneqsB);
-  std::swap(cuttingIneqsA, cuttingIneqsB);
+  std::swap(typing.redundantIneqsA, typing.redundantIneqsB);
+  std::swap(typing.cuttingIneqsA, typing.cuttingIneqsB);
 
   for (int k = 0, e = b.getNumInequalities(); k < e; ++k)
-    if (typeInequality(b.getInequality(k), simpA).failed())
-      return failure();
+    if (typeInequality(b.getInequality(k), simpI, typing).failed())
+      return {};
 
   for (int k = 0, e = b.getNumEqualities(); k < e; ++k)
-    if (typeEquality(b.getEquality(k), simpA).failed())
-      return failure();
+    if (typeEquality(b.getEquality(k), simpI, typing).failed())
+      return {};
 
   // If there are no cutting inequalities of `a`, `b` is contained
   // within `a`.
-  if (cuttingIneqsA.empty()) {
-    eraseDisjunct(j);
-    return success();
-  }
+  if (typing.cuttingIneqsA.empty())
+    return PairOutcome{PairOutcome::Kind::EraseJ, std::nullopt};
 
   // Try to apply the cut case
-  if (coalescePairCutCase(i, j).succeeded())
-    return success();
+  if (std::optional<IntegerRelation> coalesced =
+          coalescePairCutCase(a, simpI, typing))
+    return PairOutcome{PairOutcome::Kind::CutCaseIJ, std::move(coalesced)};
 
   // Swap the vectors to compare the pair (j,i) instead of (i,j).
-  std::swap(redundantIneqsA, redundantIneqsB);
-  std::swap(cuttingIneqsA, cuttingIneqsB);
+  std::swap(typing.redundantIneqsA, typing.redundantIneqsB);
+  std::swap(typing.cuttingIneqsA, typing.cuttingIneqsB);
 
   // If there are no cutting inequalities of `a`, `b` is contained
   // within `a`.
-  if (cuttingIneqsA.empty()) {
+  if (typing.cuttingIneqsA.empty())
+    return PairOutcome{PairOutcome::Kind::EraseI, std::nullopt};
+
+  // Try to apply the cut case
+  if (std::optional<IntegerRelation> coalesced =
+          coalescePairCutCase(b, simpJ, typing))
+    return PairOutcome{PairOutcome::Kind::CutCaseJI, std::move(coalesced)};
+
+  return {};
+}
+
+void SetCoalescer::applyOutcome(unsigned i, unsigned j,
+                                const PairOutcome &outcome) {
+  switch (outcome.kind) {
+  case PairOutcome::Kind::EraseI:
+    FP_STAT_INC(NumCoalesceContained);
     eraseDisjunct(i);
-    return success();
+    return;
+  case PairOutcome::Kind::EraseJ:
+    FP_STAT_INC(NumCoalesceContained);
+    eraseDisjunct(j);
+    return;
+  case PairOutcome::Kind::CutCaseIJ:
+    FP_STAT_INC(NumCoalesceCut);
+    addCoalescedDisjunct(i, j, *outcome.coalesced);
+    return;
+  case PairOutcome::Kind::CutCaseJI:
+    FP_STAT_INC(NumCoalesceCut);
+    addCoalescedDisjunct(j, i, *outcome.coalesced);
+    return;
   }
+  llvm_unreachable("unknown PairOutcome kind");
+}
 
-  // Try to apply the cut case
-  if (coalescePairCutCase(j, i).succeeded())
-    return success();
+std::optional<std::pair<unsigned, SetCoalescer::PairOutcome>>
+SetCoalescer::findFirstCoalescablePair(unsigned i,
+                                       ArrayRef<unsigned> candidates) {
+  if (getMaxNumThreads() <= 1 || candidates.size() <= 1) {
+    for (unsigned j : candidates)
+      if (std::optional<PairOutcome> outcome =
+              analyzePair(i, j, simplices[i], simplices[j]))
+        return std::make_pair(j, std::move(*outcome));
+    return {};
+  }
+
+  // Each attempt only touches the simplex of its own candidate, and works on a
+  // private copy of the simplex of `i`. Attempts after the first success found
+  // so far are skipped, since their outcome would be discarded anyway.
+  SmallVector<std::optional<PairOutcome>, 8> outcomes(candidates.size());
+  std::atomic<unsigned> firstSuccess(candidates.size());
+  parallelFor(0, candidates.size(), [&](unsigned k) {
+    if (k > firstSuccess.load(std::memory_order_relaxed))
+      return;
+    unsigned j = candidates[k];
+    Simplex simpI = simplices[i];
+    outcomes[k] = analyzePair(i, j, simpI, simplices[j]);
+    if (!outcomes[k])
+      return;
+    unsigned current = firstSuccess.load(std::memory_order_relaxed);
+    while (k < current && !firstSuccess.compare_exchange_weak(
+                              current, k, std::memory_order_relaxed))
+      ;
+  });
 
-  return failure();
+  for (unsigned k = 0, e = candidates.size(); k < e; ++k)
+    if (outcomes[k])
+      return std::make_pair(candidates[k], std::move(*outcomes[k]));
+  return {};
 }
 
 PresburgerRelation PresburgerRelation::coalesce() const {
+  FP_STAT_TIME(Coalesce);
   return SetCoalescer(*this).coalesce();
 }
 
@@ -0,0 +1,202 @@
+//===- QueryCache.cpp - MLIR Presburger Query Cache -----------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryCache.h"
+#include "IntegerRelation.h"
+#include "PresburgerRelation.h"
+#include "SolverContext.h"
+#include "Utils.h"
+#include <algorithm>
+
+using namespace mlir;
+using namespace presburger;
+using namespace mlir::presburger::detail;
+
+/// Append the equalities (isEq=true) or inequalities (isEq=false) of `rel`,
+/// normalized, sorted and uniqued, to `data`, preceded by their number.
+static void encodeConstraints(const IntegerRelation &rel, bool isEq,
+                              SmallVectorImpl<MPInt> &data) {
+  unsigned numRows = isEq ? rel.getNumEqualities() : rel.getNumInequalities();
+  SmallVector<SmallVector<MPInt, 8>, 8> rows(numRows);
+  for (unsigned r = 0; r < numRows; ++r) {
+    ArrayRef<MPInt> row = isEq ? rel.getEquality(r) : rel.getInequality(r);
+    if (!normalizeConstraint(row, isEq, rows[r]))
+      rows[r].assign(row.begin(), row.end());
+  }
+  llvm::sort(rows, [](const SmallVector<MPInt, 8> &a,
+                      const SmallVector<MPInt, 8> &b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(),
+                                        b.end());
+  });
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+  data.push_back(MPInt(rows.size()));
+  for (const SmallVector<MPInt, 8> &row : rows)
+    data.append(row.begin(), row.end());
+}
+
+/// Append the canonical encoding of `rel` to `data`. The encoding starts with
+/// the numbers of variables of each kind, which determine the row length.
+static void encodeRelation(const IntegerRelation &rel,
+                           SmallVectorImpl<MPInt> &data) {
+  const PresburgerSpace &space = rel.getSpace();
+  data.push_back(MPInt(space.getNumDomainVars()));
+  data.push_back(MPInt(space.getNumRangeVars()));
+  data.push_back(MPInt(space.getNumSymbolVars()));
+  data.push_back(MPInt(space.getNumLocalVars()));
+
+  encodeConstraints(rel, /*isEq=*/true, data);
+  encodeConstraints(rel, /*isEq=*/false, data);
+}
+
+QueryKey::QueryKey(QueryKind kind) : kind(kind) {}
+
+void QueryKey::append(const IntegerRelation &rel) { encodeRelation(rel, data); }
+
+void QueryKey::append(const PresburgerRelation &rel) {
+  const PresburgerSpace &space = rel.getSpace();
+  data.push_back(MPInt(space.getNumDomainVars()));
+  data.push_back(MPInt(space.getNumRangeVars()));
+  data.push_back(MPInt(space.getNumSymbolVars()));
+
+  // The encodings of the disjuncts are self-delimiting, so sorting them makes
+  // the key independent of the order of the disjuncts.
+  SmallVector<SmallVector<MPInt, 32>, 4> disjuncts(rel.getNumDisjuncts());
+  for (unsigned i = 0, e = rel.getNumDisjuncts(); i < e; ++i)
+    encodeRelation(rel.getDisjunct(i), disjuncts[i]);
+  llvm::sort(disjuncts, [](const SmallVector<MPInt, 32> &a,
+                           const SmallVector<MPInt, 32> &b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(),
+                                        b.end());
+  });
+
+  data.push_back(MPInt(disjuncts.size()));
+  for (const SmallVector<MPInt, 32> &disjunct : disjuncts)
+    data.append(disjunct.begin(), disjunct.end());
+}
+
+size_t QueryKey::getHash() const {
+  return size_t(hashRange(data)) * 31 + static_cast<unsigned>(kind);
+}
+
+std::optional<QueryResult> QueryCache::lookup(const QueryKey &key) {
+  size_t hash = key.getHash();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (Entry *entry = find(key, hash)) {
+    ++stats.numHits;
+    return entry->result;
+  }
+  ++stats.numMisses;
+  return {};
+}
+
+void QueryCache::insert(QueryKey key, QueryResult result) {
+  size_t hash = key.getHash();
+  std::lock_guard<std::mutex> lock(mutex);
+  if (getCapacity() == 0)
+    return;
+  // Another thread may have computed the same query in the meantime.
+  if (Entry *entry = find(key, hash)) {
+    entry->result = std::move(result);
+    return;
+  }
+  entries.push_front({std::move(key), hash, std::move(result)});
+  index.emplace(hash, entries.begin());
+  evictToCapacity();
+}
+
+void QueryCache::setCapacity(size_t newCapacity) {
+  std::lock_guard<std::mutex> lock(mutex);
+  capacity.store(newCapacity, std::memory_order_relaxed);
+  evictToCapacity();
+}
+
+void QueryCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  stats = QueryCacheStats();
+}
+
+QueryCacheStats QueryCache::getStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  QueryCacheStats result = stats;
+  result.numEntries = entries.size();
+  return result;
+}
+
+QueryCache::Entry *QueryCache::find(const QueryKey &key, size_t hash) {
+  auto range = index.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (!(it->second->key == key))
+      continue;
+    entries.splice(entries.begin(), entries, it->second);
+    return &entries.front();
+  }
+  return nullptr;
+}
+
+void QueryCache::evictToCapacity() {
+  while (entries.size() > getCapacity()) {
+    auto last = std::prev(entries.end());
+    auto range = index.equal_range(last->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == last) {
+        index.erase(it);
+        break;
+      }
+    }
+    entries.pop_back();
+    ++stats.numEvictions;
+  }
+}
+
+static QueryCache &getQueryCache() {
+  static QueryCache cache;
+  return cache;
+}
+
+void presburger::setQueryCacheCapacity(size_t capacity) {
+  getQueryCache().setCapacity(capacity);
+}
+
+size_t presburger::getQueryCacheCapacity() {
+  return getQueryCache().getCapacity();
+}
+
+void presburger::clearQueryCache() { getQueryCache().clear(); }
+
+QueryCacheStats presburger::getQueryCacheStats() {
+  return getQueryCache().getStats();
+}
+
+/// Return the cache that queries on the current thread should use, or nullptr
+/// if caching is disabled.
+static QueryCache *getActiveQueryCache() {
+  if (SolverContext *context = SolverContext::getCurrent())
+    if (QueryCache *cache = context->getOwnQueryCache())
+      return cache;
+  QueryCache &cache = getQueryCache();
+  return cache.getCapacity() != 0 ? &cache : nullptr;
+}
+
+bool presburger::detail::isQueryCacheEnabled() {
+  return getActiveQueryCache() != nullptr;
+}
+
+std::optional<QueryResult>
+presburger::detail::lookupQuery(const QueryKey &key) {
+  if (QueryCache *cache = getActiveQueryCache())
+    return cache->lookup(key);
+  return {};
+}
+
+void presburger::detail::insertQuery(QueryKey key, QueryResult result) {
+  if (QueryCache *cache = getActiveQueryCache())
+    cache->insert(std::move(key), std::move(result));
+}
@@ -0,0 +1,581 @@
+//===- Serialization.cpp - MLIR Presburger Serialization ------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Serialization.h"
+#include "Utils.h"
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace mlir;
+using namespace presburger;
+
+static const uint8_t kMagic[4] = {'F', 'P', 'S', 'R'};
+/// The size of the magic, the version and the number of records.
+constexpr size_t kArchiveHeaderSize = 16;
+constexpr size_t kRecordHeaderSize = 8;
+/// The number of int64 counts before the constraints of an IntegerRelation
+/// record in the fixed int64 encoding.
+constexpr size_t kNumFixedCounts = 6;
+/// Coefficients with smaller magnitudes are encoded without an escape.
+constexpr int64_t kMaxUnescapedMagnitude = int64_t(1) << 62;
+/// Bound on the number of variables of a decoded space, so that counts from
+/// malformed data cannot overflow.
+constexpr uint64_t kMaxNumVars = std::numeric_limits<int32_t>::max();
+
+//===----------------------------------------------------------------------===//
+// Encoding
+//===----------------------------------------------------------------------===//
+
+static void writeFixed(std::vector<uint8_t> &out, uint64_t value,
+                       unsigned numBytes) {
+  for (unsigned i = 0; i < numBytes; ++i)
+    out.push_back(uint8_t(value >> (8 * i)));
+}
+
+static void writeVarint(std::vector<uint8_t> &out, uint64_t value) {
+  for (; value >= 0x80; value >>= 7)
+    out.push_back(uint8_t(value) | 0x80);
+  out.push_back(uint8_t(value));
+}
+
+static void writeCoefficient(std::vector<uint8_t> &out, const MPInt &value) {
+  int64_t small;
+  if (value.getIfSmall(small) && small < kMaxUnescapedMagnitude &&
+      small >= -kMaxUnescapedMagnitude) {
+    uint64_t zigzag = (uint64_t(small) << 1) ^ uint64_t(small >> 63);
+    writeVarint(out, zigzag << 1);
+    return;
+  }
+  std::vector<uint8_t> magnitude;
+  bool isNegative = value.getMagnitudeBytes(magnitude);
+  writeVarint(out, (((uint64_t(magnitude.size()) << 1) | isNegative) << 1) | 1);
+  out.insert(out.end(), magnitude.begin(), magnitude.end());
+}
+
+static void writeSpace(std::vector<uint8_t> &out,
+                       const PresburgerSpace &space) {
+  writeVarint(out, space.getNumDomainVars());
+  writeVarint(out, space.getNumRangeVars());
+  writeVarint(out, space.getNumSymbolVars());
+  writeVarint(out, space.getNumLocalVars());
+}
+
+static void writeRows(std::vector<uint8_t> &out, const Matrix &rows) {
+  for (unsigned r = 0, e = rows.getNumRows(); r < e; ++r)
+    for (const MPInt &coeff : rows.getRow(r))
+      writeCoefficient(out, coeff);
+}
+
+static void writeRelation(std::vector<uint8_t> &out,
+                          const IntegerRelation &rel) {
+  writeSpace(out, rel.getSpace());
+  writeVarint(out, rel.getNumEqualities());
+  writeVarint(out, rel.getNumInequalities());
+  for (unsigned r = 0, e = rel.getNumEqualities(); r < e; ++r)
+    for (const MPInt &coeff : rel.getEquality(r))
+      writeCoefficient(out, coeff);
+  for (unsigned r = 0, e = rel.getNumInequalities(); r < e; ++r)
+    for (const MPInt &coeff : rel.getInequality(r))
+      writeCoefficient(out, coeff);
+}
+
+static void writePresburgerRelation(std::vector<uint8_t> &out,
+                                    const PresburgerRelation &rel) {
+  writeSpace(out, rel.getSpace());
+  writeVarint(out, rel.getNumDisjuncts());
+  for (unsigned i = 0, e = rel.getNumDisjuncts(); i < e; ++i)
+    writeRelation(out, rel.getDisjunct(i));
+}
+
+/// Return whether all the coefficients of `rel` fit in an int64_t.
+static bool fitsInInt64(const IntegerRelation &rel) {
+  auto isSmall = [](const MPInt &x) {
+    int64_t small;
+    return x.getIfSmall(small);
+  };
+  for (unsigned r = 0, e = rel.getNumEqualities(); r < e; ++r)
+    if (!llvm::all_of(rel.getEquality(r), isSmall))
+      return false;
+  for (unsigned r = 0, e = rel.getNumInequalities(); r < e; ++r)
+    if (!llvm::all_of(rel.getInequality(r), isSmall))
+      return false;
+  return true;
+}
+
+void SerializationWriter::startRecord(RecordKind kind,
+                                      CoefficientEncoding recordEncoding) {
+  data.resize((data.size() + 7) / 8 * 8);
+  records.push_back(data.size());
+  data.push_back(static_cast<uint8_t>(kind));
+  data.push_back(static_cast<uint8_t>(recordEncoding));
+  data.resize(data.size() + kRecordHeaderSize - 2);
+}
+
+unsigned SerializationWriter::add(const PresburgerSpace &space) {
+  startRecord(RecordKind::PresburgerSpace, CoefficientEncoding::Varint);
+  writeSpace(data, space);
+  return records.size() - 1;
+}
+
+unsigned SerializationWriter::add(const IntegerRelation &rel) {
+  if (encoding != CoefficientEncoding::FixedInt64 || !fitsInInt64(rel)) {
+    startRecord(RecordKind::IntegerRelation, CoefficientEncoding::Varint);
+    writeRelation(data, rel);
+    return records.size() - 1;
+  }
+
+  startRecord(RecordKind::IntegerRelation, CoefficientEncoding::FixedInt64);
+  const PresburgerSpace &space = rel.getSpace();
+  for (unsigned count :
+       {space.getNumDomainVars(), space.getNumRangeVars(),
+        space.getNumSymbolVars(), space.getNumLocalVars(),
+        rel.getNumEqualities(), rel.getNumInequalities()})
+    writeFixed(data, count, 8);
+  for (unsigned r = 0, e = rel.getNumEqualities(); r < e; ++r)
+    for (const MPInt &coeff : rel.getEquality(r))
+      writeFixed(data, uint64_t(int64_t(coeff)), 8);
+  for (unsigned r = 0, e = rel.getNumInequalities(); r < e; ++r)
+    for (const MPInt &coeff : rel.getInequality(r))
+      writeFixed(data, uint64_t(int64_t(coeff)), 8);
+  return records.size() - 1;
+}
+
+unsigned SerializationWriter::add(const PresburgerRelation &rel) {
+  startRecord(RecordKind::PresburgerRelation, CoefficientEncoding::Varint);
+  writePresburgerRelation(data, rel);
+  return records.size() - 1;
+}
+
+unsigned SerializationWriter::add(const PWMAFunction &func) {
+  startRecord(RecordKind::PWMAFunction, CoefficientEncoding::Varint);
+  writeSpace(data, func.getSpace());
+  writeVarint(data, func.getNumPieces());
+  for (const PWMAFunction::Piece &piece : func.getAllPieces()) {
+    writePresburgerRelation(data, piece.domain);
+    const MultiAffineFunction &output = piece.output;
+    writeSpace(data, output.getSpace());
+    writeRows(data, output.getOutputMatrix());
+    const DivisionRepr &divs = output.getDivs();
+    for (unsigned i = 0, e = divs.getNumDivs(); i < e; ++i) {
+      writeCoefficient(data, divs.getDenom(i));
+      for (const MPInt &coeff : divs.getDividend(i))
+        writeCoefficient(data, coeff);
+    }
+  }
+  return records.size() - 1;
+}
+
+std::vector<uint8_t> SerializationWriter::finish() const {
+  std::vector<uint8_t> archive(kMagic, kMagic + 4);
+  writeFixed(archive, kSerializationVersion, 4);
+  writeFixed(archive, records.size(), 8);
+  uint64_t recordsStart = kArchiveHeaderSize + 8 * records.size();
+  for (uint64_t offset : records)
+    writeFixed(archive, recordsStart + offset, 8);
+  archive.insert(archive.end(), data.begin(), data.end());
+  return archive;
+}
+
+//===----------------------------------------------------------------------===//
+// Decoding
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// Reads the values written by the encoding functions above from a buffer.
+/// Every read checks the bounds of the buffer and returns false if the data
+/// is malformed.
+class ByteReader {
+public:
+  explicit ByteReader(ArrayRef<uint8_t> data) : data(data) {}
+
+  size_t getNumRemaining() const { return data.size() - pos; }
+
+  bool readFixed(uint64_t &value, unsigned numBytes) {
+    if (getNumRemaining() < numBytes)
+      return false;
+    value = 0;
+    for (unsigned i = 0; i < numBytes; ++i)
+      value |= uint64_t(data[pos + i]) << (8 * i);
+    pos += numBytes;
+    return true;
+  }
+
+  bool readVarint(uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (getNumRemaining() == 0)
+        return false;
+      uint8_t byte = data[pos++];
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  /// Read a count, encoded as a varint or as a fixed int64, that is at most
+  /// `limit`.
+  bool readCount(unsigned &count, bool isFixed, uint64_t limit = kMaxNumVars) {
+    uint64_t value;
+    if (!(isFixed ? readFixed(value, 8) : readVarint(value)) || value > limit)
+      return false;
+    count = value;
+    return true;
+  }
+
+  bool readCoefficient(MPInt &value, bool isFixed) {
+    uint64_t encoded;
+    if (isFixed) {
+      if (!readFixed(encoded, 8))
+        return false;
+      value = MPInt(int64_t(encoded));
+      return true;
+    }
+    if (!readVarint(encoded))
+      return false;
+    if (!(encoded & 1)) {
+      uint64_t zigzag = encoded >> 1;
+      value = MPInt(int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1));
+      return true;
+    }
+    uint64_t header = encoded >> 1;
+    uint64_t numBytes = header >> 1;
+    if (getNumRemaining() < numBytes)
+      return false;
+    value = MPInt::fromMagnitudeBytes(data.data() + pos, numBytes, header & 1);
+    pos += numBytes;
+    return true;
+  }
+
+private:
+  ArrayRef<uint8_t> data;
+  size_t pos = 0;
+};
+} // namespace
+
+static std::optional<PresburgerSpace> readSpace(ByteReader &reader,
+                                                bool isFixed) {
+  unsigned numDomain, numRange, numSymbols, numLocals;
+  if (!reader.readCount(numDomain, isFixed) ||
+      !reader.readCount(numRange, isFixed) ||
+      !reader.readCount(numSymbols, isFixed) ||
+      !reader.readCount(numLocals, isFixed))
+    return {};
+  if (uint64_t(numDomain) + numRange + numSymbols + numLocals > kMaxNumVars)
+    return {};
+  return PresburgerSpace::getRelationSpace(numDomain, numRange, numSymbols,
+                                           numLocals);
+}
+
+/// Return whether `numRows` rows of `minRowSize` coefficients each can fit in
+/// the remaining data. Every coefficient takes at least one byte, so this
+/// bounds what is allocated for the rows by the size of the data, and is
+/// checked before allocating anything for them. It also ensures the number of
+/// coefficients fits in an unsigned.
+static bool canFitRows(const ByteReader &reader, bool isFixed,
+                       uint64_t numRows, uint64_t minRowSize) {
+  if (numRows == 0 || minRowSize == 0)
+    return true;
+  uint64_t rowBytes = minRowSize * (isFixed ? 8 : 1);
+  return numRows <= reader.getNumRemaining() / rowBytes &&
+         numRows <= std::numeric_limits<unsigned>::max() / minRowSize;
+}
+
+/// Read `numRows` rows of `numCols` coefficients, passing each to `addRow`.
+/// Rows that cannot fit in the remaining data are rejected before anything is
+/// allocated for them.
+static bool readRows(ByteReader &reader, bool isFixed, unsigned numRows,
+                     unsigned numCols,
+                     llvm::function_ref<void(ArrayRef<MPInt>)> addRow) {
+  if (!canFitRows(reader, isFixed, numRows, numCols))
+    return false;
+  SmallVector<MPInt, 8> row(numCols);
+  for (unsigned r = 0; r < numRows; ++r) {
+    for (MPInt &coeff : row)
+      if (!reader.readCoefficient(coeff, isFixed))
+        return false;
+    addRow(row);
+  }
+  return true;
+}
+
+static std::optional<IntegerRelation> readRelation(ByteReader &reader,
+                                                   bool isFixed) {
+  std::optional<PresburgerSpace> space = readSpace(reader, isFixed);
+  unsigned numEqs, numIneqs;
+  if (!space || !reader.readCount(numEqs, isFixed, reader.getNumRemaining()) ||
+      !reader.readCount(numIneqs, isFixed, reader.getNumRemaining()))
+    return {};
+
+  unsigned numCols = space->getNumVars() + 1;
+  if (!canFitRows(reader, isFixed, uint64_t(numEqs) + numIneqs, numCols))
+    return {};
+  IntegerRelation rel(numIneqs, numEqs, numCols, *space);
+  if (!readRows(reader, isFixed, numEqs, numCols,
+                [&](ArrayRef<MPInt> eq) { rel.addEquality(eq); }) ||
+      !readRows(reader, isFixed, numIneqs, numCols,
+                [&](ArrayRef<MPInt> ineq) { rel.addInequality(ineq); }))
+    return {};
+  return rel;
+}
+
+static std::optional<PresburgerRelation>
+readPresburgerRelation(ByteReader &reader) {
+  std::optional<PresburgerSpace> space = readSpace(reader, /*isFixed=*/false);
+  unsigned numDisjuncts;
+  if (!space || space->getNumLocalVars() != 0 ||
+      !reader.readCount(numDisjuncts, /*isFixed=*/false,
+                        reader.getNumRemaining()))
+    return {};
+
+  PresburgerRelation result = PresburgerRelation::getEmpty(*space);
+  for (unsigned i = 0; i < numDisjuncts; ++i) {
+    std::optional<IntegerRelation> disjunct =
+        readRelation(reader, /*isFixed=*/false);
+    if (!disjunct || !disjunct->getSpace().isCompatible(*space))
+      return {};
+    result.unionInPlace(*disjunct);
+  }
+  return result;
+}
+
+static std::optional<MultiAffineFunction>
+readMultiAffineFunction(ByteReader &reader) {
+  std::optional<PresburgerSpace> space = readSpace(reader, /*isFixed=*/false);
+  if (!space)
+    return {};
+
+  unsigned numOutputs = space->getNumRangeVars();
+  unsigned numDivs = space->getNumLocalVars();
+  unsigned numNonDivs = space->getNumDomainVars() + space->getNumSymbolVars();
+  unsigned numCols = numNonDivs + numDivs + 1;
+  // Each div is a denominator followed by a dividend.
+  if (!canFitRows(reader, /*isFixed=*/false, numOutputs, numCols) ||
+      !canFitRows(reader, /*isFixed=*/false, numDivs, uint64_t(numCols) + 1))
+    return {};
+  Matrix output(numOutputs, numCols);
+  unsigned row = 0;
+  if (!readRows(reader, /*isFixed=*/false, numOutputs, output.getNumColumns(),
+                [&](ArrayRef<MPInt> expr) { output.setRow(row++, expr); }))
+    return {};
+
+  DivisionRepr divs(numNonDivs + numDivs, numDivs);
+  for (unsigned i = 0; i < numDivs; ++i) {
+    MPInt denom;
+    if (!reader.readCoefficient(denom, /*isFixed=*/false) || denom <= 0)
+      return {};
+    if (!readRows(reader, /*isFixed=*/false, 1, numCols,
+                  [&](ArrayRef<MPInt> dividend) {
+                    divs.setDiv(i, dividend, denom);
+                  }))
+      return {};
+  }
+  return MultiAffineFunction(*space, output, divs);
+}
+
+static std::optional<PWMAFunction> readPWMAFunction(ByteReader &reader) {
+  std::optional<PresburgerSpace> space = readSpace(reader, /*isFixed=*/false);
+  unsigned numPieces;
+  if (!space || space->getNumLocalVars() != 0 ||
+      !reader.readCount(numPieces, /*isFixed=*/false,
+                        reader.getNumRemaining()))
+    return {};
+
+  PWMAFunction func(*space);
+  for (unsigned i = 0; i < numPieces; ++i) {
+    std::optional<PresburgerRelation> domain = readPresburgerRelation(reader);
+    if (!domain || domain->getSpace().getNumDomainVars() != 0)
+      return {};
+    std::optional<MultiAffineFunction> output =
+        readMultiAffineFunction(reader);
+    if (!output ||
+        !output->getSpace().getSpaceWithoutLocals().isCompatible(*space))
+      return {};
+    PWMAFunction::Piece piece{PresburgerSet(*domain), *output};
+    if (!piece.isConsistent())
+      return {};
+    // The pieces are not checked to be disjoint, as that would need emptiness
+    // checks; archives written by SerializationWriter always satisfy this.
+    func.addPiece(piece);
+  }
+  return func;
+}
+
+//===----------------------------------------------------------------------===//
+// SerializedArchive
+//===----------------------------------------------------------------------===//
+
+uint64_t SerializedArchive::OffsetTable::operator[](size_t idx) const {
+  assert(idx < num && "Invalid record position");
+  uint64_t offset = 0;
+  for (unsigned i = 0; i < 8; ++i)
+    offset |= uint64_t(table[8 * idx + i]) << (8 * i);
+  return offset;
+}
+
+std::optional<SerializedArchive>
+SerializedArchive::get(ArrayRef<uint8_t> data) {
+  ByteReader reader(data);
+  uint64_t magic, version, numRecords;
+  if (!reader.readFixed(magic, 4) ||
+      std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0 ||
+      !reader.readFixed(version, 4) || version != kSerializationVersion ||
+      !reader.readFixed(numRecords, 8) ||
+      numRecords > reader.getNumRemaining() / 8)
+    return {};
+
+  SerializedArchive archive(
+      data, data.slice(kArchiveHeaderSize, numRecords * 8));
+  // Check that the records are aligned, in order, and have valid headers, so
+  // that the accessors only need to check the payloads.
+  uint64_t minOffset = kArchiveHeaderSize + numRecords * 8;
+  for (unsigned i = 0; i < numRecords; ++i) {
+    uint64_t offset = archive.offsets[i];
+    if (offset % 8 != 0 || offset < minOffset ||
+        data.size() < kRecordHeaderSize ||
+        offset > data.size() - kRecordHeaderSize ||
+        data[offset] > static_cast<uint8_t>(RecordKind::PWMAFunction) ||
+        data[offset + 1] >
+            static_cast<uint8_t>(CoefficientEncoding::FixedInt64))
+      return {};
+    minOffset = offset + kRecordHeaderSize;
+  }
+  return archive;
+}
+
+ArrayRef<uint8_t> SerializedArchive::getRecord(unsigned idx) const {
+  uint64_t begin = offsets[idx];
+  uint64_t end = idx + 1 < offsets.size() ? offsets[idx + 1] : data.size();
+  return data.slice(begin, end - begin);
+}
+
+RecordKind SerializedArchive::getKind(unsigned idx) const {
+  return static_cast<RecordKind>(getRecord(idx)[0]);
+}
+
+CoefficientEncoding SerializedArchive::getEncoding(unsigned idx) const {
+  return static_cast<CoefficientEncoding>(getRecord(idx)[1]);
+}
+
+std::optional<PresburgerSpace> SerializedArchive::getSpace(unsigned idx) const {
+  assert(getKind(idx) == RecordKind::PresburgerSpace && "Wrong record kind");
+  ByteReader reader(getRecord(idx).drop_front(kRecordHeaderSize));
+  return readSpace(reader, /*isFixed=*/false);
+}
+
+std::optional<IntegerRelation>
+SerializedArchive::getIntegerRelation(unsigned idx) const {
+  assert(getKind(idx) == RecordKind::IntegerRelation && "Wrong record kind");
+  ByteReader reader(getRecord(idx).drop_front(kRecordHeaderSize));
+  return readRelation(reader,
+                      getEncoding(idx) == CoefficientEncoding::FixedInt64);
+}
+
+std::optional<PresburgerRelation>
+SerializedArchive::getPresburgerRelation(unsigned idx) const {
+  assert(getKind(idx) == RecordKind::PresburgerRelation &&
+         "Wrong record kind");
+  ByteReader reader(getRecord(idx).drop_front(kRecordHeaderSize));
+  return readPresburgerRelation(reader);
+}
+
+std::optional<PWMAFunction>
+SerializedArchive::getPWMAFunction(unsigned idx) const {
+  assert(getKind(idx) == RecordKind::PWMAFunction && "Wrong record kind");
+  ByteReader reader(getRecord(idx).drop_front(kRecordHeaderSize));
+  return readPWMAFunction(reader);
+}
+
+static bool isLittleEndianHost() {
+  uint16_t value = 1;
+  uint8_t firstByte;
+  std::memcpy(&firstByte, &value, 1);
+  return firstByte == 1;
+}
+
+std::optional<IntegerRelationView>
+SerializedArchive::getIntegerRelationView(unsigned idx) const {
+  assert(getKind(idx) == RecordKind::IntegerRelation && "Wrong record kind");
+  if (getEncoding(idx) != CoefficientEncoding::FixedInt64 ||
+      !isLittleEndianHost())
+    return {};
+  ArrayRef<uint8_t> payload = getRecord(idx).drop_front(kRecordHeaderSize);
+  if (reinterpret_cast<uintptr_t>(payload.data()) % alignof(int64_t) != 0)
+    return {};
+
+  ByteReader reader(payload);
+  std::optional<PresburgerSpace> space = readSpace(reader, /*isFixed=*/true);
+  unsigned numEqs, numIneqs;
+  if (!space || !reader.readCount(numEqs, /*isFixed=*/true, payload.size()) ||
+      !reader.readCount(numIneqs, /*isFixed=*/true, payload.size()))
+    return {};
+  uint64_t numCols = space->getNumVars() + 1;
+  if ((uint64_t(numEqs) + numIneqs) * numCols > reader.getNumRemaining() / 8)
+    return {};
+
+  const int64_t *equalities =
+      reinterpret_cast<const int64_t *>(payload.data()) + kNumFixedCounts;
+  return IntegerRelationView(*space, numEqs, numIneqs, equalities,
+                             equalities + numEqs * numCols);
+}
+
+IntegerRelation IntegerRelationView::materialize() const {
+  IntegerRelation rel(numInequalities, numEqualities, getNumCols(), space);
+  for (unsigned r = 0; r < numEqualities; ++r)
+    rel.addEquality(getEquality(r));
+  for (unsigned r = 0; r < numInequalities; ++r)
+    rel.addInequality(getInequality(r));
+  return rel;
+}
+
+//===----------------------------------------------------------------------===//
+// MappedFile
+//===----------------------------------------------------------------------===//
+
+std::optional<MappedFile> MappedFile::open(const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return {};
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    ::close(fd);
+    return {};
+  }
+  size_t size = status.st_size;
+  if (size == 0) {
+    ::close(fd);
+    return MappedFile(nullptr, 0);
+  }
+  void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file is closed.
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return {};
+  return MappedFile(data, size);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    if (data)
+      ::munmap(data, size);
+    data = other.data;
+    size = other.size;
+    other.data = nullptr;
+    other.size = 0;
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() {
+  if (data)
+    ::munmap(data, size);
+}
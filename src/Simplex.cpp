@@ -8,6 +8,9 @@
 
 #include "Simplex.h"
 #include "Matrix.h"
+#include "Parallel.h"
+#include "Statistics.h"
+#include <cmath>
 #include <numeric>
 #include <optional>
 
@@ -283,10 +286,10 @@ std::optional<unsigned> LexSimplex::maybeGetNonIntegralVarRow() const {
   return {};
 }
 
-MaybeOptimum<SmallVector<MPInt, 8>> LexSimplex::findIntegerLexMin() {
+LogicalResult LexSimplex::restoreIntegerConsistency() {
   // We first try to make the tableau consistent.
   if (restoreRationalConsistency().failed())
-    return OptimumKind::Empty;
+    return failure();
 
   // Then, if the sample value is integral, we are done.
   while (std::optional<unsigned> maybeRow = maybeGetNonIntegralVarRow()) {
@@ -301,10 +304,16 @@ MaybeOptimum<SmallVector<MPInt, 8>> LexSimplex::findIntegerLexMin() {
     // Failure indicates that the tableau became empty, which occurs when the
     // polytope is integer empty.
     if (addCut(*maybeRow).failed())
-      return OptimumKind::Empty;
+      return failure();
     if (restoreRationalConsistency().failed())
-      return OptimumKind::Empty;
+      return failure();
   }
+  return success();
+}
+
+MaybeOptimum<SmallVector<MPInt, 8>> LexSimplex::findIntegerLexMin() {
+  if (restoreIntegerConsistency().failed())
+    return OptimumKind::Empty;
 
   MaybeOptimum<SmallVector<Fraction, 8>> sample = getRationalSample();
   assert(!sample.isEmpty() && "If we reached here the sample should exist!");
@@ -314,6 +323,29 @@ MaybeOptimum<SmallVector<MPInt, 8>> LexSimplex::findIntegerLexMin() {
       llvm::map_range(*sample, std::mem_fn(&Fraction::getAsInteger)));
 }
 
+std::optional<OptimumKind>
+LexSimplex::findIntegerLexMin(MutableArrayRef<int64_t> sample) {
+  assert(sample.size() == var.size() && "Incorrect sample size!");
+  if (restoreIntegerConsistency().failed())
+    return OptimumKind::Empty;
+
+  // Read the sample directly from the tableau, as in getRationalSample. Every
+  // value is an integer here, so no Fraction needs to be built.
+  for (unsigned i = 0, e = var.size(); i < e; ++i) {
+    const Unknown &u = var[i];
+    if (u.orientation == Orientation::Column)
+      return OptimumKind::Unbounded;
+    const MPInt &denom = tableau(u.pos, 0);
+    if (usingBigM && tableau(u.pos, 2) != denom)
+      return OptimumKind::Unbounded;
+    int64_t num, den;
+    if (!tableau(u.pos, 1).getIfSmall(num) || !denom.getIfSmall(den))
+      return std::nullopt;
+    sample[i] = den == 1 ? num : num / den;
+  }
+  return OptimumKind::Bounded;
+}
+
 bool LexSimplex::isSeparateInequality(ArrayRef<MPInt> coeffs) {
   SimplexRollbackScopeExit scopeExit(*this);
   addInequality(coeffs);
@@ -513,12 +545,35 @@ LogicalResult SymbolicLexSimplex::doNonBranchingPivots() {
   return success();
 }
 
-SymbolicLexMin SymbolicLexSimplex::computeSymbolicIntegerLexMin() {
+SymbolicLexMin
+SymbolicLexSimplex::computeSymbolicIntegerLexMin(unsigned parallelSplitDepth) {
   SymbolicLexMin result(PresburgerSpace::getRelationSpace(
       /*numDomain=*/domainPoly.getNumDimVars(),
       /*numRange=*/var.size() - nSymbol,
       /*numSymbols=*/domainPoly.getNumSymbolVars()));
 
+  std::vector<SymbolicLexSimplex> subproblems;
+  exploreSymbolDomain(result, parallelSplitDepth, subproblems);
+  if (subproblems.empty())
+    return result;
+
+  // The subproblems cover disjoint parts of the symbol domain, so their
+  // results can simply be concatenated, in order.
+  SmallVector<std::optional<SymbolicLexMin>, 8> subresults(subproblems.size());
+  parallelFor(0, subproblems.size(), [&](unsigned i) {
+    subresults[i] = subproblems[i].computeSymbolicIntegerLexMin();
+  });
+  for (const std::optional<SymbolicLexMin> &subresult : subresults) {
+    for (const PWMAFunction::Piece &piece : subresult->lexmin.getAllPieces())
+      result.lexmin.addPiece(piece);
+    result.unboundedDomain.unionInPlace(subresult->unboundedDomain);
+  }
+  return result;
+}
+
+void SymbolicLexSimplex::exploreSymbolDomain(
+    SymbolicLexMin &result, unsigned parallelSplitDepth,
+    std::vector<SymbolicLexSimplex> &subproblems) {
   /// The algorithm is more naturally expressed recursively, but we implement
   /// it iteratively here to avoid potential issues with stack overflows in the
   /// compiler. We explicitly maintain the stack frames in a vector.
@@ -577,6 +632,14 @@ SymbolicLexMin SymbolicLexSimplex::computeSymbolicIntegerLexMin() {
       }
 
       if (splitRow < getNumRows()) {
+        if (parallelSplitDepth != 0 && stack.size() == parallelSplitDepth) {
+          // Leave this part of the domain to a copy of the current state
+          // instead of recursing; return.
+          subproblems.push_back(*this);
+          --level;
+          continue;
+        }
+
         unsigned domainSnapshot = domainSimplex.getSnapshot();
         IntegerRelation::CountsSnapshot domainPolyCounts =
             domainPoly.getCounts();
@@ -660,8 +723,6 @@ SymbolicLexMin SymbolicLexSimplex::computeSymbolicIntegerLexMin() {
       continue;
     }
   }
-
-  return result;
 }
 
 bool LexSimplex::rowIsViolated(unsigned row) const {
@@ -860,23 +921,42 @@ unsigned LexSimplexBase::getLexMinPivotColumn(unsigned row, unsigned colA,
 /// negative, we need to decrease (increase) the value of the column. Also,
 /// we cannot decrease the sample value of restricted columns.
 ///
-/// If multiple columns are valid, we break ties by considering a lexicographic
-/// ordering where we prefer unknowns with lower index.
+/// If multiple columns are valid, the one with the best score under `rule` is
+/// chosen. We break ties, and choose among all the valid columns with Bland's
+/// rule, by considering a lexicographic ordering where we prefer unknowns with
+/// lower index. If some score cannot be computed, Bland's rule is used.
 std::optional<SimplexBase::Pivot>
-Simplex::findPivot(int row, Direction direction) const {
-  std::optional<unsigned> col;
+Simplex::findPivot(int row, Direction direction, PivotRule rule) const {
+  std::optional<unsigned> col, blandCol;
+  double bestScore = 0;
+  bool useBland = rule == PivotRule::Bland;
   for (unsigned j = 2, e = getNumColumns(); j < e; ++j) {
-    MPInt elem = tableau(row, j);
+    const MPInt &elem = tableau(row, j);
     if (elem == 0)
       continue;
 
     if (unknownFromColumn(j).restricted &&
         !signMatchesDirection(elem, direction))
       continue;
-    if (!col || colUnknown[j] < colUnknown[*col])
+    if (!blandCol || colUnknown[j] < colUnknown[*blandCol])
+      blandCol = j;
+    if (useBland)
+      continue;
+
+    std::optional<double> score = getPivotColumnScore(row, j, rule);
+    if (!score) {
+      useBland = true;
+      continue;
+    }
+    if (!col || *score > bestScore ||
+        (*score == bestScore && colUnknown[j] < colUnknown[*col])) {
       col = j;
+      bestScore = *score;
+    }
   }
 
+  if (useBland)
+    col = blandCol;
   if (!col)
     return {};
 
@@ -886,6 +966,55 @@ Simplex::findPivot(int row, Direction direction) const {
   return Pivot{maybePivotRow.value_or(row), *col};
 }
 
+/// The entries of a row share its denominator, so the coefficients of the
+/// columns in `row` can be compared directly. For the steepest edge rule, the
+/// norm of a column is computed over the rows that are not marked redundant,
+/// dividing each entry by the denominator of its row.
+std::optional<double> Simplex::getPivotColumnScore(unsigned row, unsigned col,
+                                                   PivotRule rule) const {
+  assert(rule != PivotRule::Bland && "Bland's rule has no score!");
+  int64_t elem;
+  if (!tableau(row, col).getIfSmall(elem))
+    return std::nullopt;
+  double coeff = static_cast<double>(elem);
+  if (rule == PivotRule::LargestCoeff)
+    return std::abs(coeff);
+
+  double normSquared = 1;
+  for (unsigned i = nRedundant, e = getNumRows(); i < e; ++i) {
+    if (i == row)
+      continue;
+    int64_t num, den;
+    if (!tableau(i, col).getIfSmall(num) || !tableau(i, 0).getIfSmall(den))
+      return std::nullopt;
+    if (num == 0)
+      continue;
+    double entry = static_cast<double>(num) / static_cast<double>(den);
+    normSquared += entry * entry;
+  }
+  int64_t rowDen;
+  if (!tableau(row, 0).getIfSmall(rowDen))
+    return std::nullopt;
+  coeff /= static_cast<double>(rowDen);
+  return coeff * coeff / normSquared;
+}
+
+/// A pivot is degenerate if the sample value of its row is zero, since the
+/// sample values of all the rows, including the optimized one, then stay the
+/// same. Bland's rule never cycles, so it needs no guard.
+void Simplex::guardAgainstCycling(Pivot pivot, PivotRule &rule,
+                                  unsigned &numDegenerate) const {
+  if (tableau(pivot.row, 1) != 0) {
+    numDegenerate = 0;
+    return;
+  }
+  FP_STAT_INC(NumDegeneratePivots);
+  if (rule == PivotRule::Bland || ++numDegenerate <= kMaxDegeneratePivots)
+    return;
+  FP_STAT_INC(NumPivotRuleFallbacks);
+  rule = PivotRule::Bland;
+}
+
 /// Swap the associated unknowns for the row and the column.
 ///
 /// First we swap the index associated with the row and column. Then we update
@@ -902,6 +1031,70 @@ void SimplexBase::swapRowWithCol(unsigned row, unsigned col) {
 
 void SimplexBase::pivot(Pivot pair) { pivot(pair.row, pair.column); }
 
+/// Copy `row` of the tableau into `vals` as int64_t values. Returns false if
+/// some element of the row is held in the large representation.
+static bool getRowIfSmall(const Matrix &tableau, unsigned row,
+                          SmallVectorImpl<int64_t> &vals) {
+  unsigned numCols = tableau.getNumColumns();
+  vals.resize(numCols);
+  for (unsigned col = 0; col < numCols; ++col)
+    if (!tableau(row, col).getIfSmall(vals[col]))
+      return false;
+  return true;
+}
+
+/// Perform the update of a non-pivot row `row` described in SimplexBase::pivot
+/// using only int64_t arithmetic, followed by normalizing the row by its GCD.
+/// `pivotRowVals` holds the already transformed and normalized pivot row.
+///
+/// The row is first copied into `scratch` and all arithmetic is done there
+/// with overflow checks whose results are accumulated rather than branched
+/// on, so that the inner loop is branch-free and amenable to vectorization.
+/// The tableau is only written to if the whole update succeeded. Returns false
+/// if some element of the row is large or if any intermediate result does not
+/// fit in 64 bits, in which case the tableau is left untouched and the caller
+/// must perform the update using MPInt arithmetic.
+static bool pivotRowInt64(Matrix &tableau, unsigned row, unsigned pivotCol,
+                          ArrayRef<int64_t> pivotRowVals,
+                          SmallVectorImpl<int64_t> &scratch) {
+  if (!getRowIfSmall(tableau, row, scratch))
+    return false;
+
+  unsigned numCols = pivotRowVals.size();
+  int64_t denom = pivotRowVals[0];
+  int64_t pivotColCoeff = scratch[pivotCol];
+  bool overflow = detail::mulOverflow(scratch[0], denom, scratch[0]);
+  for (unsigned col = 1; col < numCols; ++col) {
+    if (col == pivotCol)
+      continue;
+    // Add rather than subtract because the pivot row has been negated.
+    int64_t scaled, delta;
+    overflow |= detail::mulOverflow(scratch[col], denom, scaled);
+    overflow |= detail::mulOverflow(pivotColCoeff, pivotRowVals[col], delta);
+    overflow |= detail::addOverflow(scaled, delta, scratch[col]);
+  }
+  overflow |= detail::mulOverflow(pivotColCoeff, pivotRowVals[pivotCol],
+                                  scratch[pivotCol]);
+  if (FP_UNLIKELY(overflow))
+    return false;
+
+  // Taking the absolute value of the minimal int64_t overflows, so leave such
+  // rows to the MPInt path too.
+  int64_t gcd = 0;
+  for (unsigned col = 0; col < numCols; ++col) {
+    if (FP_UNLIKELY(scratch[col] == std::numeric_limits<int64_t>::min()))
+      return false;
+    gcd = std::gcd(gcd, scratch[col]);
+  }
+  if (gcd > 1)
+    for (unsigned col = 0; col < numCols; ++col)
+      scratch[col] /= gcd;
+
+  for (unsigned col = 0; col < numCols; ++col)
+    tableau(row, col) = MPInt(scratch[col]);
+  return true;
+}
+
 /// Pivot pivotRow and pivotCol.
 ///
 /// Let R be the pivot row unknown and let C be the pivot col unknown.
@@ -930,6 +1123,8 @@ void SimplexBase::pivot(Pivot pair) { pivot(pair.row, pair.column); }
 void SimplexBase::pivot(unsigned pivotRow, unsigned pivotCol) {
   assert(pivotCol >= getNumFixedCols() && "Refusing to pivot invalid column");
   assert(!unknownFromColumn(pivotCol).isSymbol);
+  FP_STAT_INC(NumPivots);
+  ++numPivots;
 
   swapRowWithCol(pivotRow, pivotCol);
   std::swap(tableau(pivotRow, 0), tableau(pivotRow, pivotCol));
@@ -948,18 +1143,55 @@ void SimplexBase::pivot(unsigned pivotRow, unsigned pivotCol) {
   }
   tableau.normalizeRow(pivotRow);
 
+  // If the pivot row has a unit denominator, the other rows are only changed
+  // in the columns where the pivot row is non-zero, and in the pivot column.
+  // Moreover, a row whose denominator is one needs no normalization. When the
+  // pivot row is sparse, only visit these columns.
+  if (sparsePivoting && tableau(pivotRow, 0) == 1) {
+    SmallVector<unsigned, 8> nonZeroCols;
+    for (unsigned col = 1, e = getNumColumns(); col < e; ++col)
+      if (col != pivotCol && tableau(pivotRow, col) != 0)
+        nonZeroCols.push_back(col);
+    if (nonZeroCols.size() * kSparsePivotRatio <= getNumColumns()) {
+      for (unsigned row = 0, numRows = getNumRows(); row < numRows; ++row) {
+        if (row == pivotRow)
+          continue;
+        if (tableau(row, pivotCol) == 0) // Nothing to do.
+          continue;
+        const MPInt &coeff = tableau(row, pivotCol);
+        // Add rather than subtract because the pivot row has been negated.
+        for (unsigned col : nonZeroCols)
+          tableau(row, col).addMul(coeff, tableau(pivotRow, col));
+        tableau(row, pivotCol) *= tableau(pivotRow, pivotCol);
+        if (tableau(row, 0) != 1)
+          tableau.normalizeRow(row);
+      }
+      return;
+    }
+  }
+
+  // In the common case all the entries fit in 64 bits, so we first try to
+  // update each row using int64_t arithmetic, falling back to MPInt arithmetic
+  // for rows where this is not possible.
+  SmallVector<int64_t, 16> pivotRowVals, scratch;
+  bool pivotRowIsSmall = getRowIfSmall(tableau, pivotRow, pivotRowVals);
+
   for (unsigned row = 0, numRows = getNumRows(); row < numRows; ++row) {
     if (row == pivotRow)
       continue;
     if (tableau(row, pivotCol) == 0) // Nothing to do.
       continue;
+    if (pivotRowIsSmall &&
+        pivotRowInt64(tableau, row, pivotCol, pivotRowVals, scratch))
+      continue;
     tableau(row, 0) *= tableau(pivotRow, 0);
     for (unsigned col = 1, numCols = getNumColumns(); col < numCols; ++col) {
       if (col == pivotCol)
         continue;
       // Add rather than subtract because the pivot row has been negated.
-      tableau(row, col) = tableau(row, col) * tableau(pivotRow, 0) +
-                          tableau(row, pivotCol) * tableau(pivotRow, col);
+      MPInt &elem = tableau(row, col);
+      elem *= tableau(pivotRow, 0);
+      elem.addMul(tableau(row, pivotCol), tableau(pivotRow, col));
     }
     tableau(row, pivotCol) *= tableau(pivotRow, pivotCol);
     tableau.normalizeRow(row);
@@ -973,11 +1205,14 @@ LogicalResult Simplex::restoreRow(Unknown &u) {
   assert(u.orientation == Orientation::Row &&
          "unknown should be in row position");
 
+  PivotRule rule = pivotRule;
+  unsigned numDegenerate = 0;
   while (tableau(u.pos, 1) < 0) {
-    std::optional<Pivot> maybePivot = findPivot(u.pos, Direction::Up);
+    std::optional<Pivot> maybePivot = findPivot(u.pos, Direction::Up, rule);
     if (!maybePivot)
       break;
 
+    guardAgainstCycling(*maybePivot, rule, numDegenerate);
     pivot(*maybePivot);
     if (u.orientation == Orientation::Column)
       return success(); // the unknown is unbounded above.
@@ -1266,6 +1501,7 @@ void SimplexBase::undo(UndoLogEntry entry) {
 /// We undo all the log entries until the log size when the snapshot was taken
 /// is reached.
 void SimplexBase::rollback(unsigned snapshot) {
+  FP_STAT_INC(NumRollbacks);
   while (undoLog.size() > snapshot) {
     undo(undoLog.back());
     undoLog.pop_back();
@@ -1319,16 +1555,25 @@ void SimplexBase::intersectIntegerRelation(const IntegerRelation &rel) {
     addEquality(rel.getEquality(i));
 }
 
-MaybeOptimum<Fraction> Simplex::computeRowOptimum(Direction direction,
-                                                  unsigned row) {
+bool Simplex::pivotRowToOptimum(Direction direction, unsigned row) {
   // Keep trying to find a pivot for the row in the specified direction.
-  while (std::optional<Pivot> maybePivot = findPivot(row, direction)) {
+  PivotRule rule = pivotRule;
+  unsigned numDegenerate = 0;
+  while (std::optional<Pivot> maybePivot = findPivot(row, direction, rule)) {
     // If findPivot returns a pivot involving the row itself, then the optimum
-    // is unbounded, so we return std::nullopt.
+    // is unbounded.
     if (maybePivot->row == row)
-      return OptimumKind::Unbounded;
+      return false;
+    guardAgainstCycling(*maybePivot, rule, numDegenerate);
     pivot(*maybePivot);
   }
+  return true;
+}
+
+MaybeOptimum<Fraction> Simplex::computeRowOptimum(Direction direction,
+                                                  unsigned row) {
+  if (!pivotRowToOptimum(direction, row))
+    return OptimumKind::Unbounded;
 
   // The row has reached its optimal sample value, which we return.
   // The sample value is the entry in the constant column divided by the common
@@ -1600,6 +1845,53 @@ MaybeOptimum<SmallVector<Fraction, 8>> LexSimplex::getRationalSample() const {
   return sample;
 }
 
+bool Simplex::getRationalSample(MutableArrayRef<int64_t> nums,
+                                MutableArrayRef<int64_t> dens) const {
+  assert(nums.size() == var.size() && dens.size() == var.size() &&
+         "Incorrect sample size!");
+  if (empty)
+    return false;
+
+  for (unsigned i = 0, e = var.size(); i < e; ++i) {
+    const Unknown &u = var[i];
+    if (u.orientation == Orientation::Column) {
+      nums[i] = 0;
+      dens[i] = 1;
+      continue;
+    }
+    if (!tableau(u.pos, 1).getIfSmall(nums[i]) ||
+        !tableau(u.pos, 0).getIfSmall(dens[i]))
+      return false;
+  }
+  return true;
+}
+
+bool Simplex::getSamplePointIfIntegral(MutableArrayRef<int64_t> sample) const {
+  assert(sample.size() == var.size() && "Incorrect sample size!");
+  if (empty)
+    return false;
+
+  for (unsigned i = 0, e = var.size(); i < e; ++i) {
+    const Unknown &u = var[i];
+    if (u.orientation == Orientation::Column) {
+      sample[i] = 0;
+      continue;
+    }
+    int64_t num, den;
+    if (!tableau(u.pos, 1).getIfSmall(num) ||
+        !tableau(u.pos, 0).getIfSmall(den))
+      return false;
+    if (den == 1) {
+      sample[i] = num;
+      continue;
+    }
+    if (num % den != 0)
+      return false;
+    sample[i] = num / den;
+  }
+  return true;
+}
+
 std::optional<SmallVector<MPInt, 8>> Simplex::getSamplePointIfIntegral() const {
   // If the tableau is empty, no sample point exists.
   if (empty)
@@ -1628,13 +1920,66 @@ std::optional<SmallVector<MPInt, 8>> Simplex::getSamplePointIfIntegral() const {
 /// also supports rolling back this addition, by maintaining a snapshot stack
 /// that contains a snapshot of the Simplex's state for each equality, just
 /// before that equality was added.
+///
+/// When used across the levels of findIntegerSample, it also supports fixing
+/// directions, i.e., adding the equalities dotProduct(dir, x) == value and
+/// dotProduct(dir, y) == value, which is equivalent to rebuilding it from the
+/// original simplex with the equality dotProduct(dir, x) == value added. The
+/// values of the directions that were already fixed in the original simplex
+/// when this was constructed are passed to the constructor, so that callers
+/// can tell when it has to be rebuilt.
 class presburger::GBRSimplex {
   using Orientation = Simplex::Orientation;
 
 public:
-  GBRSimplex(const Simplex &originalSimplex)
+  GBRSimplex(const Simplex &originalSimplex,
+             ArrayRef<MPInt> inheritedValues = {})
       : simplex(Simplex::makeProduct(originalSimplex, originalSimplex)),
-        simplexConstraintOffset(simplex.getNumConstraints()) {}
+        simplexConstraintOffset(simplex.getNumConstraints()),
+        fixedValues(inheritedValues.begin(), inheritedValues.end()),
+        numInheritedDirections(inheritedValues.size()) {}
+
+  /// Return the number of fixed directions, including the inherited ones.
+  unsigned getNumFixedDirections() const { return fixedValues.size(); }
+
+  /// Return the number of directions that were already fixed in the original
+  /// simplex. These cannot be removed.
+  unsigned getNumInheritedDirections() const { return numInheritedDirections; }
+
+  /// Return the value the `level`-th fixed direction was fixed to.
+  const MPInt &getFixedValue(unsigned level) const {
+    return fixedValues[level];
+  }
+
+  /// Add the equalities dotProduct(dir, x) == value and
+  /// dotProduct(dir, y) == value. This can only be done while no equalities
+  /// for directions are present.
+  void fixDirection(ArrayRef<MPInt> dir, const MPInt &value) {
+    assert(snapshotStack.empty() &&
+           "Cannot fix a direction while direction equalities are present!");
+    fixedSnapshotStack.push_back(simplex.getSnapshot());
+    unsigned numDims = dir.size();
+    SmallVector<MPInt, 8> coeffs(2 * numDims + 1, MPInt(0));
+    std::copy(dir.begin(), dir.end(), coeffs.begin());
+    coeffs.back() = -value;
+    simplex.addEquality(coeffs);
+    std::fill(coeffs.begin(), coeffs.begin() + numDims, MPInt(0));
+    std::copy(dir.begin(), dir.end(), coeffs.begin() + numDims);
+    simplex.addEquality(coeffs);
+    simplexConstraintOffset = simplex.getNumConstraints();
+    fixedValues.push_back(value);
+  }
+
+  /// Remove the equalities added by the last call to fixDirection.
+  void removeLastFixedDirection() {
+    assert(!fixedSnapshotStack.empty() && "No fixed direction to remove!");
+    assert(snapshotStack.empty() &&
+           "Cannot unfix a direction while direction equalities are present!");
+    simplex.rollback(fixedSnapshotStack.back());
+    fixedSnapshotStack.pop_back();
+    simplexConstraintOffset = simplex.getNumConstraints();
+    fixedValues.pop_back();
+  }
 
   /// Add an equality dotProduct(dir, x - y) == 0.
   /// First pushes a snapshot for the current simplex state to the stack so
@@ -1720,6 +2065,15 @@ public:
     snapshotStack.pop_back();
   }
 
+  /// Remove all the equalities that were added through
+  /// addEqualityForDirection.
+  void removeAllEqualities() {
+    if (snapshotStack.empty())
+      return;
+    simplex.rollback(snapshotStack.front());
+    snapshotStack.clear();
+  }
+
 private:
   /// Returns coefficients of the expression 'dot_product(dir, x - y)',
   /// i.e.,   dir_1 * x_1 + dir_2 * x_2 + ... + dir_n * x_n
@@ -1738,12 +2092,35 @@ private:
 
   Simplex simplex;
   /// The first index of the equality constraints, the index immediately after
-  /// the last constraint in the initial product simplex.
+  /// the last constraint in the product simplex with the fixed directions.
   unsigned simplexConstraintOffset;
   /// A stack of snapshots, used for rolling back.
   SmallVector<unsigned, 8> snapshotStack;
+  /// The snapshots taken just before each (non-inherited) direction was fixed.
+  SmallVector<unsigned, 8> fixedSnapshotStack;
+  /// The values the fixed directions were fixed to, starting with the
+  /// inherited ones.
+  SmallVector<MPInt, 8> fixedValues;
+  unsigned numInheritedDirections;
 };
 
+/// Return whether x < scale * y, where the denominators are positive. In the
+/// common case where the cross products fit in 64 bits, they are compared
+/// directly instead of going through MPInt temporaries.
+static bool isLessThanScaled(const Fraction &x, const Fraction &scale,
+                             const Fraction &y) {
+  if (FP_LIKELY(x.num.isSmall() && x.den.isSmall() && scale.num.isSmall() &&
+                scale.den.isSmall() && y.num.isSmall() && y.den.isSmall())) {
+    int64_t lhs, rhs, tmp;
+    if (!detail::mulOverflow(x.num.getSmall(), scale.den.getSmall(), tmp) &&
+        !detail::mulOverflow(tmp, y.den.getSmall(), lhs) &&
+        !detail::mulOverflow(scale.num.getSmall(), y.num.getSmall(), tmp) &&
+        !detail::mulOverflow(tmp, x.den.getSmall(), rhs))
+      return lhs < rhs;
+  }
+  return x < scale * y;
+}
+
 /// Reduce the basis to try and find a direction in which the polytope is
 /// "thin". This only works for bounded polytopes.
 ///
@@ -1799,14 +2176,22 @@ private:
 ///
 /// When incrementing i, no cached f values get invalidated. However, the cached
 /// duals do get invalidated as the duals for the higher levels are different.
-void Simplex::reduceBasis(Matrix &basis, unsigned level) {
+///
+/// If `levelWidth` is given, it is used as the value of width_level(b_level)
+/// instead of computing it. The caller usually knows it already, since it is
+/// the difference between the maximum and the minimum of <b_level, x> over the
+/// polytope. On return, `gbrSimplex` has no equalities for directions.
+void Simplex::reduceBasis(Matrix &basis, unsigned level, GBRSimplex &gbrSimplex,
+                          std::optional<Fraction> levelWidth) {
   const Fraction epsilon(3, 4);
 
   if (level == basis.getNumRows() - 1)
     return;
+  FP_STAT_INC(NumBasisReductions);
 
-  GBRSimplex gbrSimplex(*this);
   SmallVector<Fraction, 8> width;
+  if (levelWidth)
+    width.push_back(*levelWidth);
   SmallVector<MPInt, 8> dual;
   MPInt dualDenom;
 
@@ -1848,7 +2233,8 @@ void Simplex::reduceBasis(Matrix &basis, unsigned level) {
       widthI[1] = gbrSimplex.computeWidthAndDuals(
           basis.getRow(i + 1), candidateDual[1], candidateDualDenom[1]);
 
-      unsigned j = widthI[0] < widthI[1] ? 0 : 1;
+      unsigned j =
+          isLessThanScaled(widthI[0], Fraction(1, 1), widthI[1]) ? 0 : 1;
       if (j == 0)
         // Subtract 1 to go from u = ceil(dual) back to floor(dual).
         basis.addToRow(i, i + 1, -1);
@@ -1917,7 +2303,7 @@ void Simplex::reduceBasis(Matrix &basis, unsigned level) {
 
     // This variable stores width_i(b_{i+1} + u*b_i).
     Fraction widthICandidate = updateBasisWithUAndGetFCandidate(i);
-    if (widthICandidate < epsilon * width[i - level]) {
+    if (isLessThanScaled(widthICandidate, epsilon, width[i - level])) {
       basis.swapRows(i, i + 1);
       width[i - level] = widthICandidate;
       // The values of width_{i+1}(b_{i+1}) and higher may change after the
@@ -1938,6 +2324,7 @@ void Simplex::reduceBasis(Matrix &basis, unsigned level) {
     gbrSimplex.addEqualityForDirection(basis.getRow(i));
     i++;
   }
+  gbrSimplex.removeAllEqualities();
 }
 
 /// Search for an integer sample point using a branch and bound algorithm.
@@ -1986,6 +2373,41 @@ std::optional<SmallVector<MPInt, 8>> Simplex::findIntegerSample() {
   snapshotStack.reserve(basis.getNumRows());
   upperBoundStack.reserve(basis.getNumRows());
   nextValueStack.reserve(basis.getNumRows());
+
+  // With incremental basis reduction, the product simplex used for basis
+  // reduction is kept across levels. It is brought up to date with the values
+  // the directions of the earlier levels are currently fixed to, and is only
+  // rebuilt when one of the directions it inherited has changed.
+  std::optional<GBRSimplex> gbrSimplex;
+  auto getGBRSimplex = [&]() -> GBRSimplex & {
+    // The value the direction of level j < level is currently fixed to.
+    auto getValue = [&](unsigned j) { return nextValueStack[j] - 1; };
+
+    unsigned numValid = 0;
+    if (gbrSimplex) {
+      unsigned numFixed = std::min(gbrSimplex->getNumFixedDirections(), level);
+      while (numValid < numFixed &&
+             gbrSimplex->getFixedValue(numValid) == getValue(numValid))
+        ++numValid;
+      if (numValid < gbrSimplex->getNumInheritedDirections())
+        gbrSimplex.reset();
+    }
+
+    if (!gbrSimplex) {
+      SmallVector<MPInt, 8> values;
+      for (unsigned j = 0; j < level; ++j)
+        values.push_back(getValue(j));
+      gbrSimplex.emplace(*this, values);
+      return *gbrSimplex;
+    }
+
+    while (gbrSimplex->getNumFixedDirections() > numValid)
+      gbrSimplex->removeLastFixedDirection();
+    for (unsigned j = numValid; j < level; ++j)
+      gbrSimplex->fixDirection(basis.getRow(j), getValue(j));
+    return *gbrSimplex;
+  };
+
   while (level != -1u) {
     if (level == basis.getNumRows()) {
       // We've assigned values to all variables. Return if we have a sample,
@@ -2001,11 +2423,17 @@ std::optional<SmallVector<MPInt, 8>> Simplex::findIntegerSample() {
       // just come down a level ("recursed"). Find the lower and upper bounds.
       // If there is more than one integer point in the range, perform
       // generalized basis reduction.
+      FP_STAT_INC(NumGBRLevels);
       SmallVector<MPInt, 8> basisCoeffs =
           llvm::to_vector<8>(basis.getRow(level));
       basisCoeffs.emplace_back(0);
 
-      auto [minRoundedUp, maxRoundedDown] = computeIntegerBounds(basisCoeffs);
+      MaybeOptimum<Fraction> minimum =
+          computeOptimum(Simplex::Direction::Down, basisCoeffs);
+      MaybeOptimum<Fraction> maximum =
+          computeOptimum(Simplex::Direction::Up, basisCoeffs);
+      MaybeOptimum<MPInt> minRoundedUp = minimum.map(ceil);
+      MaybeOptimum<MPInt> maxRoundedDown = maximum.map(floor);
 
       // We don't have any integer values in the range.
       // Pop the stack and return up a level.
@@ -2029,7 +2457,17 @@ std::optional<SmallVector<MPInt, 8>> Simplex::findIntegerSample() {
         return *maybeSample;
 
       if (*minRoundedUp < *maxRoundedDown) {
-        reduceBasis(basis, level);
+        // The width of the polytope along the direction of this level, which
+        // basis reduction would otherwise compute again.
+        Fraction levelWidth(maximum->num * minimum->den -
+                                minimum->num * maximum->den,
+                            maximum->den * minimum->den);
+        if (incrementalBasisReduction) {
+          reduceBasis(basis, level, getGBRSimplex(), levelWidth);
+        } else {
+          GBRSimplex freshGBRSimplex(*this);
+          reduceBasis(basis, level, freshGBRSimplex, levelWidth);
+        }
         basisCoeffs = llvm::to_vector<8>(basis.getRow(level));
         basisCoeffs.emplace_back(0);
         std::tie(minRoundedUp, maxRoundedDown) =
@@ -2076,6 +2514,23 @@ std::optional<SmallVector<MPInt, 8>> Simplex::findIntegerSample() {
   return {};
 }
 
+std::optional<bool>
+Simplex::findIntegerSample(MutableArrayRef<int64_t> sample) {
+  assert(sample.size() == var.size() && "Incorrect sample size!");
+  if (empty)
+    return false;
+  if (getSamplePointIfIntegral(sample))
+    return true;
+
+  std::optional<SmallVector<MPInt, 8>> found = findIntegerSample();
+  if (!found)
+    return false;
+  for (unsigned i = 0, e = found->size(); i < e; ++i)
+    if (!(*found)[i].getIfSmall(sample[i]))
+      return std::nullopt;
+  return true;
+}
+
 /// Compute the minimum and maximum integer values the expression can take. We
 /// compute each separately.
 std::pair<MaybeOptimum<MPInt>, MaybeOptimum<MPInt>>
@@ -2087,6 +2542,40 @@ Simplex::computeIntegerBounds(ArrayRef<MPInt> coeffs) {
   return {minRoundedUp, maxRoundedDown};
 }
 
+bool Simplex::computeIntegerOptimum(Direction direction,
+                                    ArrayRef<MPInt> coeffs,
+                                    MaybeOptimum<int64_t> &result) {
+  if (empty) {
+    result = OptimumKind::Empty;
+    return true;
+  }
+
+  SimplexRollbackScopeExit scopeExit(*this);
+  unsigned row = con[addRow(coeffs)].pos;
+  if (!pivotRowToOptimum(direction, row)) {
+    result = OptimumKind::Unbounded;
+    return true;
+  }
+  int64_t num, den;
+  if (!tableau(row, 1).getIfSmall(num) || !tableau(row, 0).getIfSmall(den))
+    return false;
+  if (den == 1)
+    result = num;
+  else
+    result = direction == Direction::Down
+                 ? ::presburger::math::ceilDiv(num, den)
+                 : ::presburger::math::floorDiv(num, den);
+  return true;
+}
+
+bool Simplex::computeIntegerBounds(ArrayRef<int64_t> coeffs,
+                                   MaybeOptimum<int64_t> &min,
+                                   MaybeOptimum<int64_t> &max) {
+  SmallVector<MPInt, 8> row(coeffs.begin(), coeffs.end());
+  return computeIntegerOptimum(Direction::Down, row, min) &&
+         computeIntegerOptimum(Direction::Up, row, max);
+}
+
 void SimplexBase::print(raw_ostream &os) const {
   os << "rows = " << getNumRows() << ", columns = " << getNumColumns() << "\n";
   if (empty)
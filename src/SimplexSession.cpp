@@ -0,0 +1,73 @@
+//===- SimplexSession.cpp - MLIR SimplexSession Class ---------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "SimplexSession.h"
+
+using namespace mlir;
+using namespace presburger;
+
+SimplexSession::SimplexSession(const IntegerRelation &base)
+    : simplex(base), rel(base) {}
+
+void SimplexSession::push() {
+  levels.push_back({simplex.getSnapshot(), rel.getCounts()});
+}
+
+void SimplexSession::pop() {
+  assert(!levels.empty() && "no level to pop!");
+  const Level &level = levels.back();
+  simplex.rollback(level.snapshot);
+  rel.truncate(level.counts);
+  levels.pop_back();
+  if (boundedDepth && *boundedDepth > levels.size())
+    boundedDepth.reset();
+}
+
+void SimplexSession::addInequality(ArrayRef<MPInt> coeffs) {
+  assert(coeffs.size() == rel.getNumCols() &&
+         "incorrect number of coefficients!");
+  simplex.addInequality(coeffs);
+  rel.addInequality(coeffs);
+}
+
+void SimplexSession::addEquality(ArrayRef<MPInt> coeffs) {
+  assert(coeffs.size() == rel.getNumCols() &&
+         "incorrect number of coefficients!");
+  simplex.addEquality(coeffs);
+  rel.addEquality(coeffs);
+}
+
+void SimplexSession::intersect(const IntegerRelation &other) {
+  simplex.intersectIntegerRelation(other);
+  rel.append(other);
+}
+
+bool SimplexSession::isBounded() {
+  if (boundedDepth)
+    return true;
+  // isUnbounded only pivots the tableau; the constraints are not changed.
+  if (simplex.isUnbounded())
+    return false;
+  boundedDepth = levels.size();
+  return true;
+}
+
+std::optional<SmallVector<MPInt, 8>> SimplexSession::findIntegerSample() {
+  if (simplex.isEmpty())
+    return {};
+
+  // The GBR sampling algorithm only works for bounded sets, so let
+  // IntegerRelation deal with the unbounded case from scratch.
+  if (!isBounded())
+    return rel.findIntegerSample();
+
+  // Simplex::findIntegerSample may leave extra constraints in the tableau, so
+  // roll them back before returning.
+  SimplexRollbackScopeExit scope(simplex);
+  return simplex.findIntegerSample();
+}
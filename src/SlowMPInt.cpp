@@ -23,8 +23,27 @@ SlowMPInt::SlowMPInt(const mpz_t &val) {
   mpz_init(this->val);
   mpz_set(this->val, val);
 }
-SlowMPInt::SlowMPInt(const SlowMPInt &val) { mpz_set(this->val, val.val); }
-SlowMPInt &SlowMPInt::operator=(int64_t val) { return *this = SlowMPInt(val); }
+SlowMPInt::SlowMPInt(const SlowMPInt &val) {
+  mpz_init_set(this->val, val.val);
+}
+// mpz_init does not allocate, so moving is just a swap with a fresh zero.
+SlowMPInt::SlowMPInt(SlowMPInt &&val) noexcept {
+  mpz_init(this->val);
+  mpz_swap(this->val, val.val);
+}
+SlowMPInt::~SlowMPInt() { mpz_clear(val); }
+SlowMPInt &SlowMPInt::operator=(const SlowMPInt &o) {
+  mpz_set(val, o.val);
+  return *this;
+}
+SlowMPInt &SlowMPInt::operator=(SlowMPInt &&o) noexcept {
+  mpz_swap(val, o.val);
+  return *this;
+}
+SlowMPInt &SlowMPInt::operator=(int64_t val) {
+  mpz_set_si(this->val, val);
+  return *this;
+}
 SlowMPInt::operator int64_t() const { return mpz_get_si(val); }
 
 std::size_t std::hash<presburger::detail::SlowMPInt>::operator()(
@@ -43,6 +62,26 @@ std::size_t std::hash<presburger::detail::SlowMPInt>::operator()(
 /// Printing.
 /// ---------------------------------------------------------------------------
 void SlowMPInt::print(std::ostream &os) const { os << val; }
+
+bool SlowMPInt::getMagnitudeBytes(std::vector<uint8_t> &bytes) const {
+  bytes.resize((mpz_sizeinbase(val, 2) + 7) / 8);
+  size_t count = 0;
+  mpz_export(bytes.data(), &count, /*order=*/-1, /*size=*/1, /*endian=*/0,
+             /*nails=*/0, val);
+  // mpz_export writes nothing for zero.
+  bytes.resize(count);
+  return mpz_sgn(val) < 0;
+}
+
+SlowMPInt SlowMPInt::fromMagnitudeBytes(const uint8_t *bytes, size_t numBytes,
+                                        bool isNegative) {
+  SlowMPInt result;
+  mpz_import(result.val, numBytes, /*order=*/-1, /*size=*/1, /*endian=*/0,
+             /*nails=*/0, bytes);
+  if (isNegative)
+    mpz_neg(result.val, result.val);
+  return result;
+}
 void SlowMPInt::dump() const { print(std::cerr); }
 std::ostream &detail::operator<<(std::ostream &os,
                                       const SlowMPInt &x) {
@@ -53,14 +92,34 @@ std::ostream &detail::operator<<(std::ostream &os,
 /// ---------------------------------------------------------------------------
 /// Convenience operator overloads for int64_t.
 /// ---------------------------------------------------------------------------
+// GMP only provides unsigned variants of the int64_t operations, so adding a
+// negative value is done by subtracting its magnitude. The magnitude is
+// computed in unsigned arithmetic so that negating the minimal int64_t does
+// not overflow.
+static_assert(sizeof(unsigned long) >= sizeof(int64_t),
+              "mpz_*_ui functions must accept all int64_t magnitudes");
+static unsigned long magnitude(int64_t x) {
+  return x >= 0 ? static_cast<unsigned long>(x)
+                : 0ul - static_cast<unsigned long>(x);
+}
+
 SlowMPInt &detail::operator+=(SlowMPInt &a, int64_t b) {
-  return a += SlowMPInt(b);
+  if (b >= 0)
+    mpz_add_ui(a.val, a.val, magnitude(b));
+  else
+    mpz_sub_ui(a.val, a.val, magnitude(b));
+  return a;
 }
 SlowMPInt &detail::operator-=(SlowMPInt &a, int64_t b) {
-  return a -= SlowMPInt(b);
+  if (b >= 0)
+    mpz_sub_ui(a.val, a.val, magnitude(b));
+  else
+    mpz_add_ui(a.val, a.val, magnitude(b));
+  return a;
 }
 SlowMPInt &detail::operator*=(SlowMPInt &a, int64_t b) {
-  return a *= SlowMPInt(b);
+  mpz_mul_si(a.val, a.val, b);
+  return a;
 }
 SlowMPInt &detail::operator/=(SlowMPInt &a, int64_t b) {
   return a /= SlowMPInt(b);
@@ -242,23 +301,23 @@ SlowMPInt SlowMPInt::operator-() const {
 /// Assignment operators, preincrement, predecrement.
 /// ---------------------------------------------------------------------------
 SlowMPInt &SlowMPInt::operator+=(const SlowMPInt &o) {
-  *this = *this + o;
+  mpz_add(val, val, o.val);
   return *this;
 }
 SlowMPInt &SlowMPInt::operator-=(const SlowMPInt &o) {
-  *this = *this - o;
+  mpz_sub(val, val, o.val);
   return *this;
 }
 SlowMPInt &SlowMPInt::operator*=(const SlowMPInt &o) {
-  *this = *this * o;
+  mpz_mul(val, val, o.val);
   return *this;
 }
 SlowMPInt &SlowMPInt::operator/=(const SlowMPInt &o) {
-  *this = *this / o;
+  mpz_tdiv_q(val, val, o.val);
   return *this;
 }
 SlowMPInt &SlowMPInt::operator%=(const SlowMPInt &o) {
-  *this = *this % o;
+  mpz_mod(val, val, o.val);
   return *this;
 }
 SlowMPInt &SlowMPInt::operator++() {
@@ -270,3 +329,30 @@ SlowMPInt &SlowMPInt::operator--() {
   *this -= 1;
   return *this;
 }
+
+/// ---------------------------------------------------------------------------
+/// Fused multiply-add.
+/// ---------------------------------------------------------------------------
+SlowMPInt &SlowMPInt::addMul(const SlowMPInt &a, const SlowMPInt &b) {
+  mpz_addmul(val, a.val, b.val);
+  return *this;
+}
+SlowMPInt &SlowMPInt::subMul(const SlowMPInt &a, const SlowMPInt &b) {
+  mpz_submul(val, a.val, b.val);
+  return *this;
+}
+
+SlowMPInt &SlowMPInt::addMul(const SlowMPInt &a, int64_t b) {
+  if (b >= 0)
+    mpz_addmul_ui(val, a.val, magnitude(b));
+  else
+    mpz_submul_ui(val, a.val, magnitude(b));
+  return *this;
+}
+SlowMPInt &SlowMPInt::subMul(const SlowMPInt &a, int64_t b) {
+  if (b >= 0)
+    mpz_submul_ui(val, a.val, magnitude(b));
+  else
+    mpz_addmul_ui(val, a.val, magnitude(b));
+  return *this;
+}
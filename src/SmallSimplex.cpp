@@ -0,0 +1,127 @@
+//===- SmallSimplex.cpp - MLIR SmallSimplex Class -------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "SmallSimplex.h"
+#include "IntegerRelation.h"
+
+using namespace mlir;
+using namespace presburger;
+
+/// The maximum number of nodes visited by the branch and bound search of
+/// isIntegerEmptyBySmallSimplex before it gives up.
+static constexpr unsigned kMaxSmallSimplexNodes = 64;
+
+namespace {
+enum class SearchResult { Empty, Found, GaveUp };
+} // namespace
+
+/// Search for an integer point in `simplex` by branch and bound: if the sample
+/// value of some variable v is not an integer, the integer points are those
+/// with v <= floor(v) and those with v >= ceil(v), which are searched in turn.
+/// Every branch has one more constraint, so the tableau of each node is a copy
+/// of its parent's.
+template <unsigned MaxVars, unsigned MaxRows>
+static SearchResult findSample(const SmallSimplex<MaxVars, MaxRows> &simplex,
+                               unsigned &numNodes,
+                               SmallVectorImpl<MPInt> &sample) {
+  if (simplex.hasFailed())
+    return SearchResult::GaveUp;
+  if (simplex.isEmpty())
+    return SearchResult::Empty;
+  if (++numNodes > kMaxSmallSimplexNodes)
+    return SearchResult::GaveUp;
+
+  unsigned numVars = simplex.getNumVars();
+  for (unsigned var = 0; var < numVars; ++var) {
+    auto [num, denom] = simplex.getSampleValue(var);
+    if (num % denom == 0)
+      continue;
+
+    std::array<int64_t, MaxVars + 1> coeffs{};
+    // -v + floor(v) >= 0.
+    coeffs[var] = -1;
+    coeffs[numVars] = ::presburger::math::floorDiv(num, denom);
+    SmallSimplex<MaxVars, MaxRows> lower = simplex;
+    lower.addInequality(coeffs.data());
+    SearchResult result = findSample(lower, numNodes, sample);
+    if (result != SearchResult::Empty)
+      return result;
+
+    // v - ceil(v) >= 0.
+    coeffs[var] = 1;
+    coeffs[numVars] = -::presburger::math::ceilDiv(num, denom);
+    SmallSimplex<MaxVars, MaxRows> upper = simplex;
+    upper.addInequality(coeffs.data());
+    return findSample(upper, numNodes, sample);
+  }
+
+  sample.clear();
+  for (unsigned var = 0; var < numVars; ++var) {
+    auto [num, denom] = simplex.getSampleValue(var);
+    sample.emplace_back(num / denom);
+  }
+  return SearchResult::Found;
+}
+
+template <unsigned MaxVars, unsigned MaxRows>
+static std::optional<bool>
+isIntegerEmptyBySmallSimplexImpl(const IntegerRelation &rel,
+                                 SmallVectorImpl<MPInt> &sample) {
+  SmallSimplex<MaxVars, MaxRows> simplex(rel.getNumVars());
+  std::array<int64_t, MaxVars + 1> coeffs{};
+  // Add the constraint `row >= 0`, or `-row >= 0` if `negate` is true.
+  // Returns false if some coefficient does not fit in an int64_t.
+  auto addRow = [&](ArrayRef<MPInt> row, bool negate) {
+    for (unsigned i = 0, e = row.size(); i < e; ++i) {
+      if (!row[i].getIfSmall(coeffs[i]))
+        return false;
+      if (negate) {
+        if (coeffs[i] == std::numeric_limits<int64_t>::min())
+          return false;
+        coeffs[i] = -coeffs[i];
+      }
+    }
+    simplex.addInequality(coeffs.data());
+    return true;
+  };
+
+  // Add the inequalities first, and the equalities as pairs of inequalities,
+  // as Simplex does.
+  for (unsigned i = 0, e = rel.getNumInequalities(); i < e; ++i)
+    if (!addRow(rel.getInequality(i), /*negate=*/false))
+      return std::nullopt;
+  for (unsigned i = 0, e = rel.getNumEqualities(); i < e; ++i)
+    if (!addRow(rel.getEquality(i), /*negate=*/false) ||
+        !addRow(rel.getEquality(i), /*negate=*/true))
+      return std::nullopt;
+
+  unsigned numNodes = 0;
+  switch (findSample(simplex, numNodes, sample)) {
+  case SearchResult::Empty:
+    return true;
+  case SearchResult::Found:
+    return false;
+  case SearchResult::GaveUp:
+    break;
+  }
+  return std::nullopt;
+}
+
+std::optional<bool>
+presburger::isIntegerEmptyBySmallSimplex(const IntegerRelation &rel,
+                                         SmallVectorImpl<MPInt> &sample) {
+  // Each instantiation leaves room for a few levels of branching beyond the
+  // rows of the relation.
+  unsigned numVars = rel.getNumVars();
+  unsigned numRows = rel.getNumInequalities() + 2 * rel.getNumEqualities();
+  if (numVars <= 3 && numRows <= 12)
+    return isIntegerEmptyBySmallSimplexImpl<3, 16>(rel, sample);
+  if (numVars <= 6 && numRows <= 24)
+    return isIntegerEmptyBySmallSimplexImpl<6, 32>(rel, sample);
+  return std::nullopt;
+}
@@ -0,0 +1,93 @@
+//===- SolverContext.cpp - MLIR Presburger Solver Context -----------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverContext.h"
+#include <cassert>
+
+using namespace mlir;
+using namespace presburger;
+
+/// The innermost scope alive on this thread, if any.
+static thread_local SolverContextScope *currentScope = nullptr;
+/// The context of `currentScope`.
+static thread_local SolverContext *currentContext = nullptr;
+
+SolverContext *SolverContext::getCurrent() { return currentContext; }
+
+void SolverContext::setQueryCacheCapacity(size_t capacity) {
+  queryCache.setCapacity(capacity);
+}
+
+size_t SolverContext::getQueryCacheCapacity() const {
+  return queryCache.getCapacity();
+}
+
+void SolverContext::clearQueryCache() { queryCache.clear(); }
+
+QueryCacheStats SolverContext::getQueryCacheStats() const {
+  return queryCache.getStats();
+}
+
+void SolverContext::setMaxNumThreads(unsigned numThreads) {
+  maxNumThreads.store(numThreads, std::memory_order_relaxed);
+}
+
+unsigned SolverContext::getMaxNumThreads() const {
+  return maxNumThreads.load(std::memory_order_relaxed);
+}
+
+void SolverContext::setArenaChunkSize(size_t chunkSize) {
+  arenaChunkSize.store(chunkSize, std::memory_order_relaxed);
+}
+
+size_t SolverContext::getArenaChunkSize() const {
+  return arenaChunkSize.load(std::memory_order_relaxed);
+}
+
+::presburger::Statistics SolverContext::getStatistics() const {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  return stats;
+}
+
+void SolverContext::resetStatistics() {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  stats = ::presburger::Statistics();
+}
+
+void SolverContext::addStatistics(const ::presburger::Statistics &other) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  stats += other;
+}
+
+SolverContextScope::SolverContextScope(SolverContext &context)
+    : context(context), previous(currentScope), isNested(false) {
+  for (const SolverContextScope *scope = previous; scope;
+       scope = scope->previous) {
+    if (&scope->context == &context) {
+      isNested = true;
+      break;
+    }
+  }
+  if (!isNested)
+    startStats = ::presburger::detail::getThreadTotals();
+  if (size_t chunkSize = context.getArenaChunkSize())
+    arena.emplace(chunkSize);
+  currentScope = this;
+  currentContext = &context;
+}
+
+SolverContextScope::~SolverContextScope() {
+  assert(currentScope == this && "Scopes must end in reverse order");
+  // End the arena before restoring the previous scope, so that arenas nest
+  // like the scopes owning them.
+  arena.reset();
+  currentScope = previous;
+  currentContext = previous ? &previous->context : nullptr;
+  if (!isNested)
+    context.addStatistics(::presburger::detail::getThreadTotals() - startStats);
+}
@@ -0,0 +1,144 @@
+//===- Statistics.cpp - MLIR Presburger Statistics ------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+
+#include "Statistics.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+using namespace presburger;
+using namespace detail;
+
+/// Apply `fn` to each pair of corresponding fields of `a` and `b`.
+template <typename Fn>
+static void forEachField(Statistics &a, const Statistics &b, Fn fn) {
+  fn(a.numPivots, b.numPivots);
+  fn(a.numDegeneratePivots, b.numDegeneratePivots);
+  fn(a.numPivotRuleFallbacks, b.numPivotRuleFallbacks);
+  fn(a.numRollbacks, b.numRollbacks);
+  fn(a.numMPIntPromotions, b.numMPIntPromotions);
+  fn(a.numGBRLevels, b.numGBRLevels);
+  fn(a.numBasisReductions, b.numBasisReductions);
+  fn(a.numFMRowsGenerated, b.numFMRowsGenerated);
+  fn(a.numSubtractFrames, b.numSubtractFrames);
+  fn(a.numCoalescePairs, b.numCoalescePairs);
+  fn(a.numCoalesceContained, b.numCoalesceContained);
+  fn(a.numCoalesceCut, b.numCoalesceCut);
+  fn(a.integerSampleNanoseconds, b.integerSampleNanoseconds);
+  fn(a.fourierMotzkinNanoseconds, b.fourierMotzkinNanoseconds);
+  fn(a.subtractNanoseconds, b.subtractNanoseconds);
+  fn(a.coalesceNanoseconds, b.coalesceNanoseconds);
+}
+
+Statistics &Statistics::operator+=(const Statistics &other) {
+  forEachField(*this, other, [](uint64_t &x, uint64_t y) { x += y; });
+  return *this;
+}
+
+Statistics &Statistics::operator-=(const Statistics &other) {
+  forEachField(*this, other, [](uint64_t &x, uint64_t y) { x -= y; });
+  return *this;
+}
+
+/// Return the total values of the counters of `counters`.
+static Statistics readCounters(const ThreadCounters &counters) {
+  auto count = [&](StatKind kind) {
+    return counters.counts[static_cast<unsigned>(kind)].load(
+        std::memory_order_relaxed);
+  };
+  auto time = [&](TimerKind kind) {
+    return counters.nanoseconds[static_cast<unsigned>(kind)].load(
+        std::memory_order_relaxed);
+  };
+
+  Statistics stats;
+  stats.numPivots = count(StatKind::NumPivots);
+  stats.numDegeneratePivots = count(StatKind::NumDegeneratePivots);
+  stats.numPivotRuleFallbacks = count(StatKind::NumPivotRuleFallbacks);
+  stats.numRollbacks = count(StatKind::NumRollbacks);
+  stats.numMPIntPromotions = count(StatKind::NumMPIntPromotions);
+  stats.numGBRLevels = count(StatKind::NumGBRLevels);
+  stats.numBasisReductions = count(StatKind::NumBasisReductions);
+  stats.numFMRowsGenerated = count(StatKind::NumFMRowsGenerated);
+  stats.numSubtractFrames = count(StatKind::NumSubtractFrames);
+  stats.numCoalescePairs = count(StatKind::NumCoalescePairs);
+  stats.numCoalesceContained = count(StatKind::NumCoalesceContained);
+  stats.numCoalesceCut = count(StatKind::NumCoalesceCut);
+  stats.integerSampleNanoseconds = time(TimerKind::IntegerSample);
+  stats.fourierMotzkinNanoseconds = time(TimerKind::FourierMotzkin);
+  stats.subtractNanoseconds = time(TimerKind::Subtract);
+  stats.coalesceNanoseconds = time(TimerKind::Coalesce);
+  return stats;
+}
+
+namespace {
+/// The counters of all the live threads, and the totals of the threads that
+/// have exited.
+struct ThreadRegistry {
+  std::mutex mutex;
+  std::vector<const ThreadCounters *> threads;
+  Statistics retired;
+  /// The totals at the last call to resetStatistics.
+  Statistics baseline;
+
+  /// Return the totals over all threads. The mutex must be held.
+  Statistics getTotals() {
+    Statistics totals = retired;
+    for (const ThreadCounters *counters : threads)
+      totals += readCounters(*counters);
+    return totals;
+  }
+};
+} // namespace
+
+static ThreadRegistry &getThreadRegistry() {
+  static ThreadRegistry registry;
+  return registry;
+}
+
+thread_local ThreadCounters detail::threadCounters;
+
+ThreadCounters::ThreadCounters() {
+  for (std::atomic<uint64_t> &counter : counts)
+    counter.store(0, std::memory_order_relaxed);
+  for (std::atomic<uint64_t> &counter : nanoseconds)
+    counter.store(0, std::memory_order_relaxed);
+  ThreadRegistry &registry = getThreadRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.threads.push_back(this);
+}
+
+ThreadCounters::~ThreadCounters() {
+  ThreadRegistry &registry = getThreadRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.retired += readCounters(*this);
+  registry.threads.erase(
+      std::find(registry.threads.begin(), registry.threads.end(), this));
+}
+
+Statistics presburger::getStatistics() {
+  ThreadRegistry &registry = getThreadRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.getTotals() - registry.baseline;
+}
+
+void presburger::resetStatistics() {
+  ThreadRegistry &registry = getThreadRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.baseline = registry.getTotals();
+}
+
+Statistics detail::getThreadTotals() { return readCounters(threadCounters); }
+
+Statistics presburger::getThreadStatistics() {
+  return getThreadTotals() - threadCounters.threadBaseline;
+}
+
+void presburger::resetThreadStatistics() {
+  threadCounters.threadBaseline = readCounters(threadCounters);
+}
@@ -15,8 +15,10 @@
 #include "MPInt.h"
 #include <numeric>
 
+#include <limits>
 #include <numeric>
 #include <optional>
+#include <unordered_map>
 
 using namespace mlir;
 using namespace presburger;
@@ -310,26 +312,40 @@ void presburger::mergeLocalVars(
 SmallVector<MPInt, 8> presburger::getDivUpperBound(ArrayRef<MPInt> dividend,
                                                    const MPInt &divisor,
                                                    unsigned localVarIdx) {
-  assert(divisor > 0 && "divisor must be positive!");
-  assert(dividend[localVarIdx] == 0 &&
-         "Local to be set to division must have zero coeff!");
-  SmallVector<MPInt, 8> ineq(dividend.begin(), dividend.end());
-  ineq[localVarIdx] = -divisor;
+  SmallVector<MPInt, 8> ineq;
+  getDivUpperBound(dividend, divisor, localVarIdx, ineq);
   return ineq;
 }
 
 SmallVector<MPInt, 8> presburger::getDivLowerBound(ArrayRef<MPInt> dividend,
                                                    const MPInt &divisor,
                                                    unsigned localVarIdx) {
+  SmallVector<MPInt, 8> ineq;
+  getDivLowerBound(dividend, divisor, localVarIdx, ineq);
+  return ineq;
+}
+
+void presburger::getDivUpperBound(ArrayRef<MPInt> dividend,
+                                  const MPInt &divisor, unsigned localVarIdx,
+                                  SmallVectorImpl<MPInt> &ineq) {
   assert(divisor > 0 && "divisor must be positive!");
   assert(dividend[localVarIdx] == 0 &&
          "Local to be set to division must have zero coeff!");
-  SmallVector<MPInt, 8> ineq(dividend.size());
+  ineq.assign(dividend.begin(), dividend.end());
+  ineq[localVarIdx] = -divisor;
+}
+
+void presburger::getDivLowerBound(ArrayRef<MPInt> dividend,
+                                  const MPInt &divisor, unsigned localVarIdx,
+                                  SmallVectorImpl<MPInt> &ineq) {
+  assert(divisor > 0 && "divisor must be positive!");
+  assert(dividend[localVarIdx] == 0 &&
+         "Local to be set to division must have zero coeff!");
+  ineq.resize(dividend.size());
   std::transform(dividend.begin(), dividend.end(), ineq.begin(),
                  std::negate<MPInt>());
   ineq[localVarIdx] = divisor;
   ineq.back() += divisor - 1;
-  return ineq;
 }
 
 MPInt presburger::gcdRange(ArrayRef<MPInt> range) {
@@ -347,10 +363,43 @@ MPInt presburger::normalizeRange(MutableArrayRef<MPInt> range) {
   if ((gcd == 0) || (gcd == 1))
     return gcd;
   for (MPInt &elem : range)
-    elem /= gcd;
+    elem.divByPositiveInPlace(gcd);
   return gcd;
 }
 
+bool presburger::normalizeConstraint(ArrayRef<MPInt> row, bool isEq,
+                                     SmallVectorImpl<MPInt> &normalized) {
+  MPInt gcd = gcdRange(row.drop_back());
+  if (gcd == 0)
+    return false;
+  normalized.assign(row.begin(), row.end());
+  if (isEq) {
+    gcd = presburger::gcd(gcd, abs(row.back()));
+    auto firstNonZero = llvm::find_if(row, [](const MPInt &c) {
+      return c != 0;
+    });
+    if (*firstNonZero < 0)
+      gcd = -gcd;
+    for (MPInt &c : normalized)
+      c /= gcd;
+    return true;
+  }
+  if (gcd == 1)
+    return true;
+  for (MPInt &c : MutableArrayRef<MPInt>(normalized).drop_back())
+    c.divByPositiveInPlace(gcd);
+  normalized.back() = floorDiv(normalized.back(), gcd);
+  return true;
+}
+
+hash_code presburger::hashRange(ArrayRef<MPInt> range) {
+  size_t hash = range.size();
+  for (const MPInt &elem : range)
+    hash ^= size_t(hash_value(elem)) + 0x9e3779b97f4a7c15ULL + (hash << 6) +
+            (hash >> 2);
+  return hash;
+}
+
 void presburger::normalizeDiv(MutableArrayRef<MPInt> num, MPInt &denom) {
   assert(denom > 0 && "denom must be positive!");
   MPInt gcd = presburger::gcd(gcdRange(num), denom);
@@ -361,21 +410,29 @@ void presburger::normalizeDiv(MutableArrayRef<MPInt> num, MPInt &denom) {
 
 SmallVector<MPInt, 8> presburger::getNegatedCoeffs(ArrayRef<MPInt> coeffs) {
   SmallVector<MPInt, 8> negatedCoeffs;
-  negatedCoeffs.reserve(coeffs.size());
-  for (const MPInt &coeff : coeffs)
-    negatedCoeffs.emplace_back(-coeff);
+  getNegatedCoeffs(coeffs, negatedCoeffs);
   return negatedCoeffs;
 }
 
+void presburger::getNegatedCoeffs(ArrayRef<MPInt> coeffs,
+                                  SmallVectorImpl<MPInt> &negated) {
+  negated.resize(coeffs.size());
+  std::transform(coeffs.begin(), coeffs.end(), negated.begin(),
+                 std::negate<MPInt>());
+}
+
 SmallVector<MPInt, 8> presburger::getComplementIneq(ArrayRef<MPInt> ineq) {
   SmallVector<MPInt, 8> coeffs;
-  coeffs.reserve(ineq.size());
-  for (const MPInt &coeff : ineq)
-    coeffs.emplace_back(-coeff);
-  --coeffs.back();
+  getComplementIneq(ineq, coeffs);
   return coeffs;
 }
 
+void presburger::getComplementIneq(ArrayRef<MPInt> ineq,
+                                   SmallVectorImpl<MPInt> &complement) {
+  getNegatedCoeffs(ineq, complement);
+  --complement.back();
+}
+
 SmallVector<std::optional<MPInt>, 4>
 DivisionRepr::divValuesAt(ArrayRef<MPInt> point) const {
   assert(point.size() == getNumNonDivs() && "Incorrect point size");
@@ -435,38 +492,65 @@ void DivisionRepr::removeDuplicateDivs(
   // variable at position `i` only depends on local variables at position <
   // `i`. This would make sure that all divisions depending on other local
   // variables that can be merged, are merged.
-  for (unsigned i = 0; i < getNumDivs(); ++i) {
-    // Check if a division representation exists for the `i^th` local var.
-    if (denoms[i] == 0)
+  //
+  // The divisions are visited in order, and each one is merged into the first
+  // previous division equal to it for which `merge` succeeds. The previous
+  // divisions are indexed by the hash of their dividend and denominator, so
+  // that candidates are found without comparing every pair.
+  auto hashDiv = [this](unsigned i) -> size_t {
+    return hash_value(hashRange(dividends.getRow(i))) ^
+           (size_t(hash_value(denoms[i])) * 0x9e3779b97f4a7c15ULL);
+  };
+  std::unordered_multimap<size_t, unsigned> index;
+  auto buildIndex = [&](unsigned end) {
+    index.clear();
+    for (unsigned i = 0; i < end; ++i)
+      if (denoms[i] != 0)
+        index.emplace(hashDiv(i), i);
+  };
+
+  for (unsigned j = 0; j < getNumDivs();) {
+    // Check if a division representation exists for the `j^th` local var.
+    if (denoms[j] == 0) {
+      ++j;
       continue;
-    // Check if a division exists which is a duplicate of the division at `i`.
-    for (unsigned j = i + 1; j < getNumDivs(); ++j) {
-      // Check if a division representation exists for the `j^th` local var.
-      if (denoms[j] == 0)
-        continue;
-      // Check if the denominators match.
-      if (denoms[i] != denoms[j])
-        continue;
-      // Check if the representations are equal.
-      if (dividends.getRow(i) != dividends.getRow(j))
-        continue;
+    }
 
-      // Merge divisions at position `j` into division at position `i`. If
-      // merge fails, do not merge these divs.
-      bool mergeResult = merge(i, j);
-      if (!mergeResult)
+    // Collect the previous divisions equal to the one at `j`, in order.
+    size_t hash = hashDiv(j);
+    SmallVector<unsigned, 4> candidates;
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+      if (denoms[it->second] == denoms[j] &&
+          dividends.getRow(it->second) == dividends.getRow(j))
+        candidates.push_back(it->second);
+    llvm::sort(candidates);
+
+    // Merge the division at position `j` into the first candidate `i` for
+    // which merge succeeds.
+    unsigned divOffset = getDivOffset();
+    bool merged = false;
+    for (unsigned i : candidates) {
+      if (!merge(i, j))
         continue;
 
-      // Update division information to reflect merging.
-      unsigned divOffset = getDivOffset();
+      // Update division information to reflect merging. Removing the column
+      // of division `j` changes the length of every dividend and the position
+      // of their constant terms, so the hashes of the previous divisions are
+      // computed again.
       dividends.addToColumn(divOffset + j, divOffset + i, /*scale=*/1);
       dividends.removeColumn(divOffset + j);
       dividends.removeRow(j);
       denoms.erase(denoms.begin() + j);
-
-      // Since `j` can never be zero, we do not need to worry about overflows.
-      --j;
+      buildIndex(j);
+      merged = true;
+      break;
     }
+    if (merged)
+      continue;
+
+    index.emplace(hash, j);
+    ++j;
   }
 }
 
@@ -505,7 +589,103 @@ SmallVector<MPInt, 8> presburger::getMPIntVec(ArrayRef<int64_t> range) {
 }
 
 SmallVector<int64_t, 8> presburger::getInt64Vec(ArrayRef<MPInt> range) {
-  SmallVector<int64_t, 8> result(range.size());
-  std::transform(range.begin(), range.end(), result.begin(), int64FromMPInt);
+  SmallVector<int64_t, 8> result;
+  getInt64Vec(range, result);
   return result;
 }
+
+void presburger::getInt64Vec(ArrayRef<MPInt> range,
+                             SmallVectorImpl<int64_t> &result) {
+  result.resize(range.size());
+  std::transform(range.begin(), range.end(), result.begin(), int64FromMPInt);
+}
+
+bool presburger::getInt64VecIfFits(ArrayRef<MPInt> range,
+                                   SmallVectorImpl<int64_t> &result) {
+  result.clear();
+  result.reserve(range.size());
+  for (const MPInt &x : range) {
+    if (x < std::numeric_limits<int64_t>::min() ||
+        x > std::numeric_limits<int64_t>::max())
+      return false;
+    result.push_back(int64_t(x));
+  }
+  return true;
+}
+
+void presburger::evaluateAffineBatch(ArrayRef<int64_t> expr,
+                                     ArrayRef<int64_t> points,
+                                     unsigned numPoints,
+                                     MutableArrayRef<int64_t> out,
+                                     MutableArrayRef<bool> overflow) {
+  assert(!expr.empty() && "expression must have a constant term");
+  unsigned numVars = expr.size() - 1;
+  assert(points.size() >= size_t(numVars) * numPoints &&
+         "too few values for the points");
+  assert(out.size() >= numPoints && overflow.size() >= numPoints &&
+         "output buffers are too small");
+
+  std::fill(out.begin(), out.begin() + numPoints, expr.back());
+  for (unsigned v = 0; v < numVars; ++v) {
+    int64_t coeff = expr[v];
+    if (coeff == 0)
+      continue;
+    const int64_t *column = points.data() + size_t(v) * numPoints;
+    // The loop is kept branch-free so that it can be vectorized.
+    for (unsigned p = 0; p < numPoints; ++p) {
+      int64_t term;
+      bool mulOverflowed = detail::mulOverflow(coeff, column[p], term);
+      bool addOverflowed = detail::addOverflow(out[p], term, out[p]);
+      overflow[p] |= mulOverflowed | addOverflowed;
+    }
+  }
+}
+
+bool DivisionRepr::divValuesAtBatch(MutableArrayRef<int64_t> values,
+                                    unsigned numPoints,
+                                    MutableArrayRef<bool> overflow) const {
+  assert(hasAllReprs() && "all divisions must have a representation");
+  assert(values.size() >= size_t(getNumVars()) * numPoints &&
+         "too few values for the points");
+
+  SmallVector<SmallVector<int64_t, 8>, 4> dividends(getNumDivs());
+  SmallVector<int64_t, 4> denoms64;
+  for (unsigned i = 0, e = getNumDivs(); i < e; ++i)
+    if (!getInt64VecIfFits(getDividend(i), dividends[i]))
+      return false;
+  if (!getInt64VecIfFits(denoms, denoms64))
+    return false;
+
+  // Compute the divisions in an order where every division only depends on
+  // divisions computed before it, as in divValuesAt.
+  SmallVector<bool, 4> computed(getNumDivs(), false);
+  SmallVector<int64_t, 8> column(numPoints);
+  for (unsigned numComputed = 0, e = getNumDivs(); numComputed < e;) {
+    unsigned prevNumComputed = numComputed;
+    for (unsigned i = 0; i < e; ++i) {
+      if (computed[i])
+        continue;
+      ArrayRef<int64_t> dividend = dividends[i];
+      bool ready = true;
+      for (unsigned j = 0; j < e; ++j)
+        if (dividend[getDivOffset() + j] != 0 && !computed[j])
+          ready = false;
+      if (!ready)
+        continue;
+
+      evaluateAffineBatch(dividend, values, numPoints, column, overflow);
+      int64_t denom = denoms64[i];
+      int64_t *divColumn =
+          values.data() + size_t(getDivOffset() + i) * numPoints;
+      // Floor division by a positive denominator cannot overflow.
+      for (unsigned p = 0; p < numPoints; ++p)
+        divColumn[p] = column[p] / denom - (column[p] % denom < 0);
+      computed[i] = true;
+      ++numComputed;
+    }
+    assert(numComputed > prevNumComputed &&
+           "divisions must not depend on each other cyclically");
+    (void)prevNumComputed;
+  }
+  return true;
+}
@@ -1,4 +1,205 @@
 #include "IntegerRelation.h"
+#include "Simplex.h"
+#include "SmallSimplex.h"
+#include "Utils.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace mlir;
+using namespace presburger;
+
+#define CHECK(COND)                                                            \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,    \
+                   #COND);                                                     \
+      std::abort();                                                            \
+    }                                                                          \
+  } while (false)
+
+/// Return whether `a` and `b` have the same space and the same constraints in
+/// the same order.
+static bool haveSameConstraints(const IntegerRelation &a,
+                                const IntegerRelation &b) {
+  if (!a.getSpace().isEqual(b.getSpace()) ||
+      a.getNumEqualities() != b.getNumEqualities() ||
+      a.getNumInequalities() != b.getNumInequalities())
+    return false;
+  for (unsigned i = 0, e = a.getNumEqualities(); i < e; ++i)
+    if (a.getEquality(i) != b.getEquality(i))
+      return false;
+  for (unsigned i = 0, e = a.getNumInequalities(); i < e; ++i)
+    if (a.getInequality(i) != b.getInequality(i))
+      return false;
+  return true;
+}
+
+/// Eliminating several vars by Fourier-Motzkin replaces the relation once per
+/// var; rolling back must still restore the original constraints.
+static void testRollbackProjectOut() {
+  IntegerPolyhedron poly(PresburgerSpace::getSetSpace(3));
+  // x >= 0, y >= 0, x + y <= z, z <= 10, x - y + z >= 1.
+  poly.addInequality({1, 0, 0, 0});
+  poly.addInequality({0, 1, 0, 0});
+  poly.addInequality({-1, -1, 1, 0});
+  poly.addInequality({0, 0, -1, 10});
+  poly.addInequality({1, -1, 1, -1});
+  IntegerPolyhedron original = poly;
+
+  unsigned snapshot = poly.getSnapshot();
+  poly.projectOut(0, 2);
+  CHECK(poly.getNumVars() == 1);
+  poly.rollback(snapshot);
+  CHECK(haveSameConstraints(poly, original));
+  CHECK(poly.isEqual(original));
+}
+
+/// Incremental basis reduction may find a different sample, but must agree
+/// on whether there is one, and the sample must be in the polytope.
+static void testIncrementalBasisReduction() {
+  SmallVector<IntegerPolyhedron, 4> polys;
+  // A thin slanted strip: 0 <= 7x - 11y - 1 <= 3, 0 <= x, y <= 100.
+  IntegerPolyhedron strip(PresburgerSpace::getSetSpace(2));
+  strip.addInequality({7, -11, -1});
+  strip.addInequality({-7, 11, 4});
+  strip.addInequality({1, 0, 0});
+  strip.addInequality({-1, 0, 100});
+  strip.addInequality({0, 1, 0});
+  strip.addInequality({0, -1, 100});
+  polys.push_back(strip);
+  // The same strip, but 2x - 2y = 1 has no integer solution.
+  IntegerPolyhedron empty = strip;
+  empty.addInequality({2, -2, -1});
+  empty.addInequality({-2, 2, 1});
+  polys.push_back(empty);
+  // A thin slanted box in three dimensions.
+  IntegerPolyhedron thin(PresburgerSpace::getSetSpace(3));
+  thin.addInequality({3, -5, 2, -1});
+  thin.addInequality({-3, 5, -2, 3});
+  thin.addInequality({1, 1, -7, 0});
+  thin.addInequality({-1, -1, 7, 5});
+  thin.addInequality({1, 0, 0, 20});
+  thin.addInequality({-1, 0, 0, 20});
+  thin.addInequality({0, 1, 0, 20});
+  thin.addInequality({0, -1, 0, 20});
+  polys.push_back(thin);
+
+  for (const IntegerPolyhedron &poly : polys) {
+    Simplex fresh(poly), incremental(poly);
+    incremental.setIncrementalBasisReduction(true);
+    std::optional<SmallVector<MPInt, 8>> expected = fresh.findIntegerSample();
+    std::optional<SmallVector<MPInt, 8>> sample =
+        incremental.findIntegerSample();
+    CHECK(expected.has_value() == sample.has_value());
+    if (sample) {
+      CHECK(poly.containsPoint(*expected));
+      CHECK(poly.containsPoint(*sample));
+    }
+  }
+}
+
+/// Merging a division shortens every dividend, which must not stop later
+/// duplicates from being found.
+static void testRemoveDuplicateDivs() {
+  auto alwaysMerge = [](unsigned, unsigned) { return true; };
+
+  // [d0, d1] followed by a copy of it, as mergeLocalVars builds when both
+  // relations have the same divisions: d0 = floor(x / 2) and
+  // d1 = floor((x + d0) / 3), over the columns [x, d0, d1, d0', d1', 1].
+  DivisionRepr twice(/*numVars=*/5, /*numDivs=*/4);
+  twice.setDiv(0, getMPIntVec({1, 0, 0, 0, 0, 0}), MPInt(2));
+  twice.setDiv(1, getMPIntVec({1, 1, 0, 0, 0, 0}), MPInt(3));
+  twice.setDiv(2, getMPIntVec({1, 0, 0, 0, 0, 0}), MPInt(2));
+  twice.setDiv(3, getMPIntVec({1, 0, 0, 1, 0, 0}), MPInt(3));
+  twice.removeDuplicateDivs(alwaysMerge);
+  CHECK(twice.getNumDivs() == 2);
+  CHECK(twice.getDividend(1) == ArrayRef<MPInt>(getMPIntVec({1, 1, 0, 0})));
+
+  // Three copies of floor(x / 2), over the columns [x, d0, d1, d2, 1].
+  DivisionRepr thrice(/*numVars=*/4, /*numDivs=*/3);
+  for (unsigned i = 0; i < 3; ++i)
+    thrice.setDiv(i, getMPIntVec({1, 0, 0, 0, 0}), MPInt(2));
+  thrice.removeDuplicateDivs(alwaysMerge);
+  CHECK(thrice.getNumDivs() == 1);
+}
+
+/// Return the answer of isIntegerEmptyBySmallSimplex on the bounded `poly`,
+/// after checking that, if it decided, it agrees with Simplex and any sample
+/// it found is in `poly`.
+static std::optional<bool>
+checkSmallSimplexAgrees(const IntegerPolyhedron &poly) {
+  SmallVector<MPInt, 8> sample;
+  std::optional<bool> isEmpty = isIntegerEmptyBySmallSimplex(poly, sample);
+  if (!isEmpty)
+    return isEmpty;
+  Simplex simplex(poly);
+  CHECK(*isEmpty == !simplex.findIntegerSample().has_value());
+  if (!*isEmpty)
+    CHECK(poly.containsPoint(sample));
+  return isEmpty;
+}
+
+/// The fixed-size Simplex must either give up or agree with Simplex.
+static void testSmallSimplex() {
+  // 0 <= x, y <= 5 and x + y = 3, whose first vertex is already integral.
+  IntegerPolyhedron line(PresburgerSpace::getSetSpace(2));
+  line.addInequality({1, 0, 0});
+  line.addInequality({-1, 0, 5});
+  line.addInequality({0, 1, 0});
+  line.addInequality({0, -1, 5});
+  line.addEquality({1, 1, -3});
+  CHECK(checkSmallSimplexAgrees(line) == false);
+
+  // The same box with 2x + 4y = 6, and with 2x + 4y = 5, which has no
+  // integer solution.
+  IntegerPolyhedron even = line;
+  even.removeEquality(0);
+  even.addEquality({2, 4, -6});
+  checkSmallSimplexAgrees(even);
+  IntegerPolyhedron odd = line;
+  odd.removeEquality(0);
+  odd.addEquality({2, 4, -5});
+  checkSmallSimplexAgrees(odd);
+
+  // The same box with x + y >= 11, which is rationally empty.
+  IntegerPolyhedron outside = line;
+  outside.removeEquality(0);
+  outside.addInequality({1, 1, -11});
+  CHECK(checkSmallSimplexAgrees(outside) == true);
+
+  // A thin slanted box in three dimensions, which needs branching.
+  IntegerPolyhedron thin(PresburgerSpace::getSetSpace(3));
+  thin.addInequality({3, -5, 2, -1});
+  thin.addInequality({-3, 5, -2, 3});
+  thin.addInequality({1, 1, -7, 0});
+  thin.addInequality({-1, -1, 7, 5});
+  thin.addInequality({1, 0, 0, 20});
+  thin.addInequality({-1, 0, 0, 20});
+  thin.addInequality({0, 1, 0, 20});
+  thin.addInequality({0, -1, 0, 20});
+  checkSmallSimplexAgrees(thin);
+
+  // x >= 0, y >= 0, x - y >= 1 is unbounded and contains integer points.
+  IntegerPolyhedron cone(PresburgerSpace::getSetSpace(2));
+  cone.addInequality({1, 0, 0});
+  cone.addInequality({0, 1, 0});
+  cone.addInequality({1, -1, -1});
+  SmallVector<MPInt, 8> sample;
+  std::optional<bool> isEmpty = isIntegerEmptyBySmallSimplex(cone, sample);
+  CHECK(isEmpty != true);
+  if (isEmpty)
+    CHECK(cone.containsPoint(sample));
+
+  // 2x - 2y = 1 is unbounded and has no integer point, but is not empty
+  // along any branch, so branch and bound must give up.
+  IntegerPolyhedron unboundedEmpty(PresburgerSpace::getSetSpace(2));
+  unboundedEmpty.addEquality({2, -2, -1});
+  CHECK(!isIntegerEmptyBySmallSimplex(unboundedEmpty, sample).has_value());
+}
 
 int main() {
+  testRollbackProjectOut();
+  testIncrementalBasisReduction();
+  testRemoveDuplicateDivs();
+  testSmallSimplex();
 }